@@ -10,20 +10,38 @@ VPATH += code
 
 SOURCES += \
     code/camera.cpp \
+    code/clothbroadphase.cpp \
+    code/clothbuilder.cpp \
+    code/clothmultigrid.cpp \
+    code/clothselfcollision.cpp \
+    code/clothsleep.cpp \
+    code/clothtearing.cpp \
+    code/clothwind.cpp \
     code/colliders.cpp \
+    code/flipfluid.cpp \
+    code/fluidadaptivity.cpp \
+    code/fluidboundary.cpp \
+    code/fluidemitter.cpp \
+    code/fluidsimulation.cpp \
+    code/fluidsleep.cpp \
+    code/fluidsurface.cpp \
     code/forces.cpp \
     code/glutils.cpp \
     code/glwidget.cpp \
+    code/gridfluid.cpp \
     code/integrators.cpp \
     code/main.cpp \
     code/mainwindow.cpp \
     code/model.cpp \
+    code/particlebvh.cpp \
     code/particlehashgrid.cpp \
+    code/particlepool.cpp \
     code/particlesystem.cpp \
     code/scenecloth.cpp \
     code/scenefluid.cpp \
     code/scenefountain.cpp \
     code/sceneprojectiles.cpp \
+    code/threadpool.cpp \
     code/widgetcloth.cpp \
     code/widgetfluid.cpp \
     code/widgetfountain.cpp \
@@ -31,21 +49,40 @@ SOURCES += \
 
 HEADERS += \
     code/camera.h \
+    code/clothbroadphase.h \
+    code/clothbuilder.h \
+    code/clothmultigrid.h \
+    code/clothselfcollision.h \
+    code/clothsleep.h \
+    code/clothtearing.h \
+    code/clothwind.h \
     code/colliders.h \
     code/defines.h \
+    code/flipfluid.h \
+    code/fluidadaptivity.h \
+    code/fluidboundary.h \
+    code/fluidemitter.h \
+    code/fluidsimulation.h \
+    code/fluidsleep.h \
+    code/fluidsurface.h \
     code/forces.h \
     code/glutils.h \
     code/glwidget.h \
+    code/gridfluid.h \
     code/integrators.h \
     code/mainwindow.h \
     code/model.h \
     code/particle.h \
+    code/particlebvh.h \
     code/particlehashgrid.h \
+    code/particlepool.h \
     code/particlesystem.h \
     code/scene.h \
     code/scenecloth.h \
     code/scenefluid.h \
     code/scenefountain.h \
+    code/sphkernels.h \
+    code/threadpool.h \
     code/sceneprojectiles.h \
     code/widgetcloth.h \
     code/widgetfluid.h \
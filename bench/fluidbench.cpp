@@ -0,0 +1,209 @@
+/*
+ *  Standalone fluid step benchmark, no Qt needed.
+ *  Loads a dam break setup of each size and runs the full SPH step with several thread
+ *  counts, writing one CSV row per size and thread count with the step throughput and the
+ *  time spent in each phase of the pipeline.
+ *
+ *  --engine flip or apic steps the same particles with a hybrid grid solver instead of SPH.
+ *  With --grid the same tanks run on the grid fluid instead, with one cell per particle
+ *  spacing, so the two engines can be compared at the same resolution.
+ *
+ *  usage: fluidbench [--sizes N,N,...] [--threads T,T,...] [--steps S] [--warmup W]
+ *                    [--dt DT] [--pcisph] [--precision double|mixed|kahan]
+ *                    [--engine sph|flip|apic] [--grid] [--out file.csv]
+ */
+
+#include "fluidsimulation.h"
+#include "gridfluid.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace {
+
+const double particleRadius = 1.0;
+
+typedef std::chrono::steady_clock Clock;
+
+double msSince(const Clock::time_point& t0) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+std::vector<long long> parseList(const char* s) {
+    std::vector<long long> values;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) values.push_back(atoll(item.c_str()));
+    }
+    return values;
+}
+
+void runGrid(const std::vector<long long>& sizes, const std::vector<long long>& threads,
+             int steps, int warmup, double dt, std::ostream& out)
+{
+    out << "solver,cells,particles,threads,load_ms,steps,ms_per_step,cells_per_s";
+    for (int i = 0; i < GridFluid::NumPhases; i++) {
+        out << "," << GridFluid::phaseName(i) << "_ms";
+    }
+    out << ",cg_iterations,dye_ratio" << std::endl;
+
+    ThreadPool pool;
+    GridFluid grid(&pool);
+
+    for (long long size : sizes) {
+        Clock::time_point t0 = Clock::now();
+        pool.setNumThreads(ThreadPool::hardwareThreads());
+        FluidSetup setup = FluidSetup::damBreak(size, particleRadius);
+        grid.load(setup, setup.particleSpacing);
+        double loadMs = msSince(t0);
+        double dye0 = grid.getTotalDye();
+
+        for (long long numThreads : threads) {
+            pool.setNumThreads(int(numThreads));
+            for (int s = 0; s < warmup; s++) {
+                grid.step(dt);
+            }
+
+            double phaseMs[GridFluid::NumPhases] = {0};
+            double iterations = 0;
+            t0 = Clock::now();
+            for (int s = 0; s < steps; s++) {
+                grid.step(dt);
+                for (int i = 0; i < GridFluid::NumPhases; i++) {
+                    phaseMs[i] += grid.getPhaseMs(i);
+                }
+                iterations += grid.getLastIterations();
+            }
+            double totalMs = msSince(t0);
+
+            double n = double(grid.getNumCells());
+            double msPerStep = totalMs / std::max(steps, 1);
+            out << "grid," << grid.getNumCells() << "," << setup.numBlockParticles() << ","
+                << numThreads << "," << loadMs << "," << steps << "," << msPerStep << ","
+                << (msPerStep > 0 ? 1000.0 * n / msPerStep : 0.0);
+            for (int i = 0; i < GridFluid::NumPhases; i++) {
+                out << "," << phaseMs[i] / std::max(steps, 1);
+            }
+            out << "," << iterations / std::max(steps, 1) << ","
+                << (dye0 > 0 ? grid.getTotalDye() / dye0 : 0.0) << std::endl;
+        }
+    }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<long long> sizes = {1000000, 2000000, 5000000, 10000000};
+    std::vector<long long> threads;
+    int steps = 10;
+    int warmup = 2;
+    double dt = 0.005;
+    bool pcisph = false;
+    bool grid = false;
+    std::string engine = "sph";
+    std::string precision = "double";
+    std::string outPath;
+
+    for (int a = 1; a < argc; a++) {
+        if (!strcmp(argv[a], "--sizes") && a + 1 < argc)        sizes = parseList(argv[++a]);
+        else if (!strcmp(argv[a], "--threads") && a + 1 < argc) threads = parseList(argv[++a]);
+        else if (!strcmp(argv[a], "--steps") && a + 1 < argc)   steps = atoi(argv[++a]);
+        else if (!strcmp(argv[a], "--warmup") && a + 1 < argc)  warmup = atoi(argv[++a]);
+        else if (!strcmp(argv[a], "--dt") && a + 1 < argc)      dt = atof(argv[++a]);
+        else if (!strcmp(argv[a], "--pcisph"))                  pcisph = true;
+        else if (!strcmp(argv[a], "--precision") && a + 1 < argc) precision = argv[++a];
+        else if (!strcmp(argv[a], "--engine") && a + 1 < argc)  engine = argv[++a];
+        else if (!strcmp(argv[a], "--grid"))                    grid = true;
+        else if (!strcmp(argv[a], "--out") && a + 1 < argc)     outPath = argv[++a];
+        else {
+            std::cerr << "usage: " << argv[0]
+                      << " [--sizes N,N,...] [--threads T,T,...] [--steps S] [--warmup W] [--dt DT]"
+                         " [--pcisph] [--precision double|mixed|kahan] [--engine sph|flip|apic] [--grid]"
+                         " [--out file.csv]" << std::endl;
+            return 1;
+        }
+    }
+
+    // powers of two up to the hardware threads by default
+    if (threads.empty()) {
+        int hw = ThreadPool::hardwareThreads();
+        for (int t = 1; t < hw; t *= 2) threads.push_back(t);
+        threads.push_back(hw);
+    }
+
+    std::ofstream file;
+    if (!outPath.empty()) file.open(outPath);
+    std::ostream& out = outPath.empty() ? std::cout : file;
+    if (grid) {
+        runGrid(sizes, threads, steps, warmup, dt, out);
+        return 0;
+    }
+
+    out << "solver,precision,particles,boundary,threads,load_ms,steps,ms_per_step,particles_per_s";
+    for (int i = 0; i < FluidSimulation::NumPhases; i++) {
+        out << "," << FluidSimulation::phaseName(i) << "_ms";
+    }
+    out << ",avg_neighbors" << std::endl;
+
+    ThreadPool pool;
+    FluidSimulation simulation(&pool);
+
+    for (long long size : sizes) {
+        Clock::time_point t0 = Clock::now();
+        pool.setNumThreads(ThreadPool::hardwareThreads());
+        simulation.load(FluidSetup::damBreak(size, particleRadius));
+        double loadMs = msSince(t0);
+
+        ForceNavierStockes* fluid = simulation.getNavierStokes();
+        fluid->setSolver(pcisph ? ForceNavierStockes::PCISPH : ForceNavierStockes::WCSPH);
+        simulation.setEngine(engine == "flip" ? FluidSimulation::EngineFLIP :
+                             engine == "apic" ? FluidSimulation::EngineAPIC : FluidSimulation::EngineSPH);
+        std::string solver = engine == "flip" || engine == "apic" ? engine : pcisph ? "pcisph" : "wcsph";
+        fluid->setPrecision(precision == "mixed" ? ForceNavierStockes::Mixed :
+                            precision == "kahan" ? ForceNavierStockes::MixedKahan : ForceNavierStockes::Double);
+
+        // thread counts run one after the other on the same collapsing column, the first
+        // steps of a dam break all cost about the same
+        for (long long numThreads : threads) {
+            pool.setNumThreads(int(numThreads));
+            for (int s = 0; s < warmup; s++) {
+                simulation.step(dt);
+            }
+
+            double phaseMs[FluidSimulation::NumPhases] = {0};
+            t0 = Clock::now();
+            for (int s = 0; s < steps; s++) {
+                simulation.step(dt);
+                for (int i = 0; i < FluidSimulation::NumPhases; i++) {
+                    phaseMs[i] += simulation.getPhaseMs(i);
+                }
+            }
+            double totalMs = msSince(t0);
+
+            const std::vector<Particle*>& particles = simulation.getParticles();
+            double neighbors = 0;
+            for (const Particle* p : particles) {
+                neighbors += p->neighbors.size();
+            }
+
+            double n = double(particles.size());
+            double msPerStep = totalMs / std::max(steps, 1);
+            out << solver << "," << precision << "," << particles.size() << ","
+                << simulation.getNumBoundarySamples() << "," << numThreads << ","
+                << loadMs << "," << steps << "," << msPerStep << ","
+                << (msPerStep > 0 ? 1000.0 * n / msPerStep : 0.0);
+            for (int i = 0; i < FluidSimulation::NumPhases; i++) {
+                out << "," << phaseMs[i] / std::max(steps, 1);
+            }
+            out << "," << (n > 0 ? neighbors / n : 0.0) << std::endl;
+        }
+    }
+    return 0;
+}
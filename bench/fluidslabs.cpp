@@ -0,0 +1,183 @@
+/*
+ *  Check of the slab decomposed fluid against the single process run, no Qt needed.
+ *  The same dam break is stepped split into slabs, with one worker process per slab talking
+ *  over Unix sockets (or one thread per slab with --transport local), and in a single
+ *  FluidSimulation. Positions and velocities are then compared particle by particle.
+ *  Exits with 1 if the largest position difference is above the tolerance.
+ *
+ *  usage: fluidslabs [--particles N] [--slabs S] [--steps K] [--dt DT]
+ *                    [--transport socket|local] [--threads T] [--tolerance radii]
+ */
+
+#include "fluidslab.h"
+#include "fluidtransport.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const double particleRadius = 1.0;
+
+typedef std::chrono::steady_clock Clock;
+
+double msSince(const Clock::time_point& t0) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+struct Run {
+    const FluidSetup* setup;
+    const std::vector<double>* slabs;
+    int steps;
+    double dt;
+    int threads;
+};
+
+// steps one slab and gathers on rank 0, returns false if the transport failed
+bool runWorker(const Run& run, FluidTransport* transport, std::vector<Vec3>& positions, std::vector<Vec3>& velocities) {
+    ThreadPool pool(run.threads);
+    FluidSlabWorker worker(*run.setup, *run.slabs, transport, &pool);
+    for (int s = 0; s < run.steps; s++) {
+        if (!worker.step(run.dt)) return false;
+    }
+    return worker.gather(positions, velocities);
+}
+
+bool runLocal(const Run& run, int numSlabs, std::vector<Vec3>& positions, std::vector<Vec3>& velocities) {
+    FluidLocalHub hub(numSlabs);
+    std::vector<FluidLocalTransport*> transports;
+    for (int r = 0; r < numSlabs; r++) {
+        transports.push_back(new FluidLocalTransport(&hub, r));
+    }
+
+    std::vector<char> ok(numSlabs, 0);
+    std::vector<std::thread> threads;
+    for (int r = 1; r < numSlabs; r++) {
+        threads.push_back(std::thread([&, r]() {
+            std::vector<Vec3> unusedPos, unusedVel;
+            ok[r] = runWorker(run, transports[r], unusedPos, unusedVel);
+        }));
+    }
+    ok[0] = runWorker(run, transports[0], positions, velocities);
+    for (std::thread& t : threads) t.join();
+
+    for (FluidLocalTransport* t : transports) delete t;
+    return std::find(ok.begin(), ok.end(), 0) == ok.end();
+}
+
+#ifndef _WIN32
+bool runSockets(const Run& run, int numSlabs, std::vector<Vec3>& positions, std::vector<Vec3>& velocities) {
+    // forked before this process starts any threads
+    std::vector<std::vector<int>> mesh = FluidSocketTransport::createSocketMesh(numSlabs);
+    std::vector<pid_t> children;
+    for (int r = 1; r < numSlabs; r++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            bool ok;
+            {
+                FluidSocketTransport transport(r, mesh);
+                std::vector<Vec3> unusedPos, unusedVel;
+                ok = runWorker(run, &transport, unusedPos, unusedVel);
+            }
+            _exit(ok ? 0 : 1);
+        }
+        children.push_back(pid);
+    }
+
+    bool ok;
+    {
+        FluidSocketTransport transport(0, mesh);
+        ok = runWorker(run, &transport, positions, velocities);
+    }
+    for (pid_t pid : children) {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    return ok;
+}
+#endif
+
+}
+
+int main(int argc, char* argv[]) {
+    long long numParticles = 8000;
+    int numSlabs = 4;
+    int steps = 100;
+    double dt = 0.005;
+    int threads = 1;
+    double tolerance = 1e-6;
+    std::string transport = "socket";
+
+    for (int a = 1; a < argc; a++) {
+        if (!strcmp(argv[a], "--particles") && a + 1 < argc)      numParticles = atoll(argv[++a]);
+        else if (!strcmp(argv[a], "--slabs") && a + 1 < argc)     numSlabs = std::max(1, atoi(argv[++a]));
+        else if (!strcmp(argv[a], "--steps") && a + 1 < argc)     steps = atoi(argv[++a]);
+        else if (!strcmp(argv[a], "--dt") && a + 1 < argc)        dt = atof(argv[++a]);
+        else if (!strcmp(argv[a], "--threads") && a + 1 < argc)   threads = std::max(1, atoi(argv[++a]));
+        else if (!strcmp(argv[a], "--tolerance") && a + 1 < argc) tolerance = atof(argv[++a]);
+        else if (!strcmp(argv[a], "--transport") && a + 1 < argc) transport = argv[++a];
+        else {
+            std::cerr << "usage: " << argv[0]
+                      << " [--particles N] [--slabs S] [--steps K] [--dt DT] [--transport socket|local]"
+                         " [--threads T] [--tolerance radii]" << std::endl;
+            return 1;
+        }
+    }
+
+    FluidSetup setup = FluidSetup::damBreak(numParticles, particleRadius);
+    std::vector<double> slabs = FluidSlabWorker::balancedSlabs(setup, numSlabs);
+    Run run = {&setup, &slabs, steps, dt, threads};
+
+    std::vector<Vec3> positions, velocities;
+    Clock::time_point t0 = Clock::now();
+    bool ok;
+#ifndef _WIN32
+    if (transport == "socket") ok = runSockets(run, numSlabs, positions, velocities);
+    else
+#endif
+    ok = runLocal(run, numSlabs, positions, velocities);
+    double slabMs = msSince(t0);
+    if (!ok) {
+        std::cerr << "decomposed run failed" << std::endl;
+        return 1;
+    }
+
+    t0 = Clock::now();
+    ThreadPool pool(threads);
+    FluidSimulation reference(&pool);
+    reference.load(setup);
+    for (int s = 0; s < steps; s++) {
+        reference.step(dt);
+    }
+    double referenceMs = msSince(t0);
+
+    // no sources or sinks, so the slot of a reference particle is its global id
+    const std::vector<Particle*>& particles = reference.getParticles();
+    double maxPos = 0, sumPos2 = 0, maxVel = 0;
+    for (unsigned int i = 0; i < particles.size(); i++) {
+        double dp = (positions[i] - particles[i]->pos).norm() / particleRadius;
+        maxPos = std::max(maxPos, dp);
+        sumPos2 += dp * dp;
+        maxVel = std::max(maxVel, (velocities[i] - particles[i]->vel).norm());
+    }
+    double rmsPos = particles.empty() ? 0.0 : std::sqrt(sumPos2 / particles.size());
+    bool pass = maxPos <= tolerance;
+
+    std::cout << "slabs,transport,particles,steps,slab_ms,reference_ms,max_pos_diff,rms_pos_diff,max_vel_diff,pass" << std::endl;
+    std::cout << numSlabs << "," << transport << "," << particles.size() << "," << steps << ","
+              << slabMs << "," << referenceMs << "," << maxPos << "," << rmsPos << "," << maxVel << ","
+              << (pass ? 1 : 0) << std::endl;
+    return pass ? 0 : 1;
+}
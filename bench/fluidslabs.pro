@@ -0,0 +1,49 @@
+# Slab decomposed fluid check against the single process run, built without Qt.
+# Build it next to Simulations.pro with: qmake bench/fluidslabs.pro && make
+
+TEMPLATE = app
+TARGET = fluidslabs
+
+CONFIG += console c++11 release thread
+CONFIG -= app_bundle qt
+
+INCLUDEPATH += ../code
+INCLUDEPATH += ../extlibs
+
+SOURCES += \
+    fluidslabs.cpp \
+    ../code/colliders.cpp \
+    ../code/flipfluid.cpp \
+    ../code/fluidadaptivity.cpp \
+    ../code/fluidboundary.cpp \
+    ../code/fluidemitter.cpp \
+    ../code/fluidsimulation.cpp \
+    ../code/fluidsleep.cpp \
+    ../code/fluidslab.cpp \
+    ../code/fluidtransport.cpp \
+    ../code/forces.cpp \
+    ../code/gridfluid.cpp \
+    ../code/integrators.cpp \
+    ../code/particlehashgrid.cpp \
+    ../code/particlepool.cpp \
+    ../code/particlesystem.cpp \
+    ../code/threadpool.cpp \
+
+HEADERS += \
+    ../code/colliders.h \
+    ../code/flipfluid.h \
+    ../code/fluidadaptivity.h \
+    ../code/fluidboundary.h \
+    ../code/fluidemitter.h \
+    ../code/fluidsimulation.h \
+    ../code/fluidsleep.h \
+    ../code/fluidslab.h \
+    ../code/fluidtransport.h \
+    ../code/forces.h \
+    ../code/gridfluid.h \
+    ../code/integrators.h \
+    ../code/particle.h \
+    ../code/particlehashgrid.h \
+    ../code/particlepool.h \
+    ../code/particlesystem.h \
+    ../code/threadpool.h \
@@ -0,0 +1,178 @@
+/*
+ *  Validation of the mixed precision fluid path against the all double one, no Qt needed.
+ *  The same dam break is stepped once per precision mode, and every few steps the densities
+ *  and positions of each mixed run are compared particle by particle with the double run.
+ *  The first row is after a single step from the same state, so it only shows rounding,
+ *  later rows also include how fast the runs drift apart.
+ *
+ *  With --threads the double run is repeated with each of the given thread counts instead,
+ *  and every row tells whether positions and velocities are bitwise identical to the
+ *  single threaded run.
+ *
+ *  usage: fluidvalidate [--particles N] [--steps S] [--every K] [--dt DT]
+ *                       [--threads T,T,...] [--out file.csv]
+ */
+
+#include "fluidsimulation.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace {
+
+const double particleRadius = 1.0;
+
+struct Difference {
+    double maxDensity = 0;      // relative to the double run
+    double rmsDensity = 0;
+    double maxPosition = 0;     // in particle radii
+    double rmsPosition = 0;
+};
+
+Difference compare(const FluidSimulation& reference, const FluidSimulation& sim) {
+    // no emitters, drains or adaptivity, so particle i is the same in both runs
+    const std::vector<Particle*>& a = reference.getParticles();
+    const std::vector<Particle*>& b = sim.getParticles();
+    Difference d;
+    int n = std::min(a.size(), b.size());
+    for (int i = 0; i < n; i++) {
+        double rel = std::abs(b[i]->density - a[i]->density) / std::max(std::abs(a[i]->density), 1e-12);
+        double dist = (b[i]->pos - a[i]->pos).norm() / particleRadius;
+        d.maxDensity = std::max(d.maxDensity, rel);
+        d.rmsDensity += rel * rel;
+        d.maxPosition = std::max(d.maxPosition, dist);
+        d.rmsPosition += dist * dist;
+    }
+    if (n > 0) {
+        d.rmsDensity = std::sqrt(d.rmsDensity / n);
+        d.rmsPosition = std::sqrt(d.rmsPosition / n);
+    }
+    return d;
+}
+
+// bitwise comparison, -0 and 0 or two NaNs with different payloads count as different
+bool identical(const FluidSimulation& reference, const FluidSimulation& sim) {
+    const std::vector<Particle*>& a = reference.getParticles();
+    const std::vector<Particle*>& b = sim.getParticles();
+    if (a.size() != b.size()) return false;
+    for (unsigned int i = 0; i < a.size(); i++) {
+        if (memcmp(a[i]->pos.data(), b[i]->pos.data(), 3 * sizeof(double)) != 0) return false;
+        if (memcmp(a[i]->vel.data(), b[i]->vel.data(), 3 * sizeof(double)) != 0) return false;
+    }
+    return true;
+}
+
+void validatePrecision(std::ostream& out, const FluidSetup& setup, int steps, int every, double dt) {
+    out << "precision,step,particles,max_density_rel,rms_density_rel,max_pos_diff,rms_pos_diff" << std::endl;
+
+    const ForceNavierStockes::Precision modes[] = {ForceNavierStockes::Double, ForceNavierStockes::Mixed, ForceNavierStockes::MixedKahan};
+    const char* modeNames[] = {"double", "mixed", "kahan"};
+    const int numModes = 3;
+
+    ThreadPool pool;
+    std::vector<FluidSimulation*> sims;
+    for (int m = 0; m < numModes; m++) {
+        FluidSimulation* sim = new FluidSimulation(&pool);
+        sim->load(setup);
+        sim->getNavierStokes()->setPrecision(modes[m]);
+        sims.push_back(sim);
+    }
+
+    for (int step = 1; step <= steps; step++) {
+        for (FluidSimulation* sim : sims) {
+            sim->step(dt);
+        }
+        if (step == 1 || step % every == 0) {
+            for (int m = 1; m < numModes; m++) {
+                Difference d = compare(*sims[0], *sims[m]);
+                out << modeNames[m] << "," << step << "," << sims[m]->getParticles().size() << ","
+                    << d.maxDensity << "," << d.rmsDensity << ","
+                    << d.maxPosition << "," << d.rmsPosition << std::endl;
+            }
+        }
+    }
+
+    for (FluidSimulation* sim : sims) delete sim;
+}
+
+void validateThreads(std::ostream& out, const FluidSetup& setup, int steps, int every, double dt,
+                     const std::vector<int>& threads) {
+    out << "threads,step,particles,identical,max_pos_diff" << std::endl;
+
+    // every run has its own pool, the reference runs inline
+    std::vector<ThreadPool*> pools;
+    std::vector<FluidSimulation*> sims;
+    pools.push_back(new ThreadPool(1));
+    for (int t : threads) pools.push_back(new ThreadPool(t));
+    for (ThreadPool* pool : pools) {
+        FluidSimulation* sim = new FluidSimulation(pool);
+        sim->load(setup);
+        sims.push_back(sim);
+    }
+
+    for (int step = 1; step <= steps; step++) {
+        for (FluidSimulation* sim : sims) {
+            sim->step(dt);
+        }
+        if (step == 1 || step % every == 0) {
+            for (unsigned int s = 1; s < sims.size(); s++) {
+                out << threads[s - 1] << "," << step << "," << sims[s]->getParticles().size() << ","
+                    << (identical(*sims[0], *sims[s]) ? 1 : 0) << ","
+                    << compare(*sims[0], *sims[s]).maxPosition << std::endl;
+            }
+        }
+    }
+
+    for (FluidSimulation* sim : sims) delete sim;
+    for (ThreadPool* pool : pools) delete pool;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    long long numParticles = 20000;
+    int steps = 200;
+    int every = 20;
+    double dt = 0.005;
+    std::vector<int> threads;
+    std::string outPath;
+
+    for (int a = 1; a < argc; a++) {
+        if (!strcmp(argv[a], "--particles") && a + 1 < argc)  numParticles = atoll(argv[++a]);
+        else if (!strcmp(argv[a], "--steps") && a + 1 < argc) steps = atoi(argv[++a]);
+        else if (!strcmp(argv[a], "--every") && a + 1 < argc) every = std::max(1, atoi(argv[++a]));
+        else if (!strcmp(argv[a], "--dt") && a + 1 < argc)    dt = atof(argv[++a]);
+        else if (!strcmp(argv[a], "--threads") && a + 1 < argc) {
+            std::stringstream ss(argv[++a]);
+            std::string item;
+            while (std::getline(ss, item, ',')) {
+                if (!item.empty()) threads.push_back(atoi(item.c_str()));
+            }
+        }
+        else if (!strcmp(argv[a], "--out") && a + 1 < argc)   outPath = argv[++a];
+        else {
+            std::cerr << "usage: " << argv[0]
+                      << " [--particles N] [--steps S] [--every K] [--dt DT] [--threads T,T,...] [--out file.csv]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::ofstream file;
+    if (!outPath.empty()) file.open(outPath);
+    std::ostream& out = outPath.empty() ? std::cout : file;
+
+    FluidSetup setup = FluidSetup::damBreak(numParticles, particleRadius);
+    if (threads.empty()) {
+        validatePrecision(out, setup, steps, every, dt);
+    }
+    else {
+        validateThreads(out, setup, steps, every, dt, threads);
+    }
+    return 0;
+}
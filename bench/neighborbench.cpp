@@ -0,0 +1,262 @@
+/*
+ *  Standalone neighbor search benchmark, no Qt needed.
+ *  Times grid build and query throughput of the neighbor search backends for several
+ *  particle distributions and sizes, and writes one CSV row per run.
+ *
+ *  usage: neighborbench [--min N] [--max N] [--queries Q] [--reps R] [--out file.csv]
+ */
+
+#include "particle.h"
+#include "particlehashgrid.h"
+#include "particledensegrid.h"
+#include "particlebvh.h"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+
+namespace {
+
+const double particleRadius = 1.0;
+const double spacing = 2.0 * particleRadius;
+const double searchDist = 2.0 * particleRadius;
+
+typedef std::chrono::steady_clock Clock;
+
+double msSince(const Clock::time_point& t0) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+struct Distribution {
+    std::string name;
+    Vec3 bmin, bmax;
+    std::vector<Particle*> particles;
+};
+
+// box side that fits n particles at fluid spacing
+double boxSide(int n) {
+    return spacing * std::cbrt(double(n));
+}
+
+Particle* newParticle(const Vec3& pos) {
+    Particle* p = new Particle();
+    p->pos = pos;
+    p->prevPos = pos;
+    p->radius = particleRadius;
+    return p;
+}
+
+void makeUniform(Distribution& d, int n, std::mt19937& rng) {
+    double side = boxSide(n);
+    std::uniform_real_distribution<double> u(0.0, side);
+    d.name = "uniform";
+    d.bmin = Vec3(0, 0, 0);
+    d.bmax = Vec3(side, side, side);
+    for (int i = 0; i < n; i++) {
+        d.particles.push_back(newParticle(Vec3(u(rng), u(rng), u(rng))));
+    }
+}
+
+// a few dense gaussian blobs in a mostly empty box
+void makeClustered(Distribution& d, int n, std::mt19937& rng) {
+    double side = 2.0 * boxSide(n);
+    const int numClusters = 8;
+    std::uniform_real_distribution<double> u(0.2 * side, 0.8 * side);
+    std::normal_distribution<double> g(0.0, 0.05 * side);
+    std::vector<Vec3> centers;
+    for (int c = 0; c < numClusters; c++) {
+        centers.push_back(Vec3(u(rng), u(rng), u(rng)));
+    }
+    d.name = "clustered";
+    d.bmin = Vec3(0, 0, 0);
+    d.bmax = Vec3(side, side, side);
+    for (int i = 0; i < n; i++) {
+        Vec3 pos = centers[i % numClusters] + Vec3(g(rng), g(rng), g(rng));
+        d.particles.push_back(newParticle(pos.cwiseMax(d.bmin).cwiseMin(d.bmax)));
+    }
+}
+
+// jittered lattice filling a tank up to a tilted free surface, like fluid sloshing against a wall
+void makeSloshing(Distribution& d, int n, std::mt19937& rng) {
+    double side = 1.6 * boxSide(n);
+    std::uniform_real_distribution<double> jitter(-0.1 * spacing, 0.1 * spacing);
+    d.name = "sloshing";
+    d.bmin = Vec3(0, 0, 0);
+    d.bmax = Vec3(side, side, side);
+
+    int cells = static_cast<int>(side / spacing);
+    for (int i = 0; i < cells && int(d.particles.size()) < n; i++) {
+        // surface goes from 0.85 to 0.15 of the tank height along x
+        double height = side * (0.85 - 0.7 * double(i) / cells);
+        for (int j = 0; j * spacing < height && int(d.particles.size()) < n; j++) {
+            for (int k = 0; k < cells && int(d.particles.size()) < n; k++) {
+                Vec3 pos = Vec3(i, j, k) * spacing + Vec3(jitter(rng), jitter(rng), jitter(rng));
+                d.particles.push_back(newParticle(pos));
+            }
+        }
+    }
+    // the wedge holds slightly less than n, top up with a splash above it
+    std::uniform_real_distribution<double> u(0.0, side);
+    while (int(d.particles.size()) < n) {
+        d.particles.push_back(newParticle(Vec3(u(rng), 0.5 * side + 0.5 * u(rng), u(rng))));
+    }
+}
+
+struct Result {
+    double buildMs;
+    double queryMs;
+    long long candidates;
+    long long neighbors;
+};
+
+// counts candidates that are real neighbors, so every backend does the same useful work.
+// Hash collisions can list a particle twice, seen[j] == stamp marks the ones already counted.
+long long countNeighbors(const std::vector<Particle*>& particles, int i, const std::vector<int>& ids, int size,
+                         std::vector<int>& seen, int stamp) {
+    long long count = 0;
+    const Vec3& pi = particles[i]->pos;
+    for (int k = 0; k < size; k++) {
+        int j = ids[k];
+        if (seen[j] == stamp) continue;
+        seen[j] = stamp;
+        if ((particles[j]->pos - pi).squaredNorm() <= searchDist * searchDist) {
+            count++;
+        }
+    }
+    return count;
+}
+
+template<typename Grid>
+Result runGrid(Grid& grid, const std::vector<Particle*>& particles, const std::vector<int>& queries) {
+    Result r = {0, 0, 0, 0};
+    Clock::time_point t0 = Clock::now();
+    grid.create(particles);
+    r.buildMs = msSince(t0);
+
+    std::vector<int> seen(particles.size(), -1);
+    int stamp = 0;
+    t0 = Clock::now();
+    for (int i : queries) {
+        grid.query(particles, i, searchDist);
+        r.candidates += grid.getQuerySize();
+        r.neighbors += countNeighbors(particles, i, grid.getNeighbors(), grid.getQuerySize(), seen, stamp++);
+    }
+    r.queryMs = msSince(t0);
+    return r;
+}
+
+Result runBVH(ParticleBVH& bvh, const std::vector<Particle*>& particles, const std::vector<int>& queries) {
+    Result r = {0, 0, 0, 0};
+    Clock::time_point t0 = Clock::now();
+    bvh.create(particles);
+    r.buildMs = msSince(t0);
+
+    std::vector<int> seen(particles.size(), -1);
+    int stamp = 0;
+    t0 = Clock::now();
+    for (int i : queries) {
+        // BVH distances are between sphere surfaces, remove the two radii
+        bvh.query(particles, i, searchDist - 2.0 * particleRadius);
+        r.candidates += bvh.getQuerySize();
+        r.neighbors += countNeighbors(particles, i, bvh.getNeighbors(), bvh.getQuerySize(), seen, stamp++);
+    }
+    r.queryMs = msSince(t0);
+    return r;
+}
+
+Result runBruteForce(const std::vector<Particle*>& particles, const std::vector<int>& queries) {
+    Result r = {0, 0, 0, 0};
+    Clock::time_point t0 = Clock::now();
+    for (int i : queries) {
+        const Vec3& pi = particles[i]->pos;
+        for (const Particle* pj : particles) {
+            if ((pj->pos - pi).squaredNorm() <= searchDist * searchDist) {
+                r.neighbors++;
+            }
+        }
+    }
+    r.candidates = (long long)(queries.size()) * particles.size();
+    r.queryMs = msSince(t0);
+    return r;
+}
+
+void writeRow(std::ostream& out, const std::string& backend, const Distribution& d, int rep,
+              const std::vector<int>& queries, const Result& r) {
+    double nq = double(queries.size());
+    out << backend << "," << d.name << "," << d.particles.size() << "," << rep << ","
+        << r.buildMs << "," << queries.size() << "," << r.queryMs << ","
+        << (r.queryMs > 0 ? 1000.0 * nq / r.queryMs : 0.0) << ","
+        << r.candidates / nq << "," << r.neighbors / nq << std::endl;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    int minParticles = 1000;
+    int maxParticles = 4000000;
+    int numQueries = 100000;
+    int numBruteQueries = 200;
+    int reps = 3;
+    std::string outPath;
+
+    for (int a = 1; a < argc; a++) {
+        if (!strcmp(argv[a], "--min") && a + 1 < argc)          minParticles = atoi(argv[++a]);
+        else if (!strcmp(argv[a], "--max") && a + 1 < argc)     maxParticles = atoi(argv[++a]);
+        else if (!strcmp(argv[a], "--queries") && a + 1 < argc) numQueries = atoi(argv[++a]);
+        else if (!strcmp(argv[a], "--brute") && a + 1 < argc)   numBruteQueries = atoi(argv[++a]);
+        else if (!strcmp(argv[a], "--reps") && a + 1 < argc)    reps = atoi(argv[++a]);
+        else if (!strcmp(argv[a], "--out") && a + 1 < argc)     outPath = argv[++a];
+        else {
+            std::cerr << "usage: " << argv[0]
+                      << " [--min N] [--max N] [--queries Q] [--brute Q] [--reps R] [--out file.csv]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::ofstream file;
+    if (!outPath.empty()) file.open(outPath);
+    std::ostream& out = outPath.empty() ? std::cout : file;
+    out << "backend,distribution,particles,rep,build_ms,queries,query_ms,queries_per_s,"
+           "avg_candidates,avg_neighbors" << std::endl;
+
+    typedef std::function<void(Distribution&, int, std::mt19937&)> Generator;
+    std::vector<Generator> generators = {makeUniform, makeClustered, makeSloshing};
+
+    // sizes grow by 4 from the minimum, the maximum is always the last one
+    std::vector<int> sizes;
+    for (long long size = minParticles; size < maxParticles; size *= 4) sizes.push_back(int(size));
+    sizes.push_back(maxParticles);
+
+    for (int n : sizes) {
+        for (const Generator& generate : generators) {
+            std::mt19937 rng(1337);
+            Distribution d;
+            generate(d, n, rng);
+
+            // same query set for every backend
+            std::uniform_int_distribution<int> pick(0, n - 1);
+            std::vector<int> queries(std::min(numQueries, n));
+            for (int& q : queries) q = pick(rng);
+            std::vector<int> bruteQueries(queries.begin(), queries.begin() + std::min<size_t>(numBruteQueries, queries.size()));
+
+            ParticleHashGrid hashGrid(spacing, n);
+            ParticleDenseGrid denseGrid(spacing, d.bmin, d.bmax, n);
+            ParticleBVH bvh(n);
+
+            for (int rep = 0; rep < reps; rep++) {
+                writeRow(out, "hash", d, rep, queries, runGrid(hashGrid, d.particles, queries));
+                writeRow(out, "dense", d, rep, queries, runGrid(denseGrid, d.particles, queries));
+                writeRow(out, "bvh", d, rep, queries, runBVH(bvh, d.particles, queries));
+                writeRow(out, "brute", d, rep, bruteQueries, runBruteForce(d.particles, bruteQueries));
+            }
+
+            for (Particle* p : d.particles) delete p;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,25 @@
+# Standalone neighbor search benchmark, built without Qt.
+# Build it next to Simulations.pro with: qmake bench/neighborbench.pro && make
+
+TEMPLATE = app
+TARGET = neighborbench
+
+CONFIG += console c++11 release thread
+CONFIG -= app_bundle qt
+
+INCLUDEPATH += ../code
+INCLUDEPATH += ../extlibs
+
+SOURCES += \
+    neighborbench.cpp \
+    ../code/particlebvh.cpp \
+    ../code/particledensegrid.cpp \
+    ../code/particlehashgrid.cpp \
+    ../code/threadpool.cpp \
+
+HEADERS += \
+    ../code/particle.h \
+    ../code/particlebvh.h \
+    ../code/particledensegrid.h \
+    ../code/particlehashgrid.h \
+    ../code/threadpool.h \
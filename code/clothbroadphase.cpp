@@ -0,0 +1,243 @@
+#include "clothbroadphase.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+
+namespace {
+    // patches per BVH leaf
+    const int LeafSize = 2;
+
+    // entry distance of the ray into the box, infinity if it misses
+    double rayBox(const Vec3& origin, const Vec3& invDir, const Vec3& bmin, const Vec3& bmax) {
+        double tmin = 0, tmax = INFINITY;
+        for (int a = 0; a < 3; a++) {
+            double t0 = (bmin[a] - origin[a])*invDir[a];
+            double t1 = (bmax[a] - origin[a])*invDir[a];
+            if (t0 > t1) std::swap(t0, t1);
+            tmin = std::max(tmin, t0);
+            tmax = std::min(tmax, t1);
+        }
+        return tmin <= tmax ? tmin : INFINITY;
+    }
+}
+
+ClothBroadphase::ClothBroadphase(ThreadPool* pool)
+    : pool(pool ? pool : &ThreadPool::shared())
+{
+    patchStart.assign(1, 0);
+}
+
+void ClothBroadphase::setPatches(const std::vector<int>& particlePatch)
+{
+    int numPatches = 0;
+    for (int p : particlePatch) numPatches = std::max(numPatches, p + 1);
+
+    // counting sort of the particles by patch, in index order inside each patch
+    patchStart.assign(numPatches + 1, 0);
+    for (int p : particlePatch) patchStart[p + 1]++;
+    for (int i = 0; i < numPatches; i++) patchStart[i + 1] += patchStart[i];
+    patchParticles.resize(particlePatch.size());
+    std::vector<int> next(patchStart.begin(), patchStart.end() - 1);
+    for (int i = 0; i < int(particlePatch.size()); i++) {
+        patchParticles[next[particlePatch[i]]++] = i;
+    }
+
+    patchMin.resize(numPatches);
+    patchMax.resize(numPatches);
+    this->particlePatch = particlePatch;
+    patchMoved.assign(numPatches, 0);
+    nodes.clear();
+}
+
+int ClothBroadphase::buildNode(int first, int count, std::vector<Vec3>& centers)
+{
+    int idx = int(nodes.size());
+    nodes.push_back(Node());
+    if (count <= LeafSize) {
+        nodes[idx].first = first;
+        nodes[idx].count = count;
+        return idx;
+    }
+
+    // median split along the longest axis of the patch centers
+    Vec3 cmin = Vec3::Constant( 1e30);
+    Vec3 cmax = Vec3::Constant(-1e30);
+    for (int i = first; i < first + count; i++) {
+        cmin = cmin.cwiseMin(centers[treePatches[i]]);
+        cmax = cmax.cwiseMax(centers[treePatches[i]]);
+    }
+    int axis;
+    (cmax - cmin).maxCoeff(&axis);
+    int half = count/2;
+    std::nth_element(treePatches.begin() + first, treePatches.begin() + first + half, treePatches.begin() + first + count,
+                     [&](int a, int b) { return centers[a][axis] < centers[b][axis]; });
+
+    int left = buildNode(first, half, centers);
+    int right = buildNode(first + half, count - half, centers);
+    nodes[idx].left = left;
+    nodes[idx].right = right;
+    return idx;
+}
+
+int ClothBroadphase::pick(const std::vector<Particle*>& particles, const Vec3& origin, const Vec3& dir, double tolerance)
+{
+    const int numPatches = getNumPatches();
+    if (numPatches == 0) return -1;
+
+    if (nodes.empty()) {
+        std::vector<Vec3> centers(numPatches);
+        for (int b = 0; b < numPatches; b++) centers[b] = 0.5*(patchMin[b] + patchMax[b]);
+        treePatches.resize(numPatches);
+        for (int b = 0; b < numPatches; b++) treePatches[b] = b;
+        buildNode(0, numPatches, centers);
+    }
+
+    // refit, children before parents
+    for (int n = int(nodes.size()) - 1; n >= 0; n--) {
+        Node& node = nodes[n];
+        if (node.left < 0) {
+            node.bmin = patchMin[treePatches[node.first]];
+            node.bmax = patchMax[treePatches[node.first]];
+            for (int i = node.first + 1; i < node.first + node.count; i++) {
+                node.bmin = node.bmin.cwiseMin(patchMin[treePatches[i]]);
+                node.bmax = node.bmax.cwiseMax(patchMax[treePatches[i]]);
+            }
+        }
+        else {
+            node.bmin = nodes[node.left].bmin.cwiseMin(nodes[node.right].bmin);
+            node.bmax = nodes[node.left].bmax.cwiseMax(nodes[node.right].bmax);
+        }
+    }
+
+    const Vec3 d = dir.normalized();
+    const Vec3 invDir(1/d[0], 1/d[1], 1/d[2]);
+    const Vec3 grow = Vec3::Constant(tolerance);
+    int best = -1;
+    double bestDist2 = tolerance*tolerance;
+
+    // every box the ray passes within the tolerance, the closest particle can be in any of them
+    std::vector<int> stack(1, 0);
+    while (!stack.empty()) {
+        const Node& node = nodes[stack.back()];
+        stack.pop_back();
+        if (rayBox(origin, invDir, node.bmin - grow, node.bmax + grow) == INFINITY) continue;
+
+        if (node.left >= 0) {
+            stack.push_back(node.right);
+            stack.push_back(node.left);
+            continue;
+        }
+
+        for (int i = node.first; i < node.first + node.count; i++) {
+            int b = treePatches[i];
+            for (int k = patchStart[b]; k < patchStart[b + 1]; k++) {
+                // distance from the particle to the ray, ties go to the nearer particle
+                Vec3 op = particles[patchParticles[k]]->pos - origin;
+                double tc = op.dot(d);
+                if (tc < 0) continue;
+                double dist2 = std::max(0.0, op.squaredNorm() - tc*tc);
+                if (dist2 < bestDist2 || (dist2 == bestDist2 && best >= 0 &&
+                                          tc < (particles[best]->pos - origin).dot(d))) {
+                    bestDist2 = dist2;
+                    best = patchParticles[k];
+                }
+            }
+        }
+    }
+    return best;
+}
+
+std::vector<int> ClothBroadphase::cellPatches(const std::vector<Particle*>& particles, double cellSize)
+{
+    std::vector<int> patch(particles.size());
+    std::unordered_map<uint64_t, int> cellPatch;
+    for (unsigned int i = 0; i < particles.size(); i++) {
+        const Vec3& p = particles[i]->pos;
+        uint64_t key = 0;
+        for (int a = 0; a < 3; a++) {
+            key = (key << 21) | (uint64_t(int64_t(std::floor(p[a]/cellSize))) & 0x1FFFFF);
+        }
+        auto it = cellPatch.emplace(key, int(cellPatch.size())).first;
+        patch[i] = it->second;
+    }
+    return patch;
+}
+
+void ClothBroadphase::fitPatch(const std::vector<Particle*>& particles, int b)
+{
+    Vec3 bmin = Vec3::Constant( 1e30);
+    Vec3 bmax = Vec3::Constant(-1e30);
+    for (int k = patchStart[b]; k < patchStart[b + 1]; k++) {
+        const Particle* p = particles[patchParticles[k]];
+        Vec3 r = Vec3::Constant(p->radius);
+        bmin = bmin.cwiseMin(p->pos - r).cwiseMin(p->prevPos - r);
+        bmax = bmax.cwiseMax(p->pos + r).cwiseMax(p->prevPos + r);
+    }
+    patchMin[b] = bmin;
+    patchMax[b] = bmax;
+}
+
+void ClothBroadphase::listCandidates(int c, const std::vector<char>* frozen)
+{
+    const int numPatches = getNumPatches();
+    std::vector<int>& list = candidates[c];
+    list.clear();
+    if (numPatches == 0 || !colliders[c]->mayCollide(clothMin, clothMax)) return;
+    for (int b = 0; b < numPatches; b++) {
+        if (frozen && (*frozen)[b]) continue;
+        if (colliders[c]->mayCollide(patchMin[b], patchMax[b])) {
+            list.insert(list.end(), patchParticles.begin() + patchStart[b],
+                        patchParticles.begin() + patchStart[b + 1]);
+        }
+    }
+}
+
+void ClothBroadphase::update(const std::vector<Particle*>& particles, const std::vector<char>* frozen)
+{
+    const int numPatches = getNumPatches();
+
+    pool->parallelFor(numPatches, [&](int begin, int end) {
+        for (int b = begin; b < end; b++) {
+            if (frozen && (*frozen)[b]) continue;
+            fitPatch(particles, b);
+        }
+    });
+
+    clothMin = Vec3::Constant( 1e30);
+    clothMax = Vec3::Constant(-1e30);
+    for (int b = 0; b < numPatches; b++) {
+        clothMin = clothMin.cwiseMin(patchMin[b]);
+        clothMax = clothMax.cwiseMax(patchMax[b]);
+    }
+
+    for (unsigned int c = 0; c < colliders.size(); c++) {
+        listCandidates(c, frozen);
+    }
+}
+
+void ClothBroadphase::refit(const std::vector<Particle*>& particles, const std::vector<int>& moved,
+                            int firstCollider, const std::vector<char>* frozen)
+{
+    if (moved.empty()) return;
+
+    movedPatches.clear();
+    for (int i : moved) {
+        int b = particlePatch[i];
+        if (!patchMoved[b]) {
+            patchMoved[b] = 1;
+            movedPatches.push_back(b);
+        }
+    }
+    // the cloth box only grows, a box too large still lists every patch that may collide
+    for (int b : movedPatches) {
+        fitPatch(particles, b);
+        clothMin = clothMin.cwiseMin(patchMin[b]);
+        clothMax = clothMax.cwiseMax(patchMax[b]);
+        patchMoved[b] = 0;
+    }
+
+    for (int c = firstCollider; c < int(colliders.size()); c++) {
+        listCandidates(c, frozen);
+    }
+}
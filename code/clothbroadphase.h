@@ -0,0 +1,85 @@
+#ifndef CLOTHBROADPHASE_H
+#define CLOTHBROADPHASE_H
+
+#include "colliders.h"
+#include "particle.h"
+#include "threadpool.h"
+#include <vector>
+
+/*
+ *  Culls the cloth particles before the collider tests. The particles are grouped in patches
+ *  of neighbouring vertices, whose bounds (positions and previous positions, grown by the
+ *  particle radii) are refit every update, together with the box of the whole cloth. Each
+ *  collider then only gets the particles of the patches it may touch as candidates, and the
+ *  exact tests run on those.
+ *
+ *  Refitting is one pass over the positions without virtual calls, the colliders are asked
+ *  once per patch. Candidates are listed in patch order, so the collision order does not
+ *  depend on the number of threads. A collider moves the particles it resolves, so refit
+ *  updates the patches of those particles and lists the candidates of the later colliders
+ *  again.
+ *
+ *  The patch bounds also carry a BVH for mouse picking. Its tree is split once, at the first
+ *  pick after setPatches, and later picks only refit its nodes from the current patch bounds
+ *  before walking the ray through them, with the boxes grown by the pick tolerance.
+ */
+class ClothBroadphase
+{
+public:
+    // runs on the shared pool if none is given
+    explicit ClothBroadphase(ThreadPool* pool = nullptr);
+
+    // patch of each particle, patches numbered from 0
+    void setPatches(const std::vector<int>& particlePatch);
+    // patches for any mesh: the particles in each cell of the given size, numbered by first particle
+    static std::vector<int> cellPatches(const std::vector<Particle*>& particles, double cellSize);
+    void setColliders(const std::vector<const Collider*>& c) { colliders = c; candidates.resize(c.size()); }
+
+    // refits the bounds and lists the candidates of every collider. Patches flagged in frozen
+    // keep their bounds and give no candidates.
+    void update(const std::vector<Particle*>& particles, const std::vector<char>* frozen = nullptr);
+    // refits the patches of the moved particles and lists the candidates of the colliders from
+    // firstCollider on again, frozen as in update
+    void refit(const std::vector<Particle*>& particles, const std::vector<int>& moved, int firstCollider,
+               const std::vector<char>* frozen = nullptr);
+    // candidates of the collider of index c in setColliders
+    const std::vector<int>& getCandidates(int c) const { return candidates[c]; }
+
+    // particle closest to the ray, in front of the origin and no further than tolerance from it,
+    // -1 if none. Uses the bounds of the last update.
+    int pick(const std::vector<Particle*>& particles, const Vec3& origin, const Vec3& dir, double tolerance);
+
+    int getNumPatches() const { return int(patchStart.size()) - 1; }
+    void getClothBounds(Vec3& bmin, Vec3& bmax) const { bmin = clothMin; bmax = clothMax; }
+
+protected:
+    ThreadPool* pool;
+    std::vector<const Collider*> colliders;
+
+    // particles of each patch
+    std::vector<int> patchStart;
+    std::vector<int> patchParticles;
+    std::vector<Vec3> patchMin, patchMax;
+    Vec3 clothMin = Vec3(0, 0, 0);
+    Vec3 clothMax = Vec3(0, 0, 0);
+
+    std::vector<std::vector<int>> candidates;
+
+    void fitPatch(const std::vector<Particle*>& particles, int b);
+    void listCandidates(int c, const std::vector<char>* frozen);
+    std::vector<int> particlePatch;
+    std::vector<int> movedPatches;
+    std::vector<char> patchMoved;
+
+    // picking BVH, children are stored after their parent
+    struct Node {
+        Vec3 bmin = Vec3(0, 0, 0), bmax = Vec3(0, 0, 0);
+        int left = -1, right = -1;      // children, -1 on leaves
+        int first = 0, count = 0;       // range of treePatches on leaves
+    };
+    int buildNode(int first, int count, std::vector<Vec3>& centers);
+    std::vector<Node> nodes;
+    std::vector<int> treePatches;
+};
+
+#endif // CLOTHBROADPHASE_H
@@ -0,0 +1,142 @@
+#include "clothbuilder.h"
+#include <algorithm>
+
+void ClothBuilder::build(Model& model)
+{
+    const std::vector<float>& coords = model.getVertexCoords();
+    const std::vector<unsigned int>& tris = model.getIndices();
+    const int nv = model.numVertices();
+    const int nt = model.numFaces();
+    positions.resize(nv);
+    for (int v = 0; v < nv; v++) positions[v] = Vec3(coords[3*v], coords[3*v + 1], coords[3*v + 2]);
+    auto spring = [&](int a, int b) {
+        Spring s;
+        s.a = a;
+        s.b = b;
+        s.rest = (positions[a] - positions[b]).norm();
+        s.edge = false;
+        return s;
+    };
+
+    // every triangle edge under its lower vertex, with the vertex opposite to it
+    halfStart.assign(nv + 1, 0);
+    for (int i = 0; i < 3*nt; i++) {
+        unsigned int a = tris[i], b = tris[i - i%3 + (i + 1)%3];
+        halfStart[std::min(a, b) + 1]++;
+    }
+    for (int v = 0; v < nv; v++) halfStart[v + 1] += halfStart[v];
+    halfUpper.resize(3*nt);
+    halfOpposite.resize(3*nt);
+    std::vector<int> next(halfStart.begin(), halfStart.end() - 1);
+    for (int i = 0; i < 3*nt; i++) {
+        int t = i - i%3;
+        unsigned int a = tris[i], b = tris[t + (i + 1)%3];
+        int slot = next[std::min(a, b)]++;
+        halfUpper[slot] = std::max(a, b);
+        halfOpposite[slot] = tris[t + (i + 2)%3];
+    }
+
+    // equal upper vertices are the same edge. When the edge is clearly the longest of both
+    // triangles around it, it is the diagonal of a quad and the other diagonal gets a shear
+    // spring too. Other triangles are already kept in shape by their own edges.
+    auto longest = [&](double l, int a, int b, int o) {
+        return (positions[a] - positions[o]).squaredNorm() < l && (positions[b] - positions[o]).squaredNorm() < l;
+    };
+    edges.clear();
+    shear.clear();
+    edgeDiagonal.clear();
+    edges.reserve(3*nt/2 + nv);
+    shear.reserve(3*nt/2);
+    edgeDiagonal.reserve(3*nt/2 + nv);
+    for (int v = 0; v < nv; v++) {
+        const int begin = halfStart[v], end = halfStart[v + 1];
+        // a handful of entries per vertex, insertion sort keeps the opposites with them
+        for (int i = begin + 1; i < end; i++) {
+            int u = halfUpper[i], o = halfOpposite[i];
+            int j = i - 1;
+            for (; j >= begin && halfUpper[j] > u; j--) {
+                halfUpper[j + 1] = halfUpper[j];
+                halfOpposite[j + 1] = halfOpposite[j];
+            }
+            halfUpper[j + 1] = u;
+            halfOpposite[j + 1] = o;
+        }
+        for (int i = begin; i < end; ) {
+            int j = i + 1;
+            while (j < end && halfUpper[j] == halfUpper[i]) j++;
+            int u = halfUpper[i];
+            edges.push_back(spring(v, u));
+            edges.back().edge = true;
+            bool diagonal = false;
+            if (j - i == 2 && halfOpposite[i] != halfOpposite[i + 1]) {
+                double l = edges.back().rest*edges.back().rest * (1 - 1e-3);
+                diagonal = longest(l, v, u, halfOpposite[i]) && longest(l, v, u, halfOpposite[i + 1]);
+            }
+            if (diagonal) {
+                shear.push_back(edges.back());
+                shear.push_back(spring(std::min(halfOpposite[i], halfOpposite[i + 1]),
+                                       std::max(halfOpposite[i], halfOpposite[i + 1])));
+            }
+            edgeDiagonal.push_back(diagonal);
+            i = j;
+        }
+    }
+
+    stretch.clear();
+    stretch.reserve(edges.size());
+    for (unsigned int e = 0; e < edges.size(); e++) {
+        if (!edgeDiagonal[e]) stretch.push_back(edges[e]);
+    }
+
+    // vertex adjacency from the unique edges
+    adjacencyStart.assign(nv + 1, 0);
+    for (const Spring& s : edges) {
+        adjacencyStart[s.a + 1]++;
+        adjacencyStart[s.b + 1]++;
+    }
+    for (int v = 0; v < nv; v++) adjacencyStart[v + 1] += adjacencyStart[v];
+    adjacency.resize(2*edges.size());
+    adjacencyDiagonal.resize(2*edges.size());
+    next.assign(adjacencyStart.begin(), adjacencyStart.end() - 1);
+    for (unsigned int e = 0; e < edges.size(); e++) {
+        const Spring& s = edges[e];
+        adjacencyDiagonal[next[s.a]] = adjacencyDiagonal[next[s.b]] = edgeDiagonal[e];
+        adjacency[next[s.a]++] = s.b;
+        adjacency[next[s.b]++] = s.a;
+    }
+
+    // bend: each neighbour pairs with the most opposite one around the vertex. A pair that
+    // chose each other is added once. Quad diagonals take no part, so a diagonal never ends
+    // up paired with a side edge either.
+    bend.clear();
+    bend.reserve(3*nv);
+    std::vector<Vec3> dirs;
+    std::vector<int> best;
+    std::vector<double> bestCos;
+    for (int v = 0; v < nv; v++) {
+        const int begin = adjacencyStart[v];
+        const int deg = adjacencyStart[v + 1] - begin;
+        const Vec3& pv = positions[v];
+        dirs.resize(deg);
+        best.assign(deg, -1);
+        bestCos.assign(deg, bendCosine);
+        for (int i = 0; i < deg; i++) dirs[i] = (positions[adjacency[begin + i]] - pv).normalized();
+        for (int i = 0; i < deg; i++) {
+            if (adjacencyDiagonal[begin + i]) continue;
+            for (int j = 0; j < deg; j++) {
+                if (j == i || adjacencyDiagonal[begin + j]) continue;
+                double c = dirs[i].dot(dirs[j]);
+                if (c < bestCos[i]) {
+                    bestCos[i] = c;
+                    best[i] = j;
+                }
+            }
+        }
+        for (int i = 0; i < deg; i++) {
+            int j = best[i];
+            if (j < 0 || (best[j] == i && j < i)) continue;
+            int a = adjacency[begin + i], b = adjacency[begin + j];
+            bend.push_back(spring(std::min(a, b), std::max(a, b)));
+        }
+    }
+}
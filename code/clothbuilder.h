@@ -0,0 +1,61 @@
+#ifndef CLOTHBUILDER_H
+#define CLOTHBUILDER_H
+
+#include "defines.h"
+#include "model.h"
+#include <vector>
+
+/*
+ *  Derives the springs of a cloth or soft body from any indexed triangle mesh:
+ *   - stretch along every edge of the mesh that is not a quad diagonal,
+ *   - shear along both diagonals of two triangles forming a quad, that is sharing their
+ *     longest edge: the shared edge itself and the one between the opposite vertices,
+ *   - bend over every vertex, between the neighbours that continue each other in the
+ *     straightest line, skipping the vertex like the grid bend springs. Quad diagonals are
+ *     left out, they are held by the shear springs already.
+ *  On the regular grid triangulation this gives exactly the stretch, shear and bend springs
+ *  of the Provot layout. Springs lying on a mesh edge are flagged, which are all the stretch
+ *  springs and half of the shear springs.
+ *
+ *  Everything is counting sorts and passes over bounded vertex degrees, so the build is
+ *  linear in the mesh size. The positions are converted once into a flat array, springs
+ *  are plain records in flat arrays, and the vertex adjacency is kept in CSR form for later
+ *  passes.
+ */
+class ClothBuilder
+{
+public:
+    struct Spring {
+        unsigned int a, b;
+        double rest;
+        bool edge;      // lies on an edge of the mesh
+    };
+
+    void build(Model& model);
+
+    // two neighbours are straight through a vertex below this cosine of their angle
+    void setBendCosine(double c) { bendCosine = c; }
+
+    const std::vector<Spring>& getStretch() const { return stretch; }
+    const std::vector<Spring>& getShear() const { return shear; }
+    const std::vector<Spring>& getBend() const { return bend; }
+
+    // neighbours of vertex v are adjacency[adjacencyStart[v] .. adjacencyStart[v+1])
+    const std::vector<int>& getAdjacencyStart() const { return adjacencyStart; }
+    const std::vector<int>& getAdjacency() const { return adjacency; }
+
+protected:
+    double bendCosine = -0.8;
+
+    std::vector<Spring> stretch, shear, bend;
+    std::vector<int> adjacencyStart, adjacency;
+
+    // half edges sorted by their lower vertex
+    std::vector<int> halfStart, halfUpper, halfOpposite;
+    std::vector<Vec3> positions;
+    std::vector<Spring> edges;             // unique mesh edges
+    std::vector<char> edgeDiagonal;        // by edge, quad diagonals
+    std::vector<char> adjacencyDiagonal;   // by adjacency entry
+};
+
+#endif // CLOTHBUILDER_H
@@ -0,0 +1,177 @@
+#include "clothmultigrid.h"
+#include <algorithm>
+#include <limits>
+
+namespace {
+    // coarsening stops before a level would have fewer particles than this along an axis
+    const int MinCoords = 3;
+
+    // every second coordinate, always keeping the last one so the borders stay on the grid
+    std::vector<int> coarsen(const std::vector<int>& coords) {
+        std::vector<int> c;
+        for (unsigned int i = 0; i < coords.size(); i += 2) c.push_back(coords[i]);
+        if (c.back() != coords.back()) c.push_back(coords.back());
+        return c;
+    }
+
+    // interval [k, k+1] of coords holding x and the weight of k+1
+    void locate(const std::vector<int>& coords, int x, int& k, double& t) {
+        k = 0;
+        while (k + 2 < int(coords.size()) && coords[k + 1] <= x) k++;
+        t = double(x - coords[k]) / double(coords[k + 1] - coords[k]);
+    }
+}
+
+void ClothMultigrid::setGrid(const std::vector<Particle*>& particles, int nx, int ny)
+{
+    numY = ny;
+    levels.clear();
+    start.resize(particles.size());
+
+    Level fine;
+    for (int i = 0; i < nx; i++) fine.coordsX.push_back(i);
+    for (int j = 0; j < ny; j++) fine.coordsY.push_back(j);
+    levels.push_back(fine);
+
+    while (true) {
+        const Level& finer = levels.back();
+        Level level;
+        level.coordsX = coarsen(finer.coordsX);
+        level.coordsY = coarsen(finer.coordsY);
+        if (int(level.coordsX.size()) < MinCoords || int(level.coordsY.size()) < MinCoords) break;
+        if (level.coordsX.size() == finer.coordsX.size() && level.coordsY.size() == finer.coordsY.size()) break;
+
+        const int cx = int(level.coordsX.size());
+        const int cy = int(level.coordsY.size());
+        auto index = [&](int a, int b) { return level.coordsX[a]*ny + level.coordsY[b]; };
+        auto constraint = [&](int p, int q) {
+            Constraint c;
+            c.a = p;
+            c.b = q;
+            c.rest = (particles[p]->pos - particles[q]->pos).norm();
+            level.constraints.push_back(c);
+        };
+        level.constraintX.assign(cx*cy, -1);
+        level.constraintY.assign(cx*cy, -1);
+        for (int a = 0; a < cx; a++) {
+            for (int b = 0; b < cy; b++) {
+                if (a + 1 < cx) {
+                    level.constraintX[a*cy + b] = int(level.constraints.size());
+                    constraint(index(a, b), index(a + 1, b));
+                }
+                if (b + 1 < cy) {
+                    level.constraintY[a*cy + b] = int(level.constraints.size());
+                    constraint(index(a, b), index(a, b + 1));
+                }
+            }
+        }
+        level.slotX.assign(nx, -1);
+        level.slotY.assign(ny, -1);
+        level.intervalX.resize(nx);
+        level.intervalY.resize(ny);
+        for (int a = 0; a < cx; a++) level.slotX[level.coordsX[a]] = a;
+        for (int b = 0; b < cy; b++) level.slotY[level.coordsY[b]] = b;
+        for (int x = 0; x < nx; x++) { double t; locate(level.coordsX, x, level.intervalX[x], t); }
+        for (int y = 0; y < ny; y++) { double t; locate(level.coordsY, y, level.intervalY[y], t); }
+
+        // the finer particles off this level's rows or columns
+        std::vector<char> inX(nx, 0), inY(ny, 0);
+        for (int x : level.coordsX) inX[x] = 1;
+        for (int y : level.coordsY) inY[y] = 1;
+        std::vector<int> kbs(finer.coordsY.size());
+        std::vector<double> tbs(finer.coordsY.size());
+        for (unsigned int b = 0; b < finer.coordsY.size(); b++) {
+            locate(level.coordsY, finer.coordsY[b], kbs[b], tbs[b]);
+        }
+        for (int x : finer.coordsX) {
+            int ka; double ta;
+            locate(level.coordsX, x, ka, ta);
+            for (unsigned int b = 0; b < finer.coordsY.size(); b++) {
+                const int y = finer.coordsY[b];
+                if (inX[x] && inY[y]) continue;
+                const int kb = kbs[b];
+                const double tb = tbs[b];
+
+                Prolongation pr;
+                pr.v = x*ny + y;
+                pr.p[0] = index(ka, kb);       pr.w[0] = (1 - ta)*(1 - tb);
+                pr.p[1] = index(ka + 1, kb);   pr.w[1] = ta*(1 - tb);
+                pr.p[2] = index(ka, kb + 1);   pr.w[2] = (1 - ta)*tb;
+                pr.p[3] = index(ka + 1, kb + 1); pr.w[3] = ta*tb;
+                level.prolongation.push_back(pr);
+            }
+        }
+
+        levels.push_back(level);
+    }
+}
+
+void ClothMultigrid::breakEdge(int a, int b)
+{
+    if (a > b) std::swap(a, b);
+    const int i = a / numY, j = a % numY;
+    const bool alongX = (b == a + numY);
+    if (!alongX && (b != a + 1 || j + 1 == numY)) return;
+
+    // a rest length nothing reaches keeps the constraint in place but inactive
+    for (unsigned int l = 1; l < levels.size(); l++) {
+        Level& level = levels[l];
+        const int cy = int(level.coordsY.size());
+        int c = -1;
+        if (alongX && level.slotY[j] >= 0) {
+            c = level.constraintX[level.intervalX[i]*cy + level.slotY[j]];
+        }
+        else if (!alongX && level.slotX[i] >= 0) {
+            c = level.constraintY[level.slotX[i]*cy + level.intervalY[j]];
+        }
+        if (c >= 0) level.constraints[c].rest = std::numeric_limits<double>::infinity();
+    }
+}
+
+void ClothMultigrid::solve(std::vector<Particle*>& particles)
+{
+    if (levels.size() < 2) return;
+
+    for (unsigned int i = 0; i < particles.size(); i++) {
+        start[i] = particles[i]->pos;
+    }
+
+    for (int l = int(levels.size()) - 1; l > 0; l--) {
+        const Level& level = levels[l];
+
+        // same projection as the scene relaxation: only stretched springs are shortened
+        for (int it = 0; it < iterations; it++) {
+            for (const Constraint& c : level.constraints) {
+                Particle* p0 = particles[c.a];
+                Particle* p1 = particles[c.b];
+                Vec3 d = p1->pos - p0->pos;
+                double dist = d.norm();
+                if (!(dist > c.rest)) continue;
+
+                Vec3 corr = d * ((dist - c.rest) / dist);
+                if (!p0->isFixed && !p1->isFixed) {
+                    p0->pos += 0.5*corr;
+                    p1->pos -= 0.5*corr;
+                }
+                else if (!p0->isFixed) {
+                    p0->pos += corr;
+                }
+                else if (!p1->isFixed) {
+                    p1->pos -= corr;
+                }
+            }
+        }
+
+        // the finer particles off this level have not moved yet, they take the
+        // interpolated displacement of its particles
+        for (const Prolongation& pr : level.prolongation) {
+            Particle* p = particles[pr.v];
+            if (p->isFixed) continue;
+            Vec3 disp(0, 0, 0);
+            for (int k = 0; k < 4; k++) {
+                disp += pr.w[k] * (particles[pr.p[k]]->pos - start[pr.p[k]]);
+            }
+            p->pos += disp;
+        }
+    }
+}
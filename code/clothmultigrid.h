@@ -0,0 +1,64 @@
+#ifndef CLOTHMULTIGRID_H
+#define CLOTHMULTIGRID_H
+
+#include "particle.h"
+#include <vector>
+
+/*
+ *  Multilevel stretch relaxation for a regular cloth grid. A single Gauss-Seidel sweep over
+ *  the springs moves a stretch error by about one particle per step, so on large grids the
+ *  cloth stays rubbery for hundreds of steps. Here the grid is coarsened by two along each
+ *  axis until a few particles are left. Every step the coarse levels are relaxed first, on
+ *  springs between their particles with the rest length of the fine chain they replace, and
+ *  the displacement of each level is interpolated bilinearly to the particles of the next
+ *  finer one. The finest level is left to the usual spring relaxation.
+ *
+ *  Particles are indexed like the cloth grid, i*ny + j, and the rest lengths come from the
+ *  positions given to setGrid. Fixed particles are never moved.
+ */
+class ClothMultigrid
+{
+public:
+    void setGrid(const std::vector<Particle*>& particles, int nx, int ny);
+    // no levels, for cloths that are not a grid
+    void clear() { levels.clear(); }
+    void setIterations(int n) { iterations = n; }
+
+    // relaxes the coarse levels and prolongates their corrections down to every particle
+    void solve(std::vector<Particle*>& particles);
+
+    // the cloth tore between grid neighbours a and b: the coarse constraints over them go too
+    void breakEdge(int a, int b);
+
+    int getNumLevels() const { return int(levels.size()); }
+
+protected:
+    struct Constraint {
+        int a, b;
+        double rest;
+    };
+
+    // a particle of the finer level that is not in this one, from four of this level
+    struct Prolongation {
+        int v;
+        int p[4];
+        double w[4];
+    };
+
+    struct Level {
+        std::vector<int> coordsX, coordsY;          // grid indices kept at this level
+        std::vector<int> slotX, slotY;              // grid index to coordinate, -1 if not kept
+        std::vector<int> intervalX, intervalY;      // grid index to the coordinate before it
+        std::vector<Constraint> constraints;
+        std::vector<int> constraintX, constraintY;  // along each axis from coordinate a*cy + b
+        std::vector<Prolongation> prolongation;     // onto the finer level
+    };
+
+    std::vector<Level> levels;                      // 0 is the full grid
+    int numY = 0;
+    int iterations = 2;
+
+    std::vector<Vec3> start;
+};
+
+#endif // CLOTHMULTIGRID_H
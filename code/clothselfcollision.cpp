@@ -0,0 +1,337 @@
+#include "clothselfcollision.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <set>
+#include <utility>
+
+namespace {
+    // vertices or edges per detection job
+    const int Block = 1024;
+
+    // closest point to p on triangle abc as barycentric weights (Ericson, RTCD 5.1.5)
+    Vec3 closestOnTriangle(const Vec3& p, const Vec3& a, const Vec3& b, const Vec3& c) {
+        Vec3 ab = b - a, ac = c - a, ap = p - a;
+        double d1 = ab.dot(ap), d2 = ac.dot(ap);
+        if (d1 <= 0 && d2 <= 0) return Vec3(1, 0, 0);
+
+        Vec3 bp = p - b;
+        double d3 = ab.dot(bp), d4 = ac.dot(bp);
+        if (d3 >= 0 && d4 <= d3) return Vec3(0, 1, 0);
+
+        double vc = d1 * d4 - d3 * d2;
+        if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+            double v = d1 / (d1 - d3);
+            return Vec3(1 - v, v, 0);
+        }
+
+        Vec3 cp = p - c;
+        double d5 = ab.dot(cp), d6 = ac.dot(cp);
+        if (d6 >= 0 && d5 <= d6) return Vec3(0, 0, 1);
+
+        double vb = d5 * d2 - d1 * d6;
+        if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+            double w = d2 / (d2 - d6);
+            return Vec3(1 - w, 0, w);
+        }
+
+        double va = d3 * d6 - d5 * d4;
+        if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+            double w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+            return Vec3(0, 1 - w, w);
+        }
+
+        double denom = 1 / (va + vb + vc);
+        double v = vb * denom, w = vc * denom;
+        return Vec3(1 - v - w, v, w);
+    }
+
+    // parameters of the closest points on segments p0p1 and q0q1 (Ericson, RTCD 5.1.9)
+    void closestOnSegments(const Vec3& p0, const Vec3& p1, const Vec3& q0, const Vec3& q1, double& s, double& t) {
+        Vec3 d1 = p1 - p0, d2 = q1 - q0, r = p0 - q0;
+        double a = d1.squaredNorm(), e = d2.squaredNorm(), f = d2.dot(r);
+        double c = d1.dot(r), b = d1.dot(d2);
+        double denom = a * e - b * b;
+
+        // parallel segments take any point, the separation is the same
+        s = denom > 1e-12 * a * e ? std::min(std::max((b * f - c * e) / denom, 0.0), 1.0) : 0.0;
+        t = (b * s + f) / e;
+        if (t < 0) {
+            t = 0;
+            s = std::min(std::max(-c / a, 0.0), 1.0);
+        }
+        else if (t > 1) {
+            t = 1;
+            s = std::min(std::max((b - c) / a, 0.0), 1.0);
+        }
+    }
+
+    bool inRange(const int* lo, const int* hi, int x, int y, int z) {
+        return x >= lo[0] && x <= hi[0] && y >= lo[1] && y <= hi[1] && z >= lo[2] && z <= hi[2];
+    }
+}
+
+
+ClothSelfCollision::ClothSelfCollision(ThreadPool* threadPool)
+    : pool(threadPool ? threadPool : &ThreadPool::shared())
+{
+}
+
+int ClothSelfCollision::hashCoords(int xi, int yi, int zi) const {
+    int h = (xi * 92837111) ^ (yi * 689287499) ^ (zi * 283923481);
+    return std::abs(h) % tableSize;
+}
+
+int ClothSelfCollision::intCoord(double coord) const {
+    return static_cast<int>(std::floor(coord / cellSize));
+}
+
+void ClothSelfCollision::setMesh(const std::vector<Particle*>& particles, const std::vector<unsigned int>& tris) {
+    triangles = tris;
+
+    // unique edges, with their rest lengths
+    std::set<std::pair<unsigned int, unsigned int>> unique;
+    for (unsigned int t = 0; t + 2 < triangles.size(); t += 3) {
+        for (int k = 0; k < 3; k++) {
+            unsigned int a = triangles[t + k], b = triangles[t + (k + 1) % 3];
+            unique.insert(std::make_pair(std::min(a, b), std::max(a, b)));
+        }
+    }
+    edges.clear();
+    double maxRestEdge = 0;
+    minRestEdge = 0;
+    std::vector<std::pair<unsigned int, unsigned int>> sorted(unique.begin(), unique.end());
+    for (const std::pair<unsigned int, unsigned int>& e : sorted) {
+        edges.push_back(e.first);
+        edges.push_back(e.second);
+        double len = (particles[e.first]->pos - particles[e.second]->pos).norm();
+        maxRestEdge = std::max(maxRestEdge, len);
+        minRestEdge = edges.size() == 2 ? len : std::min(minRestEdge, len);
+    }
+    cellSize = std::max(maxRestEdge, 1e-6);
+
+    // which edges each triangle uses, for the removals
+    triangleEdges.resize(triangles.size());
+    edgeUses.assign(edges.size() / 2, 0);
+    for (unsigned int t = 0; t + 2 < triangles.size(); t += 3) {
+        for (int k = 0; k < 3; k++) {
+            unsigned int a = triangles[t + k], b = triangles[t + (k + 1) % 3];
+            std::pair<unsigned int, unsigned int> e(std::min(a, b), std::max(a, b));
+            int idx = static_cast<int>(std::lower_bound(sorted.begin(), sorted.end(), e) - sorted.begin());
+            triangleEdges[t + k] = idx;
+            edgeUses[idx]++;
+        }
+    }
+    triangleRemoved.assign(triangles.size() / 3, 0);
+    edgeRemoved.assign(edges.size() / 2, 0);
+
+    int numObjects = static_cast<int>(triangles.size() / 3 + edges.size() / 2);
+    tableSize = std::max(1, 2 * numObjects);
+}
+
+void ClothSelfCollision::removeTriangle(int t) {
+    if (triangleRemoved[t]) return;
+    triangleRemoved[t] = 1;
+    for (int k = 0; k < 3; k++) {
+        int e = triangleEdges[3 * t + k];
+        if (--edgeUses[e] == 0) edgeRemoved[e] = 1;
+    }
+}
+
+void ClothSelfCollision::buildTable(HashTable& table, int numObjects, const std::vector<unsigned int>& vertices,
+                                    int verticesPerObject, const std::vector<char>& removed,
+                                    const std::vector<Particle*>& particles)
+{
+    // cell ranges of the boxes in parallel...
+    table.lo.resize(3 * numObjects);
+    table.hi.resize(3 * numObjects);
+    pool->parallelFor(numObjects, [&](int begin, int end) {
+        for (int o = begin; o < end; o++) {
+            if (removed[o]) {
+                // empty cell range, never hashed nor matched
+                for (int a = 0; a < 3; a++) {
+                    table.lo[3 * o + a] = 1;
+                    table.hi[3 * o + a] = 0;
+                }
+                continue;
+            }
+            Vec3 bmin = particles[vertices[verticesPerObject * o]]->pos;
+            Vec3 bmax = bmin;
+            for (int k = 1; k < verticesPerObject; k++) {
+                const Vec3& p = particles[vertices[verticesPerObject * o + k]]->pos;
+                bmin = bmin.cwiseMin(p);
+                bmax = bmax.cwiseMax(p);
+            }
+            for (int a = 0; a < 3; a++) {
+                table.lo[3 * o + a] = intCoord(bmin[a] - gap);
+                table.hi[3 * o + a] = intCoord(bmax[a] + gap);
+            }
+        }
+    });
+
+    // ...then the counting sort. The cells of one object are filled one after the other,
+    // so an object landing twice in a bucket has adjacent entries.
+    table.cellStart.assign(tableSize + 1, 0);
+    auto forEachCell = [&](int o, const std::function<void(int)>& f) {
+        const int* lo = &table.lo[3 * o];
+        const int* hi = &table.hi[3 * o];
+        for (int z = lo[2]; z <= hi[2]; z++)
+            for (int y = lo[1]; y <= hi[1]; y++)
+                for (int x = lo[0]; x <= hi[0]; x++)
+                    f(hashCoords(x, y, z));
+    };
+    for (int o = 0; o < numObjects; o++) {
+        forEachCell(o, [&](int h) { table.cellStart[h]++; });
+    }
+    int start = 0;
+    for (int i = 0; i < tableSize; i++) {
+        start += table.cellStart[i];
+        table.cellStart[i] = start;
+    }
+    table.cellStart[tableSize] = start;
+    table.entries.resize(start);
+    for (int o = numObjects - 1; o >= 0; o--) {
+        forEachCell(o, [&](int h) { table.entries[--table.cellStart[h]] = o; });
+    }
+}
+
+void ClothSelfCollision::findContacts(const std::vector<Particle*>& particles, const std::vector<char>* asleep) {
+    int numVertices = static_cast<int>(particles.size());
+    int numEdges = static_cast<int>(edges.size() / 2);
+    int vertexBlocks = (numVertices + Block - 1) / Block;
+    int edgeBlocks = (numEdges + Block - 1) / Block;
+    blockContacts.resize(vertexBlocks + edgeBlocks);
+
+    pool->parallelFor(vertexBlocks + edgeBlocks, [&](int begin, int end) {
+        for (int b = begin; b < end; b++) {
+            std::vector<Contact>& found = blockContacts[b];
+            found.clear();
+
+            if (b < vertexBlocks) {
+                // particle against the triangles of its cell
+                int last = std::min(numVertices, (b + 1) * Block);
+                for (int v = b * Block; v < last; v++) {
+                    if (asleep && (*asleep)[v]) continue;
+                    const Vec3& p = particles[v]->pos;
+                    int x = intCoord(p.x()), y = intCoord(p.y()), z = intCoord(p.z());
+                    int h = hashCoords(x, y, z);
+                    for (int e = triangleTable.cellStart[h]; e < triangleTable.cellStart[h + 1]; e++) {
+                        int t = triangleTable.entries[e];
+                        if (e > triangleTable.cellStart[h] && triangleTable.entries[e - 1] == t) continue;
+                        if (!inRange(&triangleTable.lo[3 * t], &triangleTable.hi[3 * t], x, y, z)) continue;
+
+                        unsigned int ia = triangles[3 * t], ib = triangles[3 * t + 1], ic = triangles[3 * t + 2];
+                        if (ia == unsigned(v) || ib == unsigned(v) || ic == unsigned(v)) continue;
+
+                        const Vec3& a = particles[ia]->pos;
+                        const Vec3& bb = particles[ib]->pos;
+                        const Vec3& c = particles[ic]->pos;
+                        Vec3 w = closestOnTriangle(p, a, bb, c);
+                        double d = (p - (w[0] * a + w[1] * bb + w[2] * c)).norm();
+                        if (d >= gap || d < 1e-12) continue;
+
+                        Contact contact = {{v, int(ia), int(ib), int(ic)}, {1.0, -w[0], -w[1], -w[2]}};
+                        found.push_back(contact);
+                    }
+                }
+            }
+            else {
+                // edge against the later edges, each pair only in the first cell both boxes share.
+                // Sleeping edges test nothing, so the awake ones take the earlier sleeping edges.
+                int first = (b - vertexBlocks) * Block;
+                int last = std::min(numEdges, first + Block);
+                for (int e0 = first; e0 < last; e0++) {
+                    const int* lo0 = &edgeTable.lo[3 * e0];
+                    const int* hi0 = &edgeTable.hi[3 * e0];
+                    unsigned int p0 = edges[2 * e0], p1 = edges[2 * e0 + 1];
+                    if (asleep && (*asleep)[p0] && (*asleep)[p1]) continue;
+                    for (int z = lo0[2]; z <= hi0[2]; z++)
+                    for (int y = lo0[1]; y <= hi0[1]; y++)
+                    for (int x = lo0[0]; x <= hi0[0]; x++) {
+                        int h = hashCoords(x, y, z);
+                        for (int e = edgeTable.cellStart[h]; e < edgeTable.cellStart[h + 1]; e++) {
+                            int e1 = edgeTable.entries[e];
+                            if (e1 == e0) continue;
+                            if (e1 < e0 && !(asleep && (*asleep)[edges[2 * e1]] && (*asleep)[edges[2 * e1 + 1]])) continue;
+                            if (e > edgeTable.cellStart[h] && edgeTable.entries[e - 1] == e1) continue;
+                            const int* lo1 = &edgeTable.lo[3 * e1];
+                            const int* hi1 = &edgeTable.hi[3 * e1];
+                            if (!inRange(lo1, hi1, x, y, z)) continue;
+                            if (x != std::max(lo0[0], lo1[0]) || y != std::max(lo0[1], lo1[1]) || z != std::max(lo0[2], lo1[2])) continue;
+
+                            unsigned int q0 = edges[2 * e1], q1 = edges[2 * e1 + 1];
+                            if (q0 == p0 || q0 == p1 || q1 == p0 || q1 == p1) continue;
+
+                            double s, t;
+                            const Vec3& a0 = particles[p0]->pos;
+                            const Vec3& a1 = particles[p1]->pos;
+                            const Vec3& b0 = particles[q0]->pos;
+                            const Vec3& b1 = particles[q1]->pos;
+                            closestOnSegments(a0, a1, b0, b1, s, t);
+                            double d = ((a0 + s * (a1 - a0)) - (b0 + t * (b1 - b0))).norm();
+                            if (d >= gap || d < 1e-12) continue;
+
+                            Contact contact = {{int(p0), int(p1), int(q0), int(q1)}, {1 - s, s, -(1 - t), -t}};
+                            found.push_back(contact);
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    contacts.clear();
+    numPointTriangle = numEdgeEdge = 0;
+    for (int b = 0; b < vertexBlocks + edgeBlocks; b++) {
+        contacts.insert(contacts.end(), blockContacts[b].begin(), blockContacts[b].end());
+        (b < vertexBlocks ? numPointTriangle : numEdgeEdge) += static_cast<int>(blockContacts[b].size());
+    }
+}
+
+void ClothSelfCollision::applyContacts(std::vector<Particle*>& particles) {
+    int n = static_cast<int>(particles.size());
+    for (int it = 0; it < iterations; it++) {
+        dPos.assign(n, Vec3(0, 0, 0));
+        dCount.assign(n, 0);
+
+        // contacts in detection order, the sums do not depend on the threads
+        for (const Contact& contact : contacts) {
+            Vec3 diff(0, 0, 0);
+            double denom = 0;
+            for (int k = 0; k < 4; k++) {
+                const Particle* p = particles[contact.v[k]];
+                diff += contact.c[k] * p->pos;
+                if (!p->isFixed) denom += contact.c[k] * contact.c[k];
+            }
+            double d = diff.norm();
+            if (d >= gap || d < 1e-12 || denom == 0) continue;
+
+            Vec3 normal = diff / d;
+            double push = (gap - d) / denom;
+            for (int k = 0; k < 4; k++) {
+                if (particles[contact.v[k]]->isFixed) continue;
+                dPos[contact.v[k]] += push * contact.c[k] * normal;
+                dCount[contact.v[k]]++;
+            }
+        }
+
+        pool->parallelFor(n, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                if (dCount[i] > 0) particles[i]->pos += dPos[i] / dCount[i];
+            }
+        });
+    }
+}
+
+int ClothSelfCollision::resolve(std::vector<Particle*>& particles, const std::vector<char>* asleep) {
+    if (triangles.empty()) return 0;
+
+    // thicker cloth would push its own neighbors apart at rest
+    gap = std::min(thickness, 0.5 * minRestEdge);
+
+    buildTable(triangleTable, static_cast<int>(triangles.size() / 3), triangles, 3, triangleRemoved, particles);
+    buildTable(edgeTable, static_cast<int>(edges.size() / 2), edges, 2, edgeRemoved, particles);
+    findContacts(particles, asleep);
+    applyContacts(particles);
+    return static_cast<int>(contacts.size());
+}
@@ -0,0 +1,90 @@
+#ifndef CLOTHSELFCOLLISION_H
+#define CLOTHSELFCOLLISION_H
+
+#include "particle.h"
+#include "threadpool.h"
+#include <vector>
+
+/*
+ *  Keeps a cloth from passing through itself. The triangles and edges of the cloth mesh are
+ *  hashed into a uniform grid by their bounding boxes, then every particle is tested against
+ *  the triangles in its cell and every edge against the edges around it. Pairs closer than
+ *  the cloth thickness become contacts, and the contacts are pushed apart with Jacobi
+ *  averaged position corrections, like the spring relaxation. Moving positions also gives
+ *  the Verlet integrator the repulsion velocity.
+ *
+ *  A particle is never tested against a triangle it belongs to, nor an edge against one it
+ *  shares a vertex with. The hash tables and contact lists keep their memory across steps.
+ *  Detection runs on the thread pool in fixed blocks, so the contacts come out in the same
+ *  order for any number of threads.
+ */
+class ClothSelfCollision
+{
+public:
+    // runs on the shared pool if none is given
+    explicit ClothSelfCollision(ThreadPool* pool = nullptr);
+
+    // vertices are the particle indices, three per triangle. The rest lengths of the edges
+    // size the grid cells.
+    void setMesh(const std::vector<Particle*>& particles, const std::vector<unsigned int>& triangles);
+    // cloth is kept this far from itself, at most half the shortest rest edge
+    void setThickness(double t) { thickness = t; }
+    void setIterations(int n) { iterations = n; }
+
+    // drops a triangle of setMesh from the tests, and its edges once no triangle uses them
+    void removeTriangle(int t);
+
+    // returns the number of contacts found. Particles flagged in asleep still block the others,
+    // but only the awake particles and the edges with an awake end look for contacts.
+    int resolve(std::vector<Particle*>& particles, const std::vector<char>* asleep = nullptr);
+
+    int getNumPointTriangle() const { return numPointTriangle; }
+    int getNumEdgeEdge() const { return numEdgeEdge; }
+
+protected:
+    struct Contact {
+        int v[4];       // particle, triangle vertices / first edge, second edge
+        double c[4];    // weight of each vertex in the separation
+    };
+
+    // objects hashed into every cell their box touches, sorted by hash like ParticleHashGrid
+    struct HashTable {
+        std::vector<int> lo, hi;            // cell range of each object, 3 ints each
+        std::vector<int> cellStart;
+        std::vector<int> entries;
+    };
+
+    int hashCoords(int xi, int yi, int zi) const;
+    int intCoord(double coord) const;
+    void buildTable(HashTable& table, int numObjects, const std::vector<unsigned int>& vertices,
+                    int verticesPerObject, const std::vector<char>& removed, const std::vector<Particle*>& particles);
+    void findContacts(const std::vector<Particle*>& particles, const std::vector<char>* asleep);
+    void applyContacts(std::vector<Particle*>& particles);
+
+    ThreadPool* pool;
+    double thickness = 0.5;
+    double gap = 0.5;               // thickness after the rest edge limit
+    int iterations = 2;
+
+    std::vector<unsigned int> triangles;
+    std::vector<unsigned int> edges;
+    std::vector<int> triangleEdges;         // 3 per triangle
+    std::vector<int> edgeUses;
+    std::vector<char> triangleRemoved, edgeRemoved;
+    double cellSize = 1;
+    double minRestEdge = 0;
+    int tableSize = 1;
+    HashTable triangleTable;
+    HashTable edgeTable;
+
+    // per block of vertices or edges, concatenated in block order
+    std::vector<std::vector<Contact>> blockContacts;
+    std::vector<Contact> contacts;
+    int numPointTriangle = 0;
+    int numEdgeEdge = 0;
+
+    std::vector<Vec3> dPos;
+    std::vector<int> dCount;
+};
+
+#endif // CLOTHSELFCOLLISION_H
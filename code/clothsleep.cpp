@@ -0,0 +1,224 @@
+#include "clothsleep.h"
+#include <algorithm>
+#include <utility>
+
+namespace {
+    // a patch moving this much above the threshold wakes the sleeping patches around it
+    const double WakeFactor = 4;
+}
+
+ClothSleep::ClothSleep(ThreadPool* threadPool)
+    : pool(threadPool ? threadPool : &ThreadPool::shared())
+{
+    patchStart.assign(1, 0);
+}
+
+void ClothSleep::setPatches(const std::vector<int>& particlePatch, const std::vector<unsigned int>& triangles)
+{
+    patchOf = particlePatch;
+    const int numParticles = int(particlePatch.size());
+    int numPatches = 0;
+    for (int p : particlePatch) numPatches = std::max(numPatches, p + 1);
+
+    // counting sort of the particles by patch, in index order inside each patch
+    patchStart.assign(numPatches + 1, 0);
+    for (int p : particlePatch) patchStart[p + 1]++;
+    for (int i = 0; i < numPatches; i++) patchStart[i + 1] += patchStart[i];
+    patchParticles.resize(numParticles);
+    std::vector<int> next(patchStart.begin(), patchStart.end() - 1);
+    for (int i = 0; i < numParticles; i++) patchParticles[next[particlePatch[i]]++] = i;
+
+    // patch pairs across the triangles, sorted and made unique
+    std::vector<std::pair<int, int>> pairs;
+    for (unsigned int t = 0; t + 2 < triangles.size(); t += 3) {
+        for (int k = 0; k < 3; k++) {
+            int a = particlePatch[triangles[t + k]];
+            int b = particlePatch[triangles[t + (k + 1) % 3]];
+            if (a == b) continue;
+            pairs.push_back(std::make_pair(a, b));
+            pairs.push_back(std::make_pair(b, a));
+        }
+    }
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+    neighborStart.assign(numPatches + 1, 0);
+    for (const auto& pr : pairs) neighborStart[pr.first + 1]++;
+    for (int i = 0; i < numPatches; i++) neighborStart[i + 1] += neighborStart[i];
+    neighbors.resize(pairs.size());
+    for (unsigned int k = 0; k < pairs.size(); k++) neighbors[k] = pairs[k].second;
+
+    patchEnergy.assign(numPatches, 0);
+    patchMin.assign(numPatches, Vec3(0, 0, 0));
+    patchMax.assign(numPatches, Vec3(0, 0, 0));
+    quietSteps.assign(numPatches, 0);
+    patchAsleep.assign(numPatches, 0);
+    numSleeping = 0;
+
+    particleAsleep.assign(numParticles, 0);
+    wasFixed.assign(numParticles, 0);
+    listAwakeParticles();
+}
+
+void ClothSleep::setAsleep(std::vector<Particle*>& particles, int patch, bool asleep)
+{
+    if (bool(patchAsleep[patch]) == asleep) return;
+    patchAsleep[patch] = asleep;
+    quietSteps[patch] = 0;
+    numSleeping += asleep ? 1 : -1;
+
+    // both ways the particles start from rest, without the forces of the awake springs
+    // around them
+    for (int k = patchStart[patch]; k < patchStart[patch + 1]; k++) {
+        int i = patchParticles[k];
+        Particle* p = particles[i];
+        if (asleep) {
+            wasFixed[i] = p->isFixed;
+            p->isFixed = true;
+        }
+        else {
+            p->isFixed = wasFixed[i];
+        }
+        p->prevPos = p->pos;
+        p->vel = Vec3(0, 0, 0);
+        p->force = Vec3(0, 0, 0);
+        particleAsleep[i] = asleep;
+    }
+}
+
+void ClothSleep::listAwakeParticles()
+{
+    awakeParticles.clear();
+    for (int i = 0; i < int(particleAsleep.size()); i++) {
+        if (!particleAsleep[i]) awakeParticles.push_back(i);
+    }
+}
+
+void ClothSleep::findTouched(std::vector<int>& touched) const
+{
+    // sweep along x over the boxes of the moving and the sleeping patches
+    const double wake = WakeFactor*threshold;
+    std::vector<int> order;
+    for (int c = 0; c < getNumPatches(); c++) {
+        if (patchAsleep[c] || patchEnergy[c] > wake) order.push_back(c);
+    }
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return patchMin[a].x() < patchMin[b].x(); });
+
+    std::vector<int> active;
+    for (int c : order) {
+        unsigned int kept = 0;
+        for (unsigned int k = 0; k < active.size(); k++) {
+            int o = active[k];
+            if (patchMax[o].x() < patchMin[c].x()) continue;
+            active[kept++] = o;
+            if (patchAsleep[o] == patchAsleep[c]) continue;
+            if ((patchMin[c].array() > patchMax[o].array()).any() ||
+                (patchMin[o].array() > patchMax[c].array()).any()) continue;
+            touched.push_back(patchAsleep[c] ? c : o);
+        }
+        active.resize(kept);
+        active.push_back(c);
+    }
+}
+
+bool ClothSleep::update(std::vector<Particle*>& particles, double dt)
+{
+    const int numPatches = getNumPatches();
+    if (numPatches <= 0 || dt <= 0) return false;
+
+    // largest kinetic energy and bounds of the awake patches
+    pool->parallelFor(numPatches, [&](int begin, int end) {
+        for (int c = begin; c < end; c++) {
+            if (patchAsleep[c]) continue;
+            double e = 0;
+            Vec3 bmin = Vec3::Constant( 1e30);
+            Vec3 bmax = Vec3::Constant(-1e30);
+            for (int k = patchStart[c]; k < patchStart[c + 1]; k++) {
+                const Particle* p = particles[patchParticles[k]];
+                Vec3 v = (p->pos - p->prevPos)/dt;
+                e = std::max(e, 0.5*p->mass*v.squaredNorm());
+                Vec3 r = Vec3::Constant(p->radius);
+                bmin = bmin.cwiseMin(p->pos - r);
+                bmax = bmax.cwiseMax(p->pos + r);
+            }
+            patchEnergy[c] = e;
+            patchMin[c] = bmin;
+            patchMax[c] = bmax;
+        }
+    });
+
+    // wakes come from the state before this step
+    toWake.clear();
+    if (numSleeping > 0) {
+        for (int c = 0; c < numPatches; c++) {
+            if (!patchAsleep[c]) continue;
+            for (int k = neighborStart[c]; k < neighborStart[c + 1]; k++) {
+                int n = neighbors[k];
+                if (!patchAsleep[n] && patchEnergy[n] > WakeFactor*threshold) {
+                    toWake.push_back(c);
+                    break;
+                }
+            }
+        }
+        findTouched(toWake);
+    }
+
+    for (int c = 0; c < numPatches; c++) {
+        if (patchAsleep[c]) continue;
+        quietSteps[c] = patchEnergy[c] < threshold ? quietSteps[c] + 1 : 0;
+    }
+
+    bool changed = false;
+    for (int c : toWake) {
+        if (!patchAsleep[c]) continue;
+        setAsleep(particles, c, false);
+        changed = true;
+    }
+    for (int c = 0; c < numPatches; c++) {
+        if (!patchAsleep[c] && quietSteps[c] >= sleepSteps) {
+            setAsleep(particles, c, true);
+            changed = true;
+        }
+    }
+    if (changed) listAwakeParticles();
+    return changed;
+}
+
+bool ClothSleep::wakeParticle(std::vector<Particle*>& particles, int i)
+{
+    if (i < 0 || i >= int(particleAsleep.size())) return false;
+    int c = patchOf[i];
+
+    bool changed = false;
+    quietSteps[c] = 0;
+    if (patchAsleep[c]) {
+        setAsleep(particles, c, false);
+        changed = true;
+    }
+    for (int k = neighborStart[c]; k < neighborStart[c + 1]; k++) {
+        int n = neighbors[k];
+        quietSteps[n] = 0;
+        if (patchAsleep[n]) {
+            setAsleep(particles, n, false);
+            changed = true;
+        }
+    }
+    if (changed) listAwakeParticles();
+    return changed;
+}
+
+void ClothSleep::wakeAll(std::vector<Particle*>& particles)
+{
+    for (int c = 0; c < getNumPatches(); c++) {
+        setAsleep(particles, c, false);
+        quietSteps[c] = 0;
+    }
+    listAwakeParticles();
+}
+
+void ClothSleep::getAwakeSprings(const std::vector<ForceSpring*>& springs, std::vector<ForceSpring*>& awake) const
+{
+    awake.clear();
+    for (ForceSpring* s : springs) {
+        if (!particleAsleep[s->getParticle0()->id] || !particleAsleep[s->getParticle1()->id]) awake.push_back(s);
+    }
+}
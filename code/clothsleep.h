@@ -0,0 +1,80 @@
+#ifndef CLOTHSLEEP_H
+#define CLOTHSLEEP_H
+
+#include "forces.h"
+#include "particle.h"
+#include "threadpool.h"
+#include <vector>
+
+/*
+ *  Puts the cloth to sleep where it has come to rest. The particles are grouped in patches,
+ *  as for the broadphase, and a patch whose fastest particle stays below the kinetic energy
+ *  threshold for a number of steps falls asleep: its particles stop and are marked fixed, so
+ *  the relaxation, multigrid and self collisions leave them alone, and the awake lists this
+ *  class keeps leave them out of integration and forces. Wind, self collisions and tearing
+ *  take the particle flags to skip what is asleep. Particles keep their indices.
+ *
+ *  A sleeping patch wakes when a patch it shares a triangle with moves clearly faster than
+ *  the threshold, or when the box of such a patch touches its own. The caller wakes patches
+ *  for user interaction and everything when the forces change.
+ */
+class ClothSleep
+{
+public:
+    // runs on the shared pool if none is given
+    explicit ClothSleep(ThreadPool* pool = nullptr);
+
+    // patch of each particle, patches numbered from 0, and the triangles tying them together.
+    // Everything starts awake.
+    void setPatches(const std::vector<int>& particlePatch, const std::vector<unsigned int>& triangles);
+    // kinetic energy per particle below which a patch counts as resting
+    void setThreshold(double e) { threshold = e; }
+    void setSleepSteps(int n) { sleepSteps = n; }
+
+    // measures the patches after a step, sends the resting ones to sleep and wakes the ones
+    // around moving patches. Returns whether any patch changed state.
+    bool update(std::vector<Particle*>& particles, double dt);
+    // wakes the patch of particle i and its neighbours, returns whether any was asleep
+    bool wakeParticle(std::vector<Particle*>& particles, int i);
+    void wakeAll(std::vector<Particle*>& particles);
+
+    bool allAsleep() const { return numSleeping > 0 && numSleeping == getNumPatches(); }
+    int getNumPatches() const { return int(patchStart.size()) - 1; }
+    int getNumSleeping() const { return numSleeping; }
+    const std::vector<char>& getPatchAsleep() const { return patchAsleep; }
+    const std::vector<char>& getParticleAsleep() const { return particleAsleep; }
+    // awake particles in index order
+    const std::vector<int>& getAwakeParticles() const { return awakeParticles; }
+    // the springs with at least one awake end
+    void getAwakeSprings(const std::vector<ForceSpring*>& springs, std::vector<ForceSpring*>& awake) const;
+
+protected:
+    void setAsleep(std::vector<Particle*>& particles, int patch, bool asleep);
+    void listAwakeParticles();
+    // sleeping patches whose boxes touch the box of a moving one
+    void findTouched(std::vector<int>& touched) const;
+
+    ThreadPool* pool;
+    double threshold = 1e-3;
+    int sleepSteps = 30;
+
+    std::vector<int> patchOf;
+    std::vector<int> patchStart;            // particles of each patch (CSR)
+    std::vector<int> patchParticles;
+    std::vector<int> neighborStart;         // patches sharing a triangle (CSR)
+    std::vector<int> neighbors;
+
+    // per patch, energy and bounds of the last step it was awake
+    std::vector<double> patchEnergy;
+    std::vector<Vec3> patchMin, patchMax;
+    std::vector<int> quietSteps;
+    std::vector<char> patchAsleep;
+    int numSleeping = 0;
+
+    std::vector<char> particleAsleep;
+    std::vector<char> wasFixed;             // isFixed before falling asleep
+    std::vector<int> awakeParticles;
+    std::vector<int> toWake;
+};
+
+#endif // CLOTHSLEEP_H
@@ -0,0 +1,137 @@
+#include "clothtearing.h"
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+
+namespace {
+    // edge springs per strain check job
+    const int Block = 4096;
+
+    uint64_t edgeKey(int a, int b) {
+        if (a > b) std::swap(a, b);
+        return (uint64_t(uint32_t(a)) << 32) | uint32_t(b);
+    }
+}
+
+ClothTearing::ClothTearing(ThreadPool* threadPool)
+    : pool(threadPool ? threadPool : &ThreadPool::shared())
+{
+}
+
+void ClothTearing::setMesh(const std::vector<unsigned int>& triangles, const std::vector<ForceSpring*>& edges,
+                           const std::vector<ForceSpring*>& bends)
+{
+    edgeSprings = edges;
+    const int numEdges = int(edgeSprings.size());
+
+    std::unordered_map<uint64_t, int> edgeOf;
+    edgeOf.reserve(2*numEdges);
+    edgeEnds.resize(2*numEdges);
+    int numParticles = 0;
+    for (int e = 0; e < numEdges; e++) {
+        int a = edgeEnds[2*e] = edgeSprings[e]->getParticle0()->id;
+        int b = edgeEnds[2*e + 1] = edgeSprings[e]->getParticle1()->id;
+        edgeOf[edgeKey(a, b)] = e;
+        numParticles = std::max(numParticles, std::max(a, b) + 1);
+    }
+
+    // edge springs around each particle
+    std::vector<int> incidentStart(numParticles + 1, 0);
+    for (int v : edgeEnds) incidentStart[v + 1]++;
+    for (int v = 0; v < numParticles; v++) incidentStart[v + 1] += incidentStart[v];
+    std::vector<int> incident(edgeEnds.size());
+    std::vector<int> next(incidentStart.begin(), incidentStart.end() - 1);
+    for (int i = 0; i < 2*numEdges; i++) incident[next[edgeEnds[i]]++] = i/2;
+
+    // the (at most two) triangles on each side of an edge
+    edgeTriangles.assign(2*numEdges, -1);
+    for (unsigned int t = 0; t + 2 < triangles.size(); t += 3) {
+        for (int k = 0; k < 3; k++) {
+            auto it = edgeOf.find(edgeKey(triangles[t + k], triangles[t + (k + 1) % 3]));
+            if (it == edgeOf.end()) continue;
+            int* slot = &edgeTriangles[2*it->second];
+            slot[slot[0] < 0 ? 0 : 1] = int(t/3);
+        }
+    }
+    triangleRemoved.assign(triangles.size()/3, 0);
+
+    // a bend spring a-c lies over the shortest path a-m-c of two edge springs
+    std::vector<std::vector<ForceSpring*>> over(numEdges);
+    for (ForceSpring* s : bends) {
+        int a = s->getParticle0()->id;
+        int c = s->getParticle1()->id;
+        int bestAm = -1, bestMc = -1;
+        double best = 0;
+        if (a >= numParticles) continue;
+        for (int i = incidentStart[a]; i < incidentStart[a + 1]; i++) {
+            int e = incident[i];
+            int m = edgeEnds[2*e] == a ? edgeEnds[2*e + 1] : edgeEnds[2*e];
+            auto it = edgeOf.find(edgeKey(m, c));
+            if (it == edgeOf.end()) continue;
+            double len = edgeSprings[e]->getL() + edgeSprings[it->second]->getL();
+            if (bestAm < 0 || len < best) {
+                best = len;
+                bestAm = e;
+                bestMc = it->second;
+            }
+        }
+        if (bestAm < 0) continue;
+        over[bestAm].push_back(s);
+        over[bestMc].push_back(s);
+    }
+    bendStart.assign(numEdges + 1, 0);
+    bendSprings.clear();
+    for (int e = 0; e < numEdges; e++) {
+        bendSprings.insert(bendSprings.end(), over[e].begin(), over[e].end());
+        bendStart[e + 1] = int(bendSprings.size());
+    }
+
+    numBroken = 0;
+    numRemovedTriangles = 0;
+}
+
+int ClothTearing::tear(const std::vector<Particle*>& particles, std::vector<ForceSpring*>& brokenEdges,
+                       std::vector<int>& removedTriangles, const std::vector<char>* asleep)
+{
+    const int numEdges = int(edgeSprings.size());
+    const int numBlocks = (numEdges + Block - 1)/Block;
+    blockStrained.resize(numBlocks);
+
+    pool->parallelFor(numBlocks, [&](int begin, int end) {
+        for (int b = begin; b < end; b++) {
+            std::vector<int>& strained = blockStrained[b];
+            strained.clear();
+            int last = std::min(numEdges, (b + 1)*Block);
+            for (int e = b*Block; e < last; e++) {
+                ForceSpring* s = edgeSprings[e];
+                if (s->isBroken()) continue;
+                if (asleep && (*asleep)[edgeEnds[2*e]] && (*asleep)[edgeEnds[2*e + 1]]) continue;
+                const Vec3& p0 = particles[edgeEnds[2*e]]->pos;
+                const Vec3& p1 = particles[edgeEnds[2*e + 1]]->pos;
+                if ((p1 - p0).norm() > (1 + maxStrain)*s->getL()) strained.push_back(e);
+            }
+        }
+    });
+
+    int broken = 0;
+    for (int b = 0; b < numBlocks; b++) {
+        for (int e : blockStrained[b]) {
+            edgeSprings[e]->breakSpring();
+            brokenEdges.push_back(edgeSprings[e]);
+            broken++;
+
+            for (int k = 0; k < 2; k++) {
+                int t = edgeTriangles[2*e + k];
+                if (t < 0 || triangleRemoved[t]) continue;
+                triangleRemoved[t] = 1;
+                removedTriangles.push_back(t);
+                numRemovedTriangles++;
+            }
+            for (int i = bendStart[e]; i < bendStart[e + 1]; i++) {
+                bendSprings[i]->breakSpring();
+            }
+        }
+    }
+    numBroken += broken;
+    return broken;
+}
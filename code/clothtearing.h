@@ -0,0 +1,58 @@
+#ifndef CLOTHTEARING_H
+#define CLOTHTEARING_H
+
+#include "forces.h"
+#include "threadpool.h"
+#include <vector>
+
+/*
+ *  Breaks cloth springs stretched past a strain threshold. The springs along the triangle
+ *  edges are checked every step, and a broken one takes with it the triangles it bordered
+ *  and the bend springs across it, so the mesh opens where the cloth tore. Everything a
+ *  break touches is looked up in tables built at setMesh, so a tear costs a few writes no
+ *  matter the cloth size, and the removed triangles are handed back for the caller to patch
+ *  its index buffer.
+ *
+ *  Springs are matched to the mesh by the ids of their particles, which are the particle
+ *  indices used by the triangles. The strain check runs on the thread pool in fixed blocks,
+ *  so springs break in the same order for any number of threads.
+ */
+class ClothTearing
+{
+public:
+    // runs on the shared pool if none is given
+    explicit ClothTearing(ThreadPool* pool = nullptr);
+
+    // edge springs join two vertices of a triangle, bend springs skip over a vertex
+    void setMesh(const std::vector<unsigned int>& triangles, const std::vector<ForceSpring*>& edgeSprings,
+                 const std::vector<ForceSpring*>& bendSprings);
+    // relative elongation at which an edge spring breaks
+    void setMaxStrain(double s) { maxStrain = s; }
+
+    // breaks the overstretched edge springs, appends them and the triangles removed to the
+    // lists and returns how many broke. Edges between two particles flagged in asleep keep
+    // their length and are not measured.
+    int tear(const std::vector<Particle*>& particles, std::vector<ForceSpring*>& brokenEdges,
+             std::vector<int>& removedTriangles, const std::vector<char>* asleep = nullptr);
+
+    int getNumBroken() const { return numBroken; }
+    int getNumRemovedTriangles() const { return numRemovedTriangles; }
+
+protected:
+    ThreadPool* pool;
+    double maxStrain = 1.0;
+
+    std::vector<ForceSpring*> edgeSprings;
+    std::vector<int> edgeEnds;              // particles of each edge spring
+    std::vector<int> edgeTriangles;         // 2 per edge spring, -1 past the border
+    std::vector<int> bendStart;             // bend springs over each edge spring
+    std::vector<ForceSpring*> bendSprings;
+    std::vector<char> triangleRemoved;
+
+    // overstretched edge springs per block, in block order
+    std::vector<std::vector<int>> blockStrained;
+    int numBroken = 0;
+    int numRemovedTriangles = 0;
+};
+
+#endif // CLOTHTEARING_H
@@ -0,0 +1,114 @@
+#include "clothwind.h"
+#include <cmath>
+#include <random>
+
+ClothWind::ClothWind(ThreadPool* threadPool)
+    : pool(threadPool ? threadPool : &ThreadPool::shared())
+{
+    // fixed seed, the same gusts on every run
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> uniform(-1, 1);
+    noiseField.resize(NoiseSize*NoiseSize*NoiseSize);
+    for (Vec3& v : noiseField) {
+        do {
+            v = Vec3(uniform(rng), uniform(rng), uniform(rng));
+        } while (v.squaredNorm() > 1);
+    }
+}
+
+void ClothWind::setMesh(const std::vector<unsigned int>& triangles, int numParticles)
+{
+    incidentStart.assign(numParticles + 1, 0);
+    for (unsigned int v : triangles) incidentStart[v + 1]++;
+    for (int v = 0; v < numParticles; v++) incidentStart[v + 1] += incidentStart[v];
+    incident.resize(triangles.size());
+    std::vector<int> next(incidentStart.begin(), incidentStart.end() - 1);
+    for (unsigned int i = 0; i < triangles.size(); i++) incident[next[triangles[i]]++] = int(i/3);
+
+    triangleForce.assign(triangles.size()/3, Vec3(0, 0, 0));
+    time = 0;
+}
+
+Vec3 ClothWind::gust(const Vec3& q) const
+{
+    const int mask = NoiseSize - 1;
+    double fx = std::floor(q.x()), fy = std::floor(q.y()), fz = std::floor(q.z());
+    double tx = q.x() - fx, ty = q.y() - fy, tz = q.z() - fz;
+    int x0 = int(fx) & mask, y0 = int(fy) & mask, z0 = int(fz) & mask;
+    int x1 = (x0 + 1) & mask, y1 = (y0 + 1) & mask, z1 = (z0 + 1) & mask;
+
+    auto at = [&](int x, int y, int z) -> const Vec3& { return noiseField[(z*NoiseSize + y)*NoiseSize + x]; };
+    Vec3 c00 = (1 - tx)*at(x0, y0, z0) + tx*at(x1, y0, z0);
+    Vec3 c10 = (1 - tx)*at(x0, y1, z0) + tx*at(x1, y1, z0);
+    Vec3 c01 = (1 - tx)*at(x0, y0, z1) + tx*at(x1, y0, z1);
+    Vec3 c11 = (1 - tx)*at(x0, y1, z1) + tx*at(x1, y1, z1);
+    return (1 - tz)*((1 - ty)*c00 + ty*c10) + tz*((1 - ty)*c01 + ty*c11);
+}
+
+void ClothWind::apply(std::vector<Particle*>& particles, const std::vector<unsigned int>& triangles, double dt,
+                      const std::vector<char>* asleep)
+{
+    const int numParticles = int(incidentStart.size()) - 1;
+    const int numTriangles = int(triangleForce.size());
+    if (numParticles <= 0 || dt <= 0 || int(triangles.size()) < 3*numTriangles) return;
+    time += dt;
+
+    // the Verlet integrator keeps no velocities, they come from the last step
+    pos.resize(numParticles);
+    vel.resize(numParticles);
+    pool->parallelFor(numParticles, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            const Particle* p = particles[i];
+            pos[i] = p->pos;
+            vel[i] = (p->pos - p->prevPos)/dt;
+        }
+    });
+
+    const double windSpeed = wind.norm();
+    const double gustScale = turbulence*windSpeed;
+    const Vec3 drift = time*wind/gustSize;
+    pool->parallelFor(numTriangles, [&](int begin, int end) {
+        for (int t = begin; t < end; t++) {
+            const unsigned int* v = &triangles[3*t];
+            triangleForce[t] = Vec3(0, 0, 0);
+            if (v[0] == v[1] || v[1] == v[2] || v[2] == v[0]) continue;
+            if (asleep && (*asleep)[v[0]] && (*asleep)[v[1]] && (*asleep)[v[2]]) continue;
+
+            const Vec3& x0 = pos[v[0]];
+            const Vec3& x1 = pos[v[1]];
+            const Vec3& x2 = pos[v[2]];
+            Vec3 n = (x1 - x0).cross(x2 - x0);
+            double twiceArea = n.norm();
+            if (twiceArea <= 0) continue;
+
+            Vec3 center = (x0 + x1 + x2)/3.0;
+            Vec3 u = wind - (vel[v[0]] + vel[v[1]] + vel[v[2]])/3.0;
+            if (gustScale > 0) u += gustScale*gust(center/gustSize - drift);
+            double speed = u.norm();
+            if (speed <= 0) continue;
+
+            // normal facing downwind, cosine of the angle between the wind and the normal
+            n /= twiceArea;
+            double cosine = n.dot(u)/speed;
+            if (cosine < 0) {
+                n = -n;
+                cosine = -cosine;
+            }
+            Vec3 dir = u/speed;
+
+            // drag along the relative wind and lift along the rest of the normal, on the area
+            // seen from the wind
+            double q = 0.5*density*0.5*twiceArea*speed*speed*cosine;
+            triangleForce[t] = (q/3.0)*(dragCoefficient*dir + liftCoefficient*(n - cosine*dir));
+        }
+    });
+
+    pool->parallelFor(numParticles, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            if (asleep && (*asleep)[i]) continue;
+            Vec3 f(0, 0, 0);
+            for (int k = incidentStart[i]; k < incidentStart[i + 1]; k++) f += triangleForce[incident[k]];
+            particles[i]->force += f;
+        }
+    });
+}
@@ -0,0 +1,65 @@
+#ifndef CLOTHWIND_H
+#define CLOTHWIND_H
+
+#include "particle.h"
+#include "threadpool.h"
+#include <vector>
+
+/*
+ *  Aerodynamic force of the wind on the cloth triangles. Each triangle sees the wind minus
+ *  its own velocity, and gets a drag along that relative wind and a lift across it, both
+ *  scaled by the area the triangle shows to the wind, so a flag flutters and a sail fills
+ *  instead of every particle being pushed the same. A third of the force goes to each vertex.
+ *
+ *  Gusts come from a small periodic lattice of random velocities, built once and sampled
+ *  trilinearly at the triangle centers as it drifts with the wind.
+ *
+ *  Positions and velocities are first gathered into flat arrays, then the triangles are
+ *  evaluated on the thread pool into a force per triangle, and every vertex sums the forces
+ *  of its own triangles, so no two jobs write the same particle and the sums do not depend
+ *  on the number of threads.
+ */
+class ClothWind
+{
+public:
+    // runs on the shared pool if none is given
+    explicit ClothWind(ThreadPool* pool = nullptr);
+
+    // vertices are the particle indices, three per triangle
+    void setMesh(const std::vector<unsigned int>& triangles, int numParticles);
+    void setWind(const Vec3& velocity) { wind = velocity; }
+    void setDensity(double rho) { density = rho; }
+    void setCoefficients(double drag, double lift) { dragCoefficient = drag; liftCoefficient = lift; }
+    // gust speed relative to the wind speed, and gust size in scene units
+    void setTurbulence(double amplitude, double scale) { turbulence = amplitude; gustSize = scale; }
+
+    // adds the wind force to the particles and advances the gusts by dt. The triangles are
+    // the ones of setMesh, collapsed ones get no force. Particles flagged in asleep get no
+    // force, and triangles with all three of them are skipped.
+    void apply(std::vector<Particle*>& particles, const std::vector<unsigned int>& triangles, double dt,
+               const std::vector<char>* asleep = nullptr);
+
+protected:
+    // lattice velocity in the unit ball around q, in lattice units
+    Vec3 gust(const Vec3& q) const;
+
+    static const int NoiseSize = 16;    // lattice points per side, a power of two
+
+    ThreadPool* pool;
+    Vec3 wind = Vec3(0, 0, 0);
+    double density = 1;
+    double dragCoefficient = 1;
+    double liftCoefficient = 0.5;
+    double turbulence = 0.3;
+    double gustSize = 20;
+    double time = 0;
+
+    std::vector<Vec3> noiseField;
+    std::vector<int> incidentStart;     // triangles around each vertex (CSR)
+    std::vector<int> incident;
+
+    std::vector<Vec3> pos, vel;
+    std::vector<Vec3> triangleForce;    // a third of the force of each triangle
+};
+
+#endif // CLOTHWIND_H
@@ -1,4 +1,5 @@
 #include "colliders.h"
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <limits>  // For FLT_MAX
@@ -30,6 +31,17 @@ void ColliderPlane::resolveCollision(Particle* p, double kElastic, double kFrict
     p->pos = newpos;
 }
 
+bool ColliderPlane::mayCollide(const Vec3& bmin, const Vec3& bmax) const
+{
+    // the box straddles the plane if its corners along and against the normal do
+    Vec3 hi, lo;
+    for (int i = 0; i < 3; i++) {
+        hi[i] = planeN[i] >= 0 ? bmax[i] : bmin[i];
+        lo[i] = planeN[i] >= 0 ? bmin[i] : bmax[i];
+    }
+    return planeN.dot(lo) + planeD <= 0 && planeN.dot(hi) + planeD >= 0;
+}
+
 
 /*
  * Sphere
@@ -64,6 +76,12 @@ void ColliderSphere::resolveCollision(Particle* p, double kElastic, double kFric
 
 }
 
+bool ColliderSphere::mayCollide(const Vec3& bmin, const Vec3& bmax) const
+{
+    Vec3 closest = center.cwiseMax(bmin).cwiseMin(bmax);
+    return (closest - center).squaredNorm() <= radius*radius;
+}
+
 /*
  * Cube
  */
@@ -151,30 +169,52 @@ void ColliderAABB::resolveCollision(Particle* p, double kElastic, double kFricti
     }
 }
 
-void particleCollisions(Particle* pi){
-    for (Particle *pj : pi->neighbors) {
-        double minDist = 2.0 * pi->radius;
+bool ColliderAABB::mayCollide(const Vec3& bmin, const Vec3& bmax) const
+{
+    for (int i = 0; i < 3; i++) {
+        if (bmax[i] < position[i] - dimension[i]/2 || bmin[i] > position[i] + dimension[i]/2)
+            return false;
+    }
+    return true;
+}
 
-        Vec3 tempNormal = pi->pos - pj->pos;
-        double d2 = tempNormal.dot(tempNormal);
+void particleCollisionCorrection(const Particle* pi, Vec3& dPos, Vec3& dVel, std::vector<const Particle*>& contacts){
+    dPos = Vec3(0,0,0);
+    dVel = Vec3(0,0,0);
 
+    contacts.clear();
+    for (const Particle *pj : pi->neighbors) {
+        // radii differ with adaptive resolution
+        double minDist = pi->radius + pj->radius;
+        double d2 = (pi->pos - pj->pos).squaredNorm();
         if (d2 > 0.0 && d2 < minDist * minDist) {
-            double d = std::sqrt(d2);
-            tempNormal *= 1.0 / d;
-            double corr = (minDist - d) * 0.5;
-
-            pi->pos += tempNormal*corr;
-            pj->pos += tempNormal*-corr;
-
-            double vi = pi->vel.dot(tempNormal);
-            double vj = pj->vel.dot(tempNormal);
-
-            pi->vel += tempNormal*(vj - vi);
-            pj->vel += tempNormal*(vi - vj);
+            contacts.push_back(pj);
         }
     }
-}
+    if (contacts.empty()) return;
 
+    // fluid particles by id, then the fixed ones by id
+    std::sort(contacts.begin(), contacts.end(), [](const Particle* a, const Particle* b) {
+        return a->isFixed != b->isFixed ? b->isFixed : a->id < b->id;
+    });
 
+    for (const Particle *pj : contacts) {
+        double minDist = pi->radius + pj->radius;
+        Vec3 tempNormal = pi->pos - pj->pos;
+        double d = tempNormal.norm();
+        tempNormal *= 1.0 / d;
+        // pi only takes its half, pj gets the other one when it is processed.
+        // Fixed particles (fluid boundary samples) do not move, so pi takes all of it.
+        double corr = (minDist - d) * (pj->isFixed ? 1.0 : 0.5);
+
+        dPos += tempNormal*corr;
+        dVel += tempNormal*(pj->vel.dot(tempNormal) - pi->vel.dot(tempNormal));
+    }
+    // averaging keeps many simultaneous contacts from overshooting
+    if (contacts.size() > 1) {
+        dPos /= contacts.size();
+        dVel /= contacts.size();
+    }
+}
 
 
@@ -3,6 +3,7 @@
 
 #include "defines.h"
 #include "particle.h"
+#include <vector>
 
 
 class Collider  // Abstract interface
@@ -13,6 +14,10 @@ public:
 
     virtual bool testCollision(const Particle* p) const = 0;
     virtual void resolveCollision(Particle* p, double kElastic, double kFriction) const = 0;
+
+    // broadphase: false only if no particle with pos and prevPos inside the box can collide.
+    // The box already includes the particle radii.
+    virtual bool mayCollide(const Vec3& /*bmin*/, const Vec3& /*bmax*/) const { return true; }
 };
 
 
@@ -27,6 +32,7 @@ public:
 
     virtual bool testCollision(const Particle* p) const;
     virtual void resolveCollision(Particle* p, double kElastic, double kFriction) const;
+    virtual bool mayCollide(const Vec3& bmin, const Vec3& bmax) const;
 
 protected:
     Vec3 planeN;
@@ -47,6 +53,7 @@ public:
 
     virtual bool testCollision(const Particle* p) const;
     virtual void resolveCollision(Particle* p, double kElastic, double kFriction) const;
+    virtual bool mayCollide(const Vec3& bmin, const Vec3& bmax) const;
 
 protected:
     Vec3 center;
@@ -65,13 +72,19 @@ public:
     virtual bool collisionDetection(const Particle*p, bool &intersection, Vec3 &interPoint, float &tmin) const;
     virtual bool testCollision(const Particle* p) const;
     virtual void resolveCollision(Particle* p, double kElastic, double kFriction) const;
+    virtual bool mayCollide(const Vec3& bmin, const Vec3& bmax) const;
 
 protected:
     Vec3 position;
     Vec3 dimension;
 };
 
-void particleCollisions(Particle* pi);
+// Jacobi particle collisions: only reads the current state and returns the averaged
+// corrections of pi, so all particles can be processed in parallel and the corrections
+// applied afterwards. Contacts are summed in (isFixed, id) order, not in the pointer order
+// of the neighbor set, so the result does not depend on the thread count or on where the
+// particles were allocated. contacts is scratch space, one per thread.
+void particleCollisionCorrection(const Particle* pi, Vec3& dPos, Vec3& dVel, std::vector<const Particle*>& contacts);
 
 
 #endif // COLLIDERS_H
@@ -0,0 +1,289 @@
+#include "flipfluid.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // layers of faces filled around the fluid, covers the stencils of the particle advection
+    const int ExtrapolationLayers = 3;
+}
+
+
+void FlipFluid::transferToGrid(const std::vector<Particle*>& particles) {
+    int n = static_cast<int>(particles.size());
+    int numCells = nx * ny * nz;
+
+    // bin the particles by cell: cell of each particle in parallel, counting sort after
+    cellOf.resize(n);
+    pool->parallelFor(n, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            Vec3 g = (particles[i]->pos - origin) / h;
+            int ci = std::min(std::max(int(std::floor(g.x())), 0), nx - 1);
+            int cj = std::min(std::max(int(std::floor(g.y())), 0), ny - 1);
+            int ck = std::min(std::max(int(std::floor(g.z())), 0), nz - 1);
+            cellOf[i] = cell(ci, cj, ck);
+        }
+    });
+
+    cellStart.assign(numCells + 1, 0);
+    for (int i = 0; i < n; i++) {
+        cellStart[cellOf[i]]++;
+    }
+    int start = 0;
+    numFluidCells = 0;
+    for (int c = 0; c < numCells; c++) {
+        fluidCells[c] = cellStart[c] > 0;
+        numFluidCells += fluidCells[c];
+        start += cellStart[c];
+        cellStart[c] = start;
+    }
+    cellStart[numCells] = start;
+    cellEntries.resize(n);
+    for (int i = 0; i < n; i++) {
+        int c = cellOf[i];
+        cellStart[c]--;
+        cellEntries[cellStart[c]] = i;
+    }
+
+    // particles spawned since the last step start without an affine part
+    if (transfer == APIC) affine.resize(3 * n, Vec3(0, 0, 0));
+
+    particlesToField(particles, u, uValid, uDims, offsetU, 0);
+    particlesToField(particles, v, vValid, vDims, offsetV, 1);
+    particlesToField(particles, w, wValid, wDims, offsetW, 2);
+
+    // the old field is sampled at the same places as the new one, so it is extended the same way
+    extrapolate(u, uNext, uValid, uDims, ExtrapolationLayers);
+    extrapolate(v, vNext, vValid, vDims, ExtrapolationLayers);
+    extrapolate(w, wNext, wValid, wDims, ExtrapolationLayers);
+    uOld = u;
+    vOld = v;
+    wOld = w;
+}
+
+void FlipFluid::particlesToField(const std::vector<Particle*>& particles, std::vector<double>& field,
+                                 std::vector<char>& valid, const int dims[3], const Vec3& offset, int axis)
+{
+    int numFaces = dims[0] * dims[1] * dims[2];
+    int cellDims[3] = {nx, ny, nz};
+    valid.resize(numFaces);
+
+    pool->parallelFor(numFaces, [&](int begin, int end) {
+        for (int f = begin; f < end; f++) {
+            int idx[3] = {f % dims[0], (f / dims[0]) % dims[1], f / (dims[0] * dims[1])};
+            Vec3 g = Vec3(idx[0], idx[1], idx[2]) + offset;
+            Vec3 facePos = origin + g * h;
+
+            // trilinear weights reach one cell to each side of the face
+            int lo[3], hi[3];
+            for (int a = 0; a < 3; a++) {
+                lo[a] = std::max(int(std::floor(g[a] - 1)), 0);
+                hi[a] = std::min(int(std::ceil(g[a] + 1)) - 1, cellDims[a] - 1);
+            }
+
+            double sum = 0, weightSum = 0;
+            for (int k = lo[2]; k <= hi[2]; k++) {
+                for (int j = lo[1]; j <= hi[1]; j++) {
+                    for (int i = lo[0]; i <= hi[0]; i++) {
+                        int c = cell(i, j, k);
+                        for (int e = cellStart[c]; e < cellStart[c + 1]; e++) {
+                            int p = cellEntries[e];
+                            const Particle* particle = particles[p];
+                            Vec3 d = (particle->pos - origin) / h - g;
+                            double weight = std::max(0.0, 1 - std::abs(d.x()))
+                                          * std::max(0.0, 1 - std::abs(d.y()))
+                                          * std::max(0.0, 1 - std::abs(d.z()));
+                            if (weight <= 0) continue;
+
+                            double value = particle->vel[axis];
+                            if (transfer == APIC) value += affine[3 * p + axis].dot(facePos - particle->pos);
+                            sum += weight * value;
+                            weightSum += weight;
+                        }
+                    }
+                }
+            }
+            field[f] = weightSum > 0 ? sum / weightSum : 0.0;
+            valid[f] = weightSum > 0;
+        }
+    });
+}
+
+void FlipFluid::extrapolate(std::vector<double>& field, std::vector<double>& next, std::vector<char>& valid,
+                            const int dims[3], int passes)
+{
+    int numFaces = dims[0] * dims[1] * dims[2];
+    int stride[3] = {1, dims[0], dims[0] * dims[1]};
+    validNext.resize(numFaces);
+
+    for (int pass = 0; pass < passes; pass++) {
+        pool->parallelFor(numFaces, [&](int begin, int end) {
+            for (int f = begin; f < end; f++) {
+                next[f] = field[f];
+                validNext[f] = valid[f];
+                if (valid[f]) continue;
+
+                int idx[3] = {f % dims[0], (f / dims[0]) % dims[1], f / (dims[0] * dims[1])};
+                double sum = 0;
+                int count = 0;
+                for (int a = 0; a < 3; a++) {
+                    if (idx[a] > 0 && valid[f - stride[a]]) {
+                        sum += field[f - stride[a]];
+                        count++;
+                    }
+                    if (idx[a] < dims[a] - 1 && valid[f + stride[a]]) {
+                        sum += field[f + stride[a]];
+                        count++;
+                    }
+                }
+                if (count > 0) {
+                    next[f] = sum / count;
+                    validNext[f] = 1;
+                }
+            }
+        });
+        field.swap(next);
+        valid.swap(validNext);
+    }
+}
+
+void FlipFluid::solve(double dt) {
+    // gravity everywhere, the faces away from the fluid are replaced after the projection
+    // anyway. The velocity normal to the walls is zero.
+    pool->parallelFor(nx * (ny + 1) * nz, [&](int begin, int end) {
+        for (int f = begin; f < end; f++) {
+            int j = (f / nx) % (ny + 1);
+            v[f] = (j == 0 || j == ny) ? 0.0 : v[f] + dt * gravity.y();
+        }
+    });
+    pool->parallelFor((nx + 1) * ny * nz, [&](int begin, int end) {
+        for (int f = begin; f < end; f++) {
+            int i = f % (nx + 1);
+            u[f] = (i == 0 || i == nx) ? 0.0 : u[f] + dt * gravity.x();
+        }
+    });
+    pool->parallelFor(nx * ny * (nz + 1), [&](int begin, int end) {
+        for (int f = begin; f < end; f++) {
+            int k = f / (nx * ny);
+            w[f] = (k == 0 || k == nz) ? 0.0 : w[f] + dt * gravity.z();
+        }
+    });
+
+    // the fluid cells change every step and the preconditioner with them
+    buildPreconditioner();
+    project();
+
+    // faces next to a fluid cell have their final velocity, the rest is extrapolated.
+    // Walls count as valid to keep them at zero.
+    pool->parallelFor((nx + 1) * ny * nz, [&](int begin, int end) {
+        for (int f = begin; f < end; f++) {
+            int i = f % (nx + 1), j = (f / (nx + 1)) % ny, k = f / ((nx + 1) * ny);
+            uValid[f] = i == 0 || i == nx || fluidCells[cell(i - 1, j, k)] || fluidCells[cell(i, j, k)];
+        }
+    });
+    pool->parallelFor(nx * (ny + 1) * nz, [&](int begin, int end) {
+        for (int f = begin; f < end; f++) {
+            int i = f % nx, j = (f / nx) % (ny + 1), k = f / (nx * (ny + 1));
+            vValid[f] = j == 0 || j == ny || fluidCells[cell(i, j - 1, k)] || fluidCells[cell(i, j, k)];
+        }
+    });
+    pool->parallelFor(nx * ny * (nz + 1), [&](int begin, int end) {
+        for (int f = begin; f < end; f++) {
+            int i = f % nx, j = (f / nx) % ny, k = f / (nx * ny);
+            wValid[f] = k == 0 || k == nz || fluidCells[cell(i, j, k - 1)] || fluidCells[cell(i, j, k)];
+        }
+    });
+    extrapolate(u, uNext, uValid, uDims, ExtrapolationLayers);
+    extrapolate(v, vNext, vValid, vDims, ExtrapolationLayers);
+    extrapolate(w, wNext, wValid, wDims, ExtrapolationLayers);
+}
+
+Vec3 FlipFluid::sampleGradient(const std::vector<double>& field, const int dims[3], const Vec3& offset, const Vec3& pos) const {
+    Vec3 g = (pos - origin) / h - offset;
+    int i0[3];
+    double t[3];
+    bool inside[3];
+    for (int a = 0; a < 3; a++) {
+        double x = std::min(std::max(g[a], 0.0), double(dims[a] - 1));
+        inside[a] = dims[a] > 1 && x == g[a];
+        i0[a] = std::min(int(x), std::max(dims[a] - 2, 0));
+        t[a] = x - i0[a];
+    }
+    int sx = dims[0] > 1 ? 1 : 0;
+    int sy = dims[1] > 1 ? dims[0] : 0;
+    int sz = dims[2] > 1 ? dims[0] * dims[1] : 0;
+    int base = i0[0] + dims[0] * (i0[1] + dims[1] * i0[2]);
+
+    double c000 = field[base],           c100 = field[base + sx];
+    double c010 = field[base + sy],      c110 = field[base + sy + sx];
+    double c001 = field[base + sz],      c101 = field[base + sz + sx];
+    double c011 = field[base + sz + sy], c111 = field[base + sz + sy + sx];
+
+    // clamped axes have a constant sample
+    Vec3 grad;
+    grad.x() = !inside[0] ? 0.0 : ((c100 - c000) * (1 - t[1]) * (1 - t[2]) + (c110 - c010) * t[1] * (1 - t[2])
+                                 + (c101 - c001) * (1 - t[1]) * t[2]       + (c111 - c011) * t[1] * t[2]);
+    grad.y() = !inside[1] ? 0.0 : ((c010 - c000) * (1 - t[0]) * (1 - t[2]) + (c110 - c100) * t[0] * (1 - t[2])
+                                 + (c011 - c001) * (1 - t[0]) * t[2]       + (c111 - c101) * t[0] * t[2]);
+    grad.z() = !inside[2] ? 0.0 : ((c001 - c000) * (1 - t[0]) * (1 - t[1]) + (c101 - c100) * t[0] * (1 - t[1])
+                                 + (c011 - c010) * (1 - t[0]) * t[1]       + (c111 - c110) * t[0] * t[1]);
+    return grad / h;
+}
+
+void FlipFluid::transferToParticles(const std::vector<Particle*>& particles, double dt) {
+    int n = static_cast<int>(particles.size());
+    if (transfer == APIC) affine.resize(3 * n, Vec3(0, 0, 0));
+
+    pool->parallelFor(n, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            Particle* p = particles[i];
+            Vec3 pos = p->pos;
+            Vec3 gridVel = velocityAt(pos);
+
+            Vec3 vel;
+            if (transfer == APIC) {
+                vel = gridVel;
+                affine[3 * i + 0] = sampleGradient(u, uDims, offsetU, pos);
+                affine[3 * i + 1] = sampleGradient(v, vDims, offsetV, pos);
+                affine[3 * i + 2] = sampleGradient(w, wDims, offsetW, pos);
+            }
+            else {
+                Vec3 oldVel(sample(uOld, uDims, offsetU, pos), sample(vOld, vDims, offsetV, pos),
+                            sample(wOld, wDims, offsetW, pos));
+                vel = flipRatio * (p->vel + gridVel - oldVel) + (1 - flipRatio) * gridVel;
+            }
+
+            // midpoint rule through the divergence free grid velocity
+            Vec3 mid = pos + 0.5 * dt * gridVel;
+            Vec3 next = pos + dt * velocityAt(mid);
+
+            // stay inside the tank, without moving into the wall
+            for (int a = 0; a < 3; a++) {
+                double lo = setup.domainMin[a] + p->radius;
+                double hi = setup.domainMax[a] - p->radius;
+                if (next[a] < lo) {
+                    next[a] = lo;
+                    vel[a] = std::max(vel[a], 0.0);
+                }
+                else if (next[a] > hi) {
+                    next[a] = hi;
+                    vel[a] = std::min(vel[a], 0.0);
+                }
+            }
+
+            p->prevPos = pos;
+            p->pos = next;
+            p->vel = vel;
+        }
+    });
+}
+
+void FlipFluid::retireParticle(int slot, int last) {
+    int n = static_cast<int>(affine.size()) / 3;
+    if (slot >= n) return;
+
+    // particles spawned after the last transfer have no affine part yet
+    for (int a = 0; a < 3; a++) {
+        affine[3 * slot + a] = last < n ? affine[3 * last + a] : Vec3(0, 0, 0);
+    }
+    affine.resize(3 * std::min(n, last));
+}
@@ -0,0 +1,82 @@
+#ifndef FLIPFLUID_H
+#define FLIPFLUID_H
+
+#include "gridfluid.h"
+#include "particle.h"
+#include <vector>
+
+/*
+ *  Hybrid particle / grid liquid. The particles carry the fluid, the MAC grid of GridFluid is
+ *  only used to make their velocities divergence free: each step the particle velocities are
+ *  splatted to the faces (P2G), cells holding particles are projected with empty cells at
+ *  zero pressure, and the grid velocity goes back to the particles (G2P), which then move
+ *  through it. The grid can be much coarser than an SPH neighborhood, so far fewer
+ *  particles resolve the same motion, and both transfers parallelize without any locks.
+ *
+ *  FLIP adds the grid velocity change to the particle velocity, blended with a bit of PIC to
+ *  damp the noise. APIC transfers the grid velocity itself together with an affine part per
+ *  particle, which keeps the rotation PIC loses without FLIP's noise.
+ *
+ *  Particles are binned into the grid cells with a counting sort, as in ParticleHashGrid,
+ *  and every face gathers from the cells around it, so the result does not depend on the
+ *  number of threads. The particles are the ones of a FluidSimulation and stay in its pool.
+ */
+class FlipFluid : public GridFluid
+{
+public:
+    enum Transfer { FLIP, APIC };
+
+    explicit FlipFluid(ThreadPool* pool = nullptr) : GridFluid(pool) {}
+
+    // FLIP does not keep the affine parts, APIC starts again from zero
+    void setTransfer(Transfer t) { if (t != transfer) affine.clear(); transfer = t; }
+    Transfer getTransfer() const { return transfer; }
+    // share of FLIP in the FLIP/PIC blend
+    void setFlipRatio(double r) { flipRatio = r; }
+    void setGravity(const Vec3& g) { gravity = g; }
+
+    // particle velocities to the faces, marks the cells holding particles
+    void transferToGrid(const std::vector<Particle*>& particles);
+    // gravity and pressure projection on the grid
+    void solve(double dt);
+    // grid velocity back to the particles and advection, particles stay inside the domain
+    void transferToParticles(const std::vector<Particle*>& particles, double dt);
+
+    // the APIC state follows the particles: called after ParticlePool::retire(slot) moved the
+    // particle of slot last into it
+    void retireParticle(int slot, int last);
+    void clearParticles() { affine.clear(); }
+
+    int getNumFluidCells() const { return numFluidCells; }
+
+protected:
+    // weighted average of one velocity component of the particles around each face,
+    // valid where at least one particle contributed
+    void particlesToField(const std::vector<Particle*>& particles, std::vector<double>& field,
+                          std::vector<char>& valid, const int dims[3], const Vec3& offset, int axis);
+    // fills the faces without a valid value from their valid neighbors, a layer per pass
+    void extrapolate(std::vector<double>& field, std::vector<double>& next, std::vector<char>& valid,
+                     const int dims[3], int passes);
+    // gradient of the trilinear sample, the affine part of one velocity component
+    Vec3 sampleGradient(const std::vector<double>& field, const int dims[3], const Vec3& offset, const Vec3& pos) const;
+
+    Transfer transfer = FLIP;
+    double flipRatio = 0.95;
+    Vec3 gravity = Vec3(0, -9.81, 0);
+
+    // particles sorted by cell
+    std::vector<int> cellOf;
+    std::vector<int> cellStart;
+    std::vector<int> cellEntries;
+    int numFluidCells = 0;
+
+    // face velocities before the projection, for the FLIP update
+    std::vector<double> uOld, vOld, wOld;
+    std::vector<char> uValid, vValid, wValid;
+    std::vector<char> validNext;
+
+    // APIC affine velocity, per particle one gradient for each velocity component
+    std::vector<Vec3> affine;
+};
+
+#endif // FLIPFLUID_H
@@ -0,0 +1,127 @@
+#include "fluidadaptivity.h"
+#include <algorithm>
+#include <cmath>
+
+FluidAdaptivity::FluidAdaptivity(double baseMass, double baseRadius, int maxLevel)
+    : baseMass(baseMass), baseRadius(baseRadius)
+{
+    maxMass = baseMass * std::pow(2.0, maxLevel);
+}
+
+double FluidAdaptivity::radiusForMass(double mass) const {
+    return baseRadius * std::cbrt(mass / baseMass);
+}
+
+FluidAdaptivity::Region FluidAdaptivity::classify(const Particle* p) const {
+    Vec3 centroid = Vec3(0,0,0);
+    int count = 0;
+    for (const Particle* pj : p->neighbors) {
+        if (pj == p) continue;
+        centroid += pj->pos;
+        count++;
+    }
+    double speed = p->vel.norm();
+    if (count < minNeighbors || speed > splitSpeed) return Surface;
+
+    double offset = (centroid / count - p->pos).norm();
+    if (offset > 0.25 * p->radius) return Surface;
+    if (count >= interiorNeighbors && offset < 0.1 * p->radius && speed < mergeSpeed) return Interior;
+    return Keep;
+}
+
+Vec3 FluidAdaptivity::splitDirection() {
+    // spherical Fibonacci sequence, well spread and the same on every run
+    const double goldenAngle = M_PI * (3.0 - std::sqrt(5.0));
+    double z = 1.0 - 2.0 * ((splitCounter * 0.618033988749895) - std::floor(splitCounter * 0.618033988749895));
+    double phi = goldenAngle * splitCounter;
+    splitCounter++;
+    double s = std::sqrt(std::max(0.0, 1.0 - z*z));
+    return Vec3(s * std::cos(phi), s * std::sin(phi), z);
+}
+
+bool FluidAdaptivity::adapt(ParticlePool& pool, const std::function<void(int)>& retire) {
+    const std::vector<Particle*>& particles = pool.getParticles();
+    int n = pool.size();
+    lastMerges = lastSplits = 0;
+
+    region.resize(n);
+    touched.assign(n, 0);
+    for (int i = 0; i < n; i++) {
+        region[i] = classify(particles[i]);
+    }
+
+    // merge interior pairs of the same level, pj is folded into pi
+    retired.clear();
+    for (int i = 0; i < n; i++) {
+        Particle* pi = particles[i];
+        if (touched[i] || region[i] != Interior || 2 * pi->mass > maxMass * (1 + 1e-9)) continue;
+
+        Particle* partner = nullptr;
+        double bestDist2 = 0;
+        for (Particle* pj : pi->neighbors) {
+            if (pj == pi || pj->isFixed) continue;
+            int j = pj->id;
+            if (touched[j] || region[j] != Interior) continue;
+            if (std::abs(pj->mass - pi->mass) > 1e-9 * pi->mass) continue;
+            double d2 = (pj->pos - pi->pos).squaredNorm();
+            if (!partner || d2 < bestDist2) {
+                partner = pj;
+                bestDist2 = d2;
+            }
+        }
+        if (!partner) continue;
+
+        double mass = pi->mass + partner->mass;
+        pi->pos = (pi->mass * pi->pos + partner->mass * partner->pos) / mass;
+        pi->prevPos = pi->pos;
+        pi->vel = (pi->mass * pi->vel + partner->mass * partner->vel) / mass;
+        pi->mass = mass;
+        pi->radius = radiusForMass(mass);
+
+        touched[i] = touched[partner->id] = 1;
+        retired.push_back(partner->id);
+        lastMerges++;
+    }
+
+    // heavy particles near the surface, picked before retiring moves particles around
+    toSplit.clear();
+    for (int i = 0; i < n; i++) {
+        if (!touched[i] && region[i] == Surface && particles[i]->mass > 1.5 * baseMass) {
+            toSplit.push_back(particles[i]);
+        }
+    }
+
+    // retiring swaps the last particle into the freed slot. Going from the highest slot down,
+    // that particle always comes from above every slot still to retire, so those keep
+    // holding the merged partners. The moved particle may itself have just been merged.
+    std::sort(retired.begin(), retired.end(), std::greater<int>());
+    for (int slot : retired) {
+        retire(slot);
+    }
+
+    // split into two halves
+    for (Particle* pi : toSplit) {
+        Particle* half = pool.spawn();
+        if (!half) break;
+
+        double mass = 0.5 * pi->mass;
+        double radius = radiusForMass(mass);
+        Vec3 offset = radius * splitDirection();
+
+        half->pos = pi->pos - offset;
+        half->prevPos = half->pos;
+        half->vel = pi->vel;
+        half->mass = mass;
+        half->radius = radius;
+        half->color = pi->color;
+        half->density = pi->density;
+
+        pi->pos += offset;
+        pi->prevPos = pi->pos;
+        pi->mass = mass;
+        pi->radius = radius;
+        lastSplits++;
+    }
+
+    return lastMerges > 0 || lastSplits > 0;
+}
@@ -0,0 +1,60 @@
+#ifndef FLUIDADAPTIVITY_H
+#define FLUIDADAPTIVITY_H
+
+#include "particlepool.h"
+#include <functional>
+
+/*
+ *  Adaptive particle resolution for the fluid. Slow particles deep inside the fluid are merged
+ *  pairwise into heavier and larger ones, and merged particles are split again when they get
+ *  close to the free surface or move fast. Masses are baseMass * 2^level, so only particles of
+ *  the same level are merged and radii stay in a few discrete values (volume scales with mass).
+ *
+ *  Merging keeps the center of mass and the momentum of the pair, splitting places the two
+ *  halves symmetrically around the old center with the old velocity, so both conserve mass
+ *  and momentum exactly.
+ *
+ *  The classification uses the neighbor sets of the last step: a particle is near the
+ *  surface when it has few neighbors or when their centroid is far from it.
+ */
+class FluidAdaptivity
+{
+public:
+    FluidAdaptivity(double baseMass, double baseRadius, int maxLevel = 3);
+
+    void setMergeSpeed(double v) { mergeSpeed = v; }
+    void setSplitSpeed(double v) { splitSpeed = v; }
+
+    // returns true if particles were added or removed from the pool. Merged partners leave
+    // through retire(slot), so the owner can keep its per-slot data in step with the pool.
+    bool adapt(ParticlePool& pool, const std::function<void(int)>& retire);
+
+    int getLastMerges() const { return lastMerges; }
+    int getLastSplits() const { return lastSplits; }
+    double radiusForMass(double mass) const;
+
+protected:
+    enum Region { Keep, Interior, Surface };
+    Region classify(const Particle* p) const;
+    Vec3 splitDirection();
+
+    double baseMass;
+    double baseRadius;
+    double maxMass;
+    double mergeSpeed = 2.0;
+    double splitSpeed = 5.0;
+    int minNeighbors = 6;
+    int interiorNeighbors = 8;
+
+    int lastMerges = 0;
+    int lastSplits = 0;
+    unsigned int splitCounter = 0;
+
+    // scratch, indexed by pool slot
+    std::vector<char> region;
+    std::vector<char> touched;
+    std::vector<int> retired;
+    std::vector<Particle*> toSplit;
+};
+
+#endif // FLUIDADAPTIVITY_H
@@ -0,0 +1,77 @@
+#include "fluidboundary.h"
+#include "particlehashgrid.h"
+#include "sphkernels.h"
+#include <algorithm>
+#include <cmath>
+
+FluidBoundary::~FluidBoundary() {
+    clear();
+}
+
+void FluidBoundary::clear() {
+    for (Particle* p : samples) {
+        delete p;
+    }
+    samples.clear();
+}
+
+void FluidBoundary::addSample(const Vec3& pos, double radius) {
+    Particle* p = new Particle(pos, Vec3(0, 0, 0), 0);
+    p->id = samples.size();
+    p->radius = radius;
+    p->isFixed = true;
+    p->color = Vec3(0.5, 0.5, 0.5);
+    samples.push_back(p);
+}
+
+void FluidBoundary::addBox(const Vec3& bmin, const Vec3& bmax, double spacing, double radius) {
+    Vec3 lo = bmin - Vec3::Constant(radius);
+    Vec3 hi = bmax + Vec3::Constant(radius);
+    Vec3i n;
+    for (int a = 0; a < 3; a++) {
+        n[a] = std::max(1, static_cast<int>(std::ceil((hi[a] - lo[a]) / spacing)));
+    }
+    Vec3 step = (hi - lo).cwiseQuotient(n.cast<double>());
+
+    // lattice points on the shell of the box, each edge and corner only once
+    for (int i = 0; i <= n[0]; i++) {
+        for (int j = 0; j <= n[1]; j++) {
+            for (int k = 0; k <= n[2]; k++) {
+                bool onShell = i == 0 || i == n[0] || j == 0 || j == n[1] || k == 0 || k == n[2];
+                if (!onShell) {
+                    // jump to the far face of this row
+                    k = n[2] - 1;
+                    continue;
+                }
+                addSample(lo + Vec3(i*step[0], j*step[1], k*step[2]), radius);
+            }
+        }
+    }
+}
+
+void FluidBoundary::computeMasses(double h, double restDensity) {
+    int n = size();
+    if (n == 0) return;
+
+    SPHDensityKernel kernel(h);
+    ParticleHashGrid grid(h, n);
+    grid.create(samples);
+
+    std::vector<int> ids;
+    for (int i = 0; i < n; i++) {
+        Particle* pi = samples[i];
+        int count = grid.query(samples, i, h, ids);
+        // colliding cells can repeat candidates
+        std::sort(ids.begin(), ids.begin() + count);
+        count = std::unique(ids.begin(), ids.begin() + count) - ids.begin();
+
+        double sumW = 0;
+        for (int k = 0; k < count; k++) {
+            sumW += kernel.value((samples[ids[k]]->pos - pi->pos).squaredNorm());
+        }
+        // psi = rho0 / sum_k W_ik, the sample itself is always part of the sum
+        pi->mass = sumW > 0 ? restDensity / sumW : 0;
+        pi->density = restDensity;
+        pi->pressure = 0;
+    }
+}
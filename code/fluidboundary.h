@@ -0,0 +1,41 @@
+#ifndef FLUIDBOUNDARY_H
+#define FLUIDBOUNDARY_H
+
+#include "particle.h"
+#include <vector>
+
+/*
+ *  Static boundary samples for SPH, Akinci et al. 2012. Samples are fixed particles that go
+ *  into the same neighbor grid as the fluid, so walls of any shape cost one more neighbor
+ *  each instead of a collider test per particle and plane.
+ *
+ *  The mass of a sample is its density contribution psi = rho0 * V, where V comes from the
+ *  sampling density around it, so uneven or overlapping sampling does not create bumps.
+ *  Samples have isFixed set, which is how the fluid force tells them apart.
+ */
+class FluidBoundary
+{
+public:
+    FluidBoundary() {}
+    ~FluidBoundary();
+
+    void clear();
+
+    // one sample, for arbitrary shapes
+    void addSample(const Vec3& pos, double radius);
+
+    // inside of a closed box with the fluid in [bmin, bmax]. Samples sit one radius
+    // outside, so fluid particles touching them are still inside the box.
+    void addBox(const Vec3& bmin, const Vec3& bmax, double spacing, double radius);
+
+    // has to be called after adding the samples, h is the density kernel support
+    void computeMasses(double h, double restDensity);
+
+    const std::vector<Particle*>& getSamples() const { return samples; }
+    int size() const { return static_cast<int>(samples.size()); }
+
+protected:
+    std::vector<Particle*> samples;
+};
+
+#endif // FLUIDBOUNDARY_H
@@ -0,0 +1,30 @@
+#include "fluidemitter.h"
+#include <cmath>
+
+FluidEmitter::FluidEmitter(const Vec3& center, const Vec3& velocity, double halfWidth, double spacing)
+    : center(center), velocity(velocity), halfWidth(halfWidth), spacing(spacing)
+{
+    Vec3 dir = velocity.normalized();
+    Vec3 helper = std::abs(dir.y()) < 0.9 ? Vec3(0, 1, 0) : Vec3(1, 0, 0);
+    u = dir.cross(helper).normalized();
+    v = dir.cross(u);
+}
+
+void FluidEmitter::step(double dt, std::vector<Vec3>& positions) {
+    double speed = velocity.norm();
+    if (speed <= 0) return;
+    Vec3 dir = velocity / speed;
+
+    int n = static_cast<int>(std::floor(halfWidth / spacing));
+    travel += speed * dt;
+    while (travel >= spacing) {
+        travel -= spacing;
+        // released slightly in the past, so it is already ahead by the leftover travel
+        Vec3 layerCenter = center + travel * dir;
+        for (int i = -n; i <= n; i++) {
+            for (int j = -n; j <= n; j++) {
+                positions.push_back(layerCenter + (i * spacing) * u + (j * spacing) * v);
+            }
+        }
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef FLUIDEMITTER_H
+#define FLUIDEMITTER_H
+
+#include "defines.h"
+#include <vector>
+
+/*
+ *  Square nozzle that injects fluid layer by layer. A new layer of particles on a lattice
+ *  is released each time the previous one has travelled one spacing, so the stream has
+ *  the same spacing as the rest of the fluid and does not overlap itself.
+ */
+class FluidEmitter
+{
+public:
+    FluidEmitter(const Vec3& center, const Vec3& velocity, double halfWidth, double spacing);
+
+    // appends the positions released during dt
+    void step(double dt, std::vector<Vec3>& positions);
+
+    const Vec3& getVelocity() const { return velocity; }
+    const Vec3& getCenter() const { return center; }
+    double getHalfWidth() const { return halfWidth; }
+
+protected:
+    Vec3 center;
+    Vec3 velocity;
+    Vec3 u, v;          // nozzle plane
+    double halfWidth;
+    double spacing;
+    double travel = 0;  // distance covered by the last layer
+};
+
+
+// axis aligned volume where particles are removed
+class FluidDrain
+{
+public:
+    FluidDrain(const Vec3& bmin, const Vec3& bmax) : bmin(bmin), bmax(bmax) {}
+
+    bool contains(const Vec3& p) const {
+        return (p.array() >= bmin.array()).all() && (p.array() <= bmax.array()).all();
+    }
+
+protected:
+    Vec3 bmin, bmax;
+};
+
+#endif // FLUIDEMITTER_H
@@ -0,0 +1,430 @@
+#include "fluidsimulation.h"
+#include "flipfluid.h"
+#include "colliders.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    // ms since the last lap, restarts the lap
+    double lapMs(Clock::time_point& t0) {
+        Clock::time_point t1 = Clock::now();
+        double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        t0 = t1;
+        return ms;
+    }
+}
+
+
+long long FluidSetup::numBlockParticles() const {
+    long long n = 0;
+    for (const FluidBlock& b : blocks) {
+        n += (long long)(b.nx) * b.ny * b.nz;
+    }
+    return n;
+}
+
+int FluidSetup::poolCapacity() const {
+    return capacity > 0 ? capacity : static_cast<int>(numBlockParticles());
+}
+
+void FluidSetup::forEachBlockParticle(const std::function<void(const Vec3&, const Vec3&)>& f) const {
+    double sp = particleSpacing;
+    for (const FluidBlock& b : blocks) {
+        for (int i = 0; i < b.nx; i++) {
+            for (int j = 0; j < b.ny; j++) {
+                for (int k = 0; k < b.nz; k++) {
+                    f(b.origin + Vec3(i*sp, j*sp, k*sp), b.vel);
+                }
+            }
+        }
+    }
+}
+
+FluidSetup FluidSetup::doubleWall(double side, double radius) {
+    FluidSetup s;
+    s.particleRadius = radius;
+    s.particleSpacing = 2 * radius;
+    s.domainMax = Vec3(side, side, side);
+    s.capacity = 20000;
+
+    // two walls of fluid against opposite sides of the tank
+    int nx = int(side / 4) / 2;
+    int ny = int(side / 3);
+    int nz = int(side / 2);
+    double far = side - radius - (nx - 1) * s.particleSpacing;
+    s.blocks.push_back({Vec3(radius, radius, radius), nx, ny, nz, Vec3(0, 0, 0)});
+    s.blocks.push_back({Vec3(far, radius, radius), nx, ny, nz, Vec3(0, 0, 0)});
+    return s;
+}
+
+FluidSetup FluidSetup::cube(double side, double radius) {
+    FluidSetup s;
+    s.particleRadius = radius;
+    s.particleSpacing = 2 * radius;
+    s.domainMax = Vec3(side, side, side);
+    s.capacity = 20000;
+
+    int n = int(side / 4);
+    double o = 1.5 * radius;
+    s.blocks.push_back({Vec3(o, o, o), n, n, n, Vec3(0, 0, 0)});
+    return s;
+}
+
+FluidSetup FluidSetup::river(double side, double radius) {
+    FluidSetup s;
+    s.particleRadius = radius;
+    s.particleSpacing = 2 * radius;
+    s.domainMax = Vec3(side, side, side);
+    s.capacity = 20000;
+
+    // a jet on one side and a drain along the floor of the other
+    double sp = s.particleSpacing;
+    s.emitters.push_back(FluidEmitter(Vec3(2*sp, 0.6*side, 0.5*side), Vec3(10, 0, 0), 4*sp, sp));
+    s.drains.push_back(FluidDrain(Vec3(side - 4*sp, 0, 0), Vec3(side, 4*sp, side)));
+    return s;
+}
+
+FluidSetup FluidSetup::damBreak(long long numParticles, double radius) {
+    FluidSetup s;
+    s.particleRadius = radius;
+    s.particleSpacing = 2 * radius;
+
+    // column with a square k x k base and about twice as high, in a tank twice as wide
+    int k = std::max(1, int(std::round(std::cbrt(0.5 * double(numParticles)))));
+    int ny = std::max(1, int((numParticles + (long long)(k) * k - 1) / ((long long)(k) * k)));
+    double sp = s.particleSpacing;
+    s.domainMax = Vec3(2 * k * sp, (ny + 2) * sp, k * sp);
+    s.blocks.push_back({Vec3(radius, radius, radius), k, ny, k, Vec3(0, 0, 0)});
+    return s;
+}
+
+
+FluidSimulation::FluidSimulation(ThreadPool* threadPool)
+    : pool(threadPool ? threadPool : &ThreadPool::shared())
+    , sleep(pool)
+{
+}
+
+FluidSimulation::~FluidSimulation() {
+    destroy();
+}
+
+const char* FluidSimulation::phaseName(int phase) {
+    static const char* names[NumPhases] = {"Sources", "Grid", "Neighbors", "Forces", "Integrate", "Collisions", "Sleep", "Adapt"};
+    return names[phase];
+}
+
+void FluidSimulation::destroy() {
+    if (particleHashGrid) delete particleHashGrid;
+    if (particlePool) delete particlePool;
+    if (adaptivity) delete adaptivity;
+    if (fGravity) delete fGravity;
+    if (fNavierStokes) delete fNavierStokes;
+    if (flip) delete flip;
+    particleHashGrid = nullptr;
+    particlePool = nullptr;
+    adaptivity = nullptr;
+    fGravity = nullptr;
+    fNavierStokes = nullptr;
+    flip = nullptr;
+    forces.clear();
+    particles.clear();
+    gridParticles.clear();
+    boundary.clear();
+}
+
+void FluidSimulation::load(const FluidSetup& s) {
+    destroy();
+    setup = s;
+
+    double r = setup.particleRadius;
+    fGravity = new ForceConstAcceleration();
+    fGravity->setAcceleration(Vec3(0, -9.81, 0));
+    fNavierStokes = new ForceNavierStockes(2.0 * r);
+    fNavierStokes->setThreadPool(pool);
+    forces.push_back(fGravity);
+    forces.push_back(fNavierStokes);
+
+    // fluid particles stay inside the domain, the samples are just outside
+    boundary.addBox(setup.domainMin, setup.domainMax, r, r);
+    boundary.computeMasses(2.0 * r, fNavierStokes->getRestDensity());
+    fNavierStokes->setBoundaryParticles(boundary.getSamples());
+
+    // everything is sized for the pool capacity once, emitters only recycle particles
+    particlePool = new ParticlePool(setup.poolCapacity());
+    // the fluid at rest creeps by up to a sixth of the spacing in half a second, a particle
+    // falling from rest gets over a radius
+    sleep.resize(particlePool->capacity());
+    sleep.setRestDistance(0.25 * setup.particleSpacing);
+    sleep.setSleepTime(0.5);
+    particleHashGrid = new ParticleHashGrid(2.0 * r, particlePool->capacity() + boundary.size());
+    adaptivity = new FluidAdaptivity(setup.particleMass, r);
+
+    reset();
+}
+
+void FluidSimulation::reset() {
+    if (!particlePool) return;
+
+    particlePool->clear();
+    emitters = setup.emitters;
+    drains = setup.drains;
+    numSpawned = numRetired = 0;
+    stepCount = 0;
+    if (flip) flip->clearParticles();
+    fNavierStokes->invalidateMixedState();
+    sleep.wakeAll();
+    spawnBlocks();
+    particlesChanged();
+}
+
+void FluidSimulation::clear() {
+    if (!particlePool) return;
+
+    // the particles go back to the pool, which owns them
+    particlePool->clear();
+    if (flip) flip->clearParticles();
+    fNavierStokes->invalidateMixedState();
+    sleep.wakeAll();
+    particlesChanged();
+}
+
+void FluidSimulation::reserveParticles(int capacity) {
+    if (!particlePool || capacity <= particlePool->capacity()) return;
+
+    particlePool->grow(capacity);
+    sleep.resize(particlePool->capacity());
+    delete particleHashGrid;
+    particleHashGrid = new ParticleHashGrid(2.0 * setup.particleRadius, particlePool->capacity() + boundary.size());
+}
+
+void FluidSimulation::spawnBlocks() {
+    // particles past the capacity are dropped
+    setup.forEachBlockParticle([&](const Vec3& pos, const Vec3& vel) {
+        spawnParticle(pos, vel);
+    });
+}
+
+Particle* FluidSimulation::spawnParticle(const Vec3& pos, const Vec3& vel) {
+    Particle* p = particlePool->spawn();
+    if (!p) return nullptr;
+
+    p->pos = pos;
+    p->prevPos = pos;
+    p->vel = vel;
+    p->mass = setup.particleMass;
+    p->radius = setup.particleRadius;
+    p->color = Vec3(45.0, 114.0, 178.0).normalized();
+    p->isFixed = false;
+    fNavierStokes->storeMixed(p->id, p);
+    return p;
+}
+
+void FluidSimulation::setEngine(Engine e) {
+    if (e != engine && flip) flip->clearParticles();
+    engine = e;
+}
+
+void FluidSimulation::setSleeping(bool b) {
+    if (!b) sleep.wakeAll();
+    sleeping = b;
+}
+
+void FluidSimulation::removeParticle(int slot) {
+    int last = particlePool->size() - 1;
+    sleep.retire(particlePool->getParticles(), slot, last);
+    particlePool->retire(slot);
+    if (flip) flip->retireParticle(slot, last);
+    fNavierStokes->retireMixed(slot, last);
+}
+
+void FluidSimulation::updateSources(double dt) {
+    if (emitters.empty() && drains.empty()) return;
+
+    // retiring moves the last particle into slot i, so i is only advanced when kept
+    int i = 0;
+    while (i < particlePool->size()) {
+        const Vec3& pos = particlePool->getParticles()[i]->pos;
+        bool drained = false;
+        for (const FluidDrain& drain : drains) {
+            drained = drained || drain.contains(pos);
+        }
+        if (drained) {
+            removeParticle(i);
+            numRetired++;
+        }
+        else {
+            i++;
+        }
+    }
+
+    for (FluidEmitter& emitter : emitters) {
+        emitPositions.clear();
+        emitter.step(dt, emitPositions);
+        for (const Vec3& pos : emitPositions) {
+            // a full pool just stops the inflow
+            if (!spawnParticle(pos, emitter.getVelocity())) break;
+            numSpawned++;
+        }
+    }
+
+    particlesChanged();
+}
+
+void FluidSimulation::particlesChanged() {
+    // copying the pointers reuses the capacity of the vectors, nothing is allocated
+    particles = particlePool->getParticles();
+    maxParticleRadius = setup.particleRadius;
+    for (const Particle* p : particles) {
+        maxParticleRadius = std::max(maxParticleRadius, p->radius);
+    }
+    fGravity->setInfluencedParticles(particles);
+    fNavierStokes->setInfluencedParticles(particles);
+
+    gridParticles = particles;
+    gridParticles.insert(gridParticles.end(), boundary.getSamples().begin(), boundary.getSamples().end());
+}
+
+void FluidSimulation::findNeighbors() {
+    // hash grid candidates are filtered down to the kernel support r_i + r_j. Boundary samples
+    // come after the fluid in gridParticles and end up in the fluid neighborhoods, they need
+    // no neighbors of their own. Settled particles keep their lists.
+    pool->parallelFor(particles.size(), [&](int begin, int end) {
+        std::vector<int> ids;
+        for (int i = begin; i < end; i++) {
+            if (sleeping && sleep.isSettled(i)) continue;
+            Particle* pi = particles[i];
+            int count = particleHashGrid->query(gridParticles, i, pi->radius + maxParticleRadius, ids);
+            pi->neighbors.clear();
+            for (int k = 0; k < count; k++) {
+                Particle* pj = gridParticles[ids[k]];
+                double support = pi->radius + pj->radius;
+                if ((pj->pos - pi->pos).squaredNorm() <= support*support) {
+                    pi->neighbors.insert(pj);
+                }
+            }
+        }
+    });
+}
+
+void FluidSimulation::updateForces() {
+    pool->parallelFor(particles.size(), [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            particles[i]->force = Vec3(0.0, 0.0, 0.0);
+        }
+    });
+    // apply forces
+    for (unsigned int i = 0; i < forces.size(); i++) {
+        forces[i]->apply();
+    }
+}
+
+void FluidSimulation::resolveCollisions() {
+    // corrections are computed from the current state and applied in a second sweep,
+    // this also keeps the fluid off the boundary samples
+    int n = particles.size();
+    bool mixed = fNavierStokes->keepsMixedState();
+    collisionDPos.resize(n);
+    collisionDVel.resize(n);
+    pool->parallelFor(n, [&](int begin, int end) {
+        std::vector<const Particle*> contacts;
+        for (int i = begin; i < end; i++) {
+            if (sleeping && sleep.isAsleep(i)) continue;
+            particleCollisionCorrection(particles[i], collisionDPos[i], collisionDVel[i], contacts);
+        }
+    });
+    pool->parallelFor(n, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            if (sleeping && sleep.isAsleep(i)) continue;
+            particles[i]->pos += collisionDPos[i];
+            particles[i]->vel += collisionDVel[i];
+            if (mixed) fNavierStokes->storeMixed(i, particles[i]);
+        }
+    });
+}
+
+void FluidSimulation::step(double dt) {
+    if (!particlePool) return;
+
+    Clock::time_point timer = Clock::now();
+
+    updateSources(dt);
+    phaseMs[PhaseSources] = lapMs(timer);
+
+    if (engine != EngineSPH) {
+        // the grid moves every particle
+        if (sleep.getNumSleeping() > 0) sleep.wakeAll();
+
+        // one grid cell holds about eight particles of the setup lattice
+        if (!flip) {
+            flip = new FlipFluid(pool);
+            flip->load(setup, 2.0 * setup.particleSpacing);
+        }
+        flip->setTransfer(engine == EngineAPIC ? FlipFluid::APIC : FlipFluid::FLIP);
+        flip->setGravity(fGravity->getAcceleration());
+
+        flip->transferToGrid(particles);
+        phaseMs[PhaseGrid] = lapMs(timer);
+        phaseMs[PhaseNeighbors] = 0;
+
+        flip->solve(dt);
+        phaseMs[PhaseForces] = lapMs(timer);
+
+        flip->transferToParticles(particles, dt);
+        fNavierStokes->invalidateMixedState();
+        phaseMs[PhaseIntegration] = lapMs(timer);
+        phaseMs[PhaseCollisions] = 0;
+        phaseMs[PhaseSleep] = 0;
+        phaseMs[PhaseAdapt] = 0;
+        stepCount++;
+        return;
+    }
+
+    particleHashGrid->create(gridParticles, pool);
+    phaseMs[PhaseGrid] = lapMs(timer);
+
+    findNeighbors();
+    phaseMs[PhaseNeighbors] = lapMs(timer);
+
+    fNavierStokes->setTimeStep(dt);
+    fNavierStokes->setSleeping(sleeping ? &sleep.getParticleAsleep() : nullptr);
+    updateForces();
+    phaseMs[PhaseForces] = lapMs(timer);
+
+    // the mixed precision state is written while the particle is still in cache
+    bool mixed = fNavierStokes->keepsMixedState();
+    bool skipAsleep = sleeping && sleep.getNumSleeping() > 0;
+    pool->parallelFor(particles.size(), [&](int begin, int end) {
+        if (!mixed && !skipAsleep) {
+            integrator.stepWithoutPS(particles, dt, begin, end);
+            return;
+        }
+        for (int i = begin; i < end; i++) {
+            if (skipAsleep && sleep.isAsleep(i)) continue;
+            integrator.stepWithoutPS(particles, dt, i, i + 1);
+            fNavierStokes->storeMixed(i, particles[i]);
+        }
+    });
+    phaseMs[PhaseIntegration] = lapMs(timer);
+
+    resolveCollisions();
+    phaseMs[PhaseCollisions] = lapMs(timer);
+
+    if (sleeping) sleep.update(particles, dt);
+    phaseMs[PhaseSleep] = lapMs(timer);
+
+    stepCount++;
+    if (adaptive && stepCount % adaptInterval == 0) {
+        // through removeParticle, which keeps the APIC state on the right slots
+        if (adaptivity->adapt(*particlePool, [this](int slot) { removeParticle(slot); })) {
+            // merges and splits move particles in place, the lists around them are stale
+            fNavierStokes->invalidateMixedState();
+            sleep.wakeAll();
+            particlesChanged();
+        }
+    }
+    phaseMs[PhaseAdapt] = lapMs(timer);
+}
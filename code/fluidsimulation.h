@@ -0,0 +1,178 @@
+#ifndef FLUIDSIMULATION_H
+#define FLUIDSIMULATION_H
+
+#include "fluidadaptivity.h"
+#include "fluidboundary.h"
+#include "fluidemitter.h"
+#include "fluidsleep.h"
+#include "forces.h"
+#include "integrators.h"
+#include "particlehashgrid.h"
+#include "particlepool.h"
+#include "threadpool.h"
+#include <functional>
+#include <vector>
+
+class FlipFluid;
+
+// box of particles on a lattice, nx * ny * nz of them starting at origin
+struct FluidBlock {
+    Vec3 origin;
+    int nx, ny, nz;
+    Vec3 vel;
+};
+
+/*
+ *  Initial state of a fluid simulation: particle size, tank, the blocks of fluid in it and
+ *  the sources and sinks. Plain data, so setups of any size can be built without Qt or GL.
+ */
+struct FluidSetup {
+    double particleRadius = 1;
+    double particleSpacing = 2;
+    double particleMass = 1;
+    Vec3 domainMin = Vec3(0, 0, 0);
+    Vec3 domainMax = Vec3(40, 40, 40);
+    int capacity = 0;               // pool size, 0 fits exactly the blocks
+    std::vector<FluidBlock> blocks;
+    std::vector<FluidEmitter> emitters;
+    std::vector<FluidDrain> drains;
+
+    long long numBlockParticles() const;
+    int poolCapacity() const;
+    // block particles in spawn order, f(position, velocity)
+    void forEachBlockParticle(const std::function<void(const Vec3&, const Vec3&)>& f) const;
+
+    // the layouts of the fluid scene, in a cubic tank of the given side
+    static FluidSetup doubleWall(double side, double radius);
+    static FluidSetup cube(double side, double radius);
+    static FluidSetup river(double side, double radius);
+
+    // column of about numParticles collapsing into a tank twice as wide, for benchmarks
+    static FluidSetup damBreak(long long numParticles, double radius);
+};
+
+
+/*
+ *  SPH fluid in a box: particle pool, boundary samples, neighbor grid, forces and the step
+ *  pipeline, without any rendering. SceneFluid draws one of these, and the headless
+ *  benchmark in bench/ runs them with millions of particles.
+ *
+ *  The same particles can also be stepped by a FLIP or APIC hybrid on a grid two particle
+ *  spacings wide. Its transfer to the grid is timed as the grid phase, gravity and the
+ *  pressure solve as forces, and the transfer back as integration.
+ *
+ *  With sleeping on, SPH particles that have come to rest drop out of the neighbor search,
+ *  force, integration and collision loops where they lie in the pool, see FluidSleep. The
+ *  hybrids and adaptivity wake everything.
+ */
+class FluidSimulation
+{
+public:
+    enum Phase { PhaseSources, PhaseGrid, PhaseNeighbors, PhaseForces, PhaseIntegration, PhaseCollisions, PhaseSleep, PhaseAdapt, NumPhases };
+    enum Engine { EngineSPH, EngineFLIP, EngineAPIC };
+
+    // runs on the shared pool if none is given
+    explicit FluidSimulation(ThreadPool* pool = nullptr);
+    ~FluidSimulation();
+
+    // builds tank, pool and forces for the setup and spawns its blocks
+    void load(const FluidSetup& setup);
+    // back to the initial state of the loaded setup
+    void reset();
+    // removes all fluid particles, emitters keep running
+    void clear();
+
+    void step(double dt);
+
+    // direct access to the fluid particles, particlesChanged has to be called after
+    // adding or removing them. Removing moves the last particle into the freed slot.
+    Particle* spawnParticle(const Vec3& pos, const Vec3& vel);
+    void removeParticle(int slot);
+    void particlesChanged();
+
+    ForceNavierStockes* getNavierStokes() { return fNavierStokes; }
+    const ForceNavierStockes* getNavierStokes() const { return fNavierStokes; }
+    const FluidAdaptivity* getAdaptivity() const { return adaptivity; }
+    const FlipFluid* getFlip() const { return flip; }
+    const FluidSetup& getSetup() const { return setup; }
+    ThreadPool* getThreadPool() { return pool; }
+
+    // the APIC state is dropped on a switch, it was not advected by the other engines
+    void setEngine(Engine e);
+    Engine getEngine() const { return engine; }
+
+    void setAdaptive(bool b) { adaptive = b; }
+    bool isAdaptive() const { return adaptive; }
+    void setAdaptInterval(int steps) { adaptInterval = steps; }
+
+    // turning it off wakes every particle
+    void setSleeping(bool b);
+    bool isSleeping() const { return sleeping; }
+    int getNumSleeping() const { return sleep.getNumSleeping(); }
+
+    const std::vector<Particle*>& getParticles() const { return particles; }
+    int getCapacity() const { return particlePool ? particlePool->capacity() : 0; }
+    // grows the pool and the neighbor grid to at least this many particles
+    void reserveParticles(int capacity);
+    int getNumBoundarySamples() const { return boundary.size(); }
+    unsigned long getNumSpawned() const { return numSpawned; }
+    unsigned long getNumRetired() const { return numRetired; }
+    double getPhaseMs(int phase) const { return phaseMs[phase]; }
+    static const char* phaseName(int phase);
+
+protected:
+    void destroy();
+    void spawnBlocks();
+    void updateSources(double dt);
+    void findNeighbors();
+    void updateForces();
+    void resolveCollisions();
+
+    FluidSetup setup;
+    ThreadPool* pool = nullptr;
+
+    // fluid particles live in the pool, particles holds the active ones
+    ParticlePool* particlePool = nullptr;
+    std::vector<Particle*> particles;
+    double maxParticleRadius = 1;
+
+    // tank walls, floor and ceiling
+    FluidBoundary boundary;
+
+    // fluid particles followed by the boundary samples, the neighbor grid is built on them
+    ParticleHashGrid* particleHashGrid = nullptr;
+    std::vector<Particle*> gridParticles;
+
+    ForceConstAcceleration* fGravity = nullptr;
+    ForceNavierStockes* fNavierStokes = nullptr;
+    std::vector<Force*> forces;
+    IntegratorSymplecticEuler integrator;
+
+    // Jacobi particle collision corrections
+    std::vector<Vec3> collisionDPos;
+    std::vector<Vec3> collisionDVel;
+
+    std::vector<FluidEmitter> emitters;
+    std::vector<FluidDrain> drains;
+    std::vector<Vec3> emitPositions;
+    unsigned long numSpawned = 0;
+    unsigned long numRetired = 0;
+
+    // hybrid engine, built on first use
+    Engine engine = EngineSPH;
+    FlipFluid* flip = nullptr;
+
+    // adaptive resolution, runs every few steps
+    FluidAdaptivity* adaptivity = nullptr;
+    bool adaptive = false;
+    int adaptInterval = 10;
+    int stepCount = 0;
+
+    // resting particles, by pool slot
+    FluidSleep sleep;
+    bool sleeping = false;
+
+    double phaseMs[NumPhases] = {0};
+};
+
+#endif // FLUIDSIMULATION_H
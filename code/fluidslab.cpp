@@ -0,0 +1,212 @@
+#include "fluidslab.h"
+#include <algorithm>
+#include <iostream>
+#include <limits>
+
+FluidSlabWorker::FluidSlabWorker(const FluidSetup& setup, const std::vector<double>& slabs,
+                                 FluidTransport* transport, ThreadPool* pool)
+    : transport(transport), simulation(pool)
+{
+    int rank = transport->getRank();
+    int size = transport->getSize();
+    const double inf = std::numeric_limits<double>::infinity();
+    xmin = rank > 0 ? slabs[rank] : -inf;
+    xmax = rank < size - 1 ? slabs[rank + 1] : inf;
+    halo = 3 * 2.0 * setup.particleRadius;
+    if (size > 1 && slabs[rank + 1] - slabs[rank] < halo) {
+        std::cerr << "slab " << rank << " is narrower than the halo" << std::endl;
+    }
+
+    // same tank, but the fluid is added here. The pool fits the particles of the slab and
+    // its halos with a quarter more for migration, unpack grows it if the fluid piles up.
+    long long share = 0;
+    setup.forEachBlockParticle([&](const Vec3& pos, const Vec3&) {
+        if (pos.x() >= xmin - halo && pos.x() < xmax + halo) share++;
+    });
+    FluidSetup local = setup;
+    local.blocks.clear();
+    local.emitters.clear();
+    local.drains.clear();
+    local.capacity = std::max(1, static_cast<int>(share + share / 4));
+    simulation.load(local);
+
+    numParticles = setup.numBlockParticles();
+    long long id = 0;
+    setup.forEachBlockParticle([&](const Vec3& pos, const Vec3& vel) {
+        if (pos.x() >= xmin && pos.x() < xmax && simulation.spawnParticle(pos, vel)) {
+            globalIds.push_back(id);
+        }
+        id++;
+    });
+    numOwned = globalIds.size();
+    simulation.particlesChanged();
+}
+
+std::vector<double> FluidSlabWorker::balancedSlabs(const FluidSetup& setup, int numSlabs) {
+    std::vector<double> xs;
+    xs.reserve(setup.numBlockParticles());
+    setup.forEachBlockParticle([&](const Vec3& pos, const Vec3&) {
+        xs.push_back(pos.x());
+    });
+
+    std::vector<double> slabs(numSlabs + 1);
+    slabs[0] = setup.domainMin.x();
+    slabs[numSlabs] = setup.domainMax.x();
+    for (int s = 1; s < numSlabs; s++) {
+        if (xs.empty()) {
+            slabs[s] = setup.domainMin.x() + (setup.domainMax.x() - setup.domainMin.x()) * s / numSlabs;
+            continue;
+        }
+        std::vector<double>::iterator q = xs.begin() + (xs.size() * s) / numSlabs;
+        std::nth_element(xs.begin(), q, xs.end());
+        slabs[s] = *q;
+    }
+    return slabs;
+}
+
+void FluidSlabWorker::neighborPeers() {
+    int rank = transport->getRank();
+    peers.clear();
+    if (rank > 0) peers.push_back(rank - 1);
+    if (rank < transport->getSize() - 1) peers.push_back(rank + 1);
+    sends.resize(peers.size());
+    for (std::vector<double>& buffer : sends) buffer.clear();
+}
+
+void FluidSlabWorker::pack(int slot, std::vector<double>& buffer) const {
+    const Particle* p = simulation.getParticles()[slot];
+    buffer.push_back(double(globalIds[slot]));
+    buffer.push_back(p->pos.x());
+    buffer.push_back(p->pos.y());
+    buffer.push_back(p->pos.z());
+    buffer.push_back(p->vel.x());
+    buffer.push_back(p->vel.y());
+    buffer.push_back(p->vel.z());
+    buffer.push_back(p->mass);
+    buffer.push_back(p->radius);
+}
+
+bool FluidSlabWorker::unpack(const std::vector<double>& buffer) {
+    int needed = static_cast<int>(globalIds.size() + buffer.size() / RecordSize);
+    if (needed > simulation.getCapacity()) {
+        simulation.reserveParticles(std::max(needed, simulation.getCapacity() * 3 / 2));
+    }
+    for (unsigned int r = 0; r + RecordSize <= buffer.size(); r += RecordSize) {
+        const double* rec = &buffer[r];
+        Particle* p = simulation.spawnParticle(Vec3(rec[1], rec[2], rec[3]), Vec3(rec[4], rec[5], rec[6]));
+        if (!p) {
+            std::cerr << "slab " << transport->getRank() << " is out of particles" << std::endl;
+            return false;
+        }
+        p->mass = rec[7];
+        p->radius = rec[8];
+        simulation.getNavierStokes()->storeMixed(p->id, p);
+        globalIds.push_back((long long)(rec[0]));
+    }
+    return true;
+}
+
+void FluidSlabWorker::remove(int slot) {
+    // same swap as the pool
+    simulation.removeParticle(slot);
+    globalIds[slot] = globalIds.back();
+    globalIds.pop_back();
+}
+
+bool FluidSlabWorker::exchangeGhosts() {
+    neighborPeers();
+    const std::vector<Particle*>& particles = simulation.getParticles();
+    for (unsigned int k = 0; k < peers.size(); k++) {
+        bool left = peers[k] < transport->getRank();
+        for (int i = 0; i < numOwned; i++) {
+            double x = particles[i]->pos.x();
+            if (left ? x < xmin + halo : x >= xmax - halo) {
+                pack(i, sends[k]);
+            }
+        }
+    }
+    if (!transport->exchange(peers, sends, recvs)) return false;
+
+    // ghosts go after the owned particles
+    for (const std::vector<double>& buffer : recvs) {
+        if (!unpack(buffer)) return false;
+    }
+    simulation.particlesChanged();
+    return true;
+}
+
+void FluidSlabWorker::dropGhosts() {
+    // the last slots, removing them does not move anything
+    for (int slot = int(globalIds.size()) - 1; slot >= numOwned; slot--) {
+        remove(slot);
+    }
+}
+
+bool FluidSlabWorker::migrate() {
+    neighborPeers();
+    const std::vector<Particle*>& particles = simulation.getParticles();
+
+    // everything is packed before removing, the particle list is only updated by
+    // particlesChanged
+    leaving.clear();
+    for (int i = numOwned - 1; i >= 0; i--) {
+        double x = particles[i]->pos.x();
+        if (x >= xmin && x < xmax) continue;
+
+        // one slab at most per step
+        int k = (x < xmin) ? 0 : int(peers.size()) - 1;
+        pack(i, sends[k]);
+        leaving.push_back(i);
+    }
+    // from the back, so the particle moved into a freed slot is never one that leaves
+    for (int slot : leaving) {
+        remove(slot);
+    }
+    if (!transport->exchange(peers, sends, recvs)) return false;
+
+    for (const std::vector<double>& buffer : recvs) {
+        if (!unpack(buffer)) return false;
+    }
+    numOwned = globalIds.size();
+    simulation.particlesChanged();
+    return true;
+}
+
+bool FluidSlabWorker::step(double dt) {
+    if (!exchangeGhosts()) return false;
+    simulation.step(dt);
+    dropGhosts();
+    return migrate();
+}
+
+bool FluidSlabWorker::gather(std::vector<Vec3>& positions, std::vector<Vec3>& velocities) {
+    int rank = transport->getRank();
+    peers.clear();
+    if (rank == 0) {
+        for (int r = 1; r < transport->getSize(); r++) peers.push_back(r);
+    }
+    else {
+        peers.push_back(0);
+    }
+    sends.assign(peers.size(), std::vector<double>());
+    if (rank != 0) {
+        for (int i = 0; i < numOwned; i++) pack(i, sends[0]);
+    }
+    if (!transport->exchange(peers, sends, recvs)) return false;
+    if (rank != 0) return true;
+
+    // own particles in the same format as the received ones
+    recvs.push_back(std::vector<double>());
+    for (int i = 0; i < numOwned; i++) pack(i, recvs.back());
+
+    positions.assign(numParticles, Vec3(0, 0, 0));
+    velocities.assign(numParticles, Vec3(0, 0, 0));
+    for (const std::vector<double>& buffer : recvs) {
+        for (unsigned int r = 0; r + RecordSize <= buffer.size(); r += RecordSize) {
+            long long id = (long long)(buffer[r]);
+            positions[id] = Vec3(buffer[r + 1], buffer[r + 2], buffer[r + 3]);
+            velocities[id] = Vec3(buffer[r + 4], buffer[r + 5], buffer[r + 6]);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,70 @@
+#ifndef FLUIDSLAB_H
+#define FLUIDSLAB_H
+
+#include "fluidsimulation.h"
+#include "fluidtransport.h"
+#include <vector>
+
+/*
+ *  One worker of a fluid run split into slabs along x. The worker owns the particles inside
+ *  its slab and steps them with its own FluidSimulation, the rest of the fluid is only seen
+ *  through ghost copies of the particles near the slab faces.
+ *
+ *  Each step sends the owned particles within the halo to the neighbor slabs, steps owned
+ *  and ghost particles together, drops the ghosts and hands particles that left the slab to
+ *  their new owner. The halo is three kernel supports wide: owned particles need correct
+ *  forces, their collisions need correct forces on the ghosts within one support, and
+ *  those need correct densities one support further out. So a step gives the same result
+ *  as the undivided simulation, up to the order of the neighbor sums.
+ *
+ *  Particles keep the global id of their place in the setup blocks. Emitters, drains and
+ *  adaptive resolution are not supported, and slabs have to be wider than the halo.
+ */
+class FluidSlabWorker
+{
+public:
+    // slab r covers [slabs[r], slabs[r+1]), the outer faces extend to infinity
+    FluidSlabWorker(const FluidSetup& setup, const std::vector<double>& slabs,
+                    FluidTransport* transport, ThreadPool* pool = nullptr);
+
+    // slab faces with about the same number of block particles in every slab
+    static std::vector<double> balancedSlabs(const FluidSetup& setup, int numSlabs);
+
+    // false if the transport failed
+    bool step(double dt);
+
+    // all ranks take part, rank 0 gets the state of every particle indexed by global id
+    bool gather(std::vector<Vec3>& positions, std::vector<Vec3>& velocities);
+
+    FluidSimulation& getSimulation() { return simulation; }
+    int getNumOwned() const { return numOwned; }
+    double getHalo() const { return halo; }
+
+protected:
+    static const int RecordSize = 9;   // id, position, velocity, mass, radius
+
+    bool exchangeGhosts();
+    bool migrate();
+    void dropGhosts();
+    void pack(int slot, std::vector<double>& buffer) const;
+    bool unpack(const std::vector<double>& buffer);
+    void remove(int slot);
+    void neighborPeers();
+
+    FluidTransport* transport;
+    FluidSimulation simulation;
+    long long numParticles;
+    double xmin, xmax;      // owned range
+    double halo;
+
+    std::vector<long long> globalIds;    // by pool slot, owned particles first
+    int numOwned = 0;
+
+    // per round
+    std::vector<int> peers;
+    std::vector<std::vector<double>> sends;
+    std::vector<std::vector<double>> recvs;
+    std::vector<int> leaving;
+};
+
+#endif // FLUIDSLAB_H
@@ -0,0 +1,144 @@
+#include "fluidsleep.h"
+#include <cmath>
+
+FluidSleep::FluidSleep(ThreadPool* threadPool)
+    : pool(threadPool ? threadPool : &ThreadPool::shared())
+{
+}
+
+void FluidSleep::resize(int capacity)
+{
+    asleep.resize(capacity, 0);
+    settled.resize(capacity, 0);
+    anchor.resize(capacity, Vec3(0, 0, 0));
+    quietTime.resize(capacity, -1);
+    restDensity.resize(capacity, 0);
+    moving.resize(capacity, 0);
+    compressed.resize(capacity, 0);
+    bordering.resize(capacity, 0);
+    falling.resize(capacity, 0);
+}
+
+void FluidSleep::wake(int i)
+{
+    if (asleep[i]) numSleeping--;
+    asleep[i] = 0;
+    settled[i] = 0;
+    quietTime[i] = -1;
+}
+
+double FluidSleep::densityShape(const Particle* p)
+{
+    // poly6 without its normalisation, over the support r_i + r_j of the neighbor search
+    double density = 0;
+    for (const Particle* pj : p->neighbors) {
+        double h = p->radius + pj->radius;
+        double q = 1.0 - (pj->pos - p->pos).squaredNorm()/(h*h);
+        if (q > 0) density += pj->mass*q*q*q;
+    }
+    return density;
+}
+
+bool FluidSleep::update(const std::vector<Particle*>& particles, double dt)
+{
+    const int n = int(particles.size());
+    if (n > int(asleep.size())) resize(n);
+
+    // awake particles against their anchors. The sleeping ones that were searched again
+    // this step check their density, and whether they only have sleeping particles around.
+    pool->parallelFor(n, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            const Particle* p = particles[i];
+            if (asleep[i]) {
+                compressed[i] = false;
+                if (!settled[i]) {
+                    double density = densityShape(p);
+                    compressed[i] = std::abs(density - restDensity[i]) > densityTolerance*restDensity[i];
+                }
+                bool quiet = true;
+                for (const Particle* pj : p->neighbors) {
+                    if (!pj->isFixed && !asleep[pj->id]) { quiet = false; break; }
+                }
+                settled[i] = quiet;
+                continue;
+            }
+            moving[i] = quietTime[i] >= 0 && (p->pos - anchor[i]).squaredNorm() > restDistance*restDistance;
+            if (quietTime[i] < 0 || moving[i]) {
+                anchor[i] = p->pos;
+                quietTime[i] = 0;
+            }
+            else {
+                quietTime[i] += dt;
+            }
+            bordering[i] = false;
+            for (const Particle* pj : p->neighbors) {
+                if (!pj->isFixed && asleep[pj->id]) { bordering[i] = true; break; }
+            }
+        }
+    });
+
+    // an awake particle may have come into the support of a sleeping one without being in
+    // its list, so the awake side tells. Only the particles on the border walk their lists.
+    toWake.clear();
+    if (numSleeping > 0) {
+        for (int i = 0; i < n; i++) {
+            if (asleep[i] && compressed[i]) toWake.push_back(i);
+            if (asleep[i] || !bordering[i]) continue;
+            for (const Particle* pj : particles[i]->neighbors) {
+                if (pj->isFixed || !asleep[pj->id]) continue;
+                settled[pj->id] = false;
+                if (moving[i]) toWake.push_back(pj->id);
+            }
+        }
+    }
+
+    // resting particles fall asleep when nothing around them moves
+    pool->parallelFor(n, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            falling[i] = false;
+            if (asleep[i] || quietTime[i] < sleepTime) continue;
+            bool quiet = true;
+            for (const Particle* pj : particles[i]->neighbors) {
+                if (!pj->isFixed && !asleep[pj->id] && moving[pj->id]) { quiet = false; break; }
+            }
+            falling[i] = quiet;
+        }
+    });
+
+    bool changed = !toWake.empty();
+    for (int i : toWake) wake(i);
+    for (int i = 0; i < n; i++) {
+        if (!falling[i]) continue;
+        restDensity[i] = densityShape(particles[i]);
+        asleep[i] = 1;
+        settled[i] = 0;
+        numSleeping++;
+        changed = true;
+    }
+    return changed;
+}
+
+void FluidSleep::wakeAll()
+{
+    for (unsigned int i = 0; i < asleep.size(); i++) wake(i);
+    numSleeping = 0;
+}
+
+void FluidSleep::retire(const std::vector<Particle*>& particles, int slot, int last)
+{
+    // the lists of the particles around it may still hold the retired one, they are
+    // searched again
+    for (const Particle* pj : particles[slot]->neighbors) {
+        if (!pj->isFixed) wake(pj->id);
+    }
+    wake(slot);
+
+    asleep[slot] = asleep[last];
+    settled[slot] = settled[last];
+    anchor[slot] = anchor[last];
+    quietTime[slot] = quietTime[last];
+    restDensity[slot] = restDensity[last];
+    asleep[last] = 0;
+    settled[last] = 0;
+    quietTime[last] = -1;
+}
@@ -0,0 +1,77 @@
+#ifndef FLUIDSLEEP_H
+#define FLUIDSLEEP_H
+
+#include "particle.h"
+#include "threadpool.h"
+#include <vector>
+
+/*
+ *  Puts the SPH fluid to sleep where it has come to rest. The flags are kept per pool slot,
+ *  so the particles are never reordered. Fluid at rest still jitters, so resting is measured
+ *  on the position: a particle that stays within the rest distance of where it settled for
+ *  the sleep time, with no moving fluid around it, falls asleep. The simulation leaves it out
+ *  of the force, integration and collision loops, and its awake neighbours go on reading its
+ *  density, pressure and velocity. The velocity is the jitter it rested with, stopped
+ *  sleepers would damp the awake fluid through the collisions and the surface would rise.
+ *
+ *  A sleeping particle wakes when an awake neighbour moves away from where it settled, when
+ *  the fluid around it has moved enough to change its density, or when a particle next to it
+ *  is removed. Once it and all of its neighbours are asleep it is settled: nothing in its
+ *  support moves, so its neighbour list stays exact and is not searched again until an awake
+ *  particle comes near.
+ */
+class FluidSleep
+{
+public:
+    // runs on the shared pool if none is given
+    explicit FluidSleep(ThreadPool* pool = nullptr);
+
+    // slots of a pool this large, new slots are awake
+    void resize(int capacity);
+    void setRestDistance(double d) { restDistance = d; }
+    // relative density change that wakes a sleeping particle
+    void setDensityTolerance(double tol) { densityTolerance = tol; }
+    // long enough for a particle starting from rest to fall further than the rest distance
+    void setSleepTime(double t) { sleepTime = t; }
+
+    // measures the particles after a step, on the neighbourhoods the step used, sends the
+    // resting ones to sleep and wakes the ones next to moving ones. Returns whether any
+    // particle changed state.
+    bool update(const std::vector<Particle*>& particles, double dt);
+    void wakeAll();
+    // before the particle in slot is retired: its neighbours wake and the state of the last
+    // slot moves into it
+    void retire(const std::vector<Particle*>& particles, int slot, int last);
+
+    bool isAsleep(int i) const { return asleep[i] != 0; }
+    bool isSettled(int i) const { return settled[i] != 0; }
+    int getNumSleeping() const { return numSleeping; }
+    // indexed by pool slot
+    const std::vector<char>& getParticleAsleep() const { return asleep; }
+
+protected:
+    void wake(int i);
+    // smoothed density up to the kernel constant, only compared with itself
+    static double densityShape(const Particle* p);
+
+    ThreadPool* pool;
+    double restDistance = 0.25;
+    double sleepTime = 0.5;
+    double densityTolerance = 0.02;
+
+    std::vector<char> asleep;
+    std::vector<char> settled;
+    std::vector<Vec3> anchor;           // where the particle settled, unset after a wake
+    std::vector<double> quietTime;      // time within the rest distance of the anchor
+    std::vector<double> restDensity;    // densityShape when it fell asleep
+    int numSleeping = 0;
+
+    // per step, of the awake particles
+    std::vector<char> moving;           // left its anchor
+    std::vector<char> compressed;       // asleep, its density changed
+    std::vector<char> bordering;        // has sleeping neighbours
+    std::vector<char> falling;          // falls asleep after this step
+    std::vector<int> toWake;
+};
+
+#endif // FLUIDSLEEP_H
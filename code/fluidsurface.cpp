@@ -0,0 +1,244 @@
+#include "fluidsurface.h"
+#include <chrono>
+#include <cmath>
+
+namespace {
+    // cube corner c is at offset (c&1, (c>>1)&1, (c>>2)&1), the six tetrahedra share the 0-7 diagonal
+    // so the faces of neighboring cells are split the same way
+    const int cubeTets[6][4] = {
+        {0, 1, 3, 7}, {0, 3, 2, 7}, {0, 2, 6, 7},
+        {0, 6, 4, 7}, {0, 4, 5, 7}, {0, 5, 1, 7}
+    };
+
+    const int keyBits = 21;
+    const int keyOffset = 1 << (keyBits - 1);
+}
+
+FluidSurface::FluidSurface() {
+    worker = std::thread(&FluidSurface::workerLoop, this);
+}
+
+FluidSurface::~FluidSurface() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cvWork.notify_all();
+    worker.join();
+}
+
+double FluidSurface::getLastExtractionMs() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return lastExtractionMs;
+}
+
+bool FluidSurface::requestUpdate(const std::vector<Particle*>& particles) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (busy) return false;
+
+        // the worker is idle, so it is safe to fill its input
+        workPoints.resize(particles.size());
+        for (unsigned int i = 0; i < particles.size(); i++) {
+            workPoints[i] = particles[i]->pos;
+        }
+        workIsField = false;
+        workOrigin = Vec3(0, 0, 0);
+        workCellSize = cellSize;
+        busy = true;
+    }
+    cvWork.notify_one();
+    return true;
+}
+
+bool FluidSurface::requestUpdate(const std::vector<double>& field, int nx, int ny, int nz, const Vec3& origin, double h) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (busy) return false;
+
+        // the only copy of the field, the simulation keeps writing its own
+        workField.assign(field.begin(), field.end());
+        fieldDims[0] = nx;
+        fieldDims[1] = ny;
+        fieldDims[2] = nz;
+        workIsField = true;
+        workOrigin = origin;
+        workCellSize = h;
+        busy = true;
+    }
+    cvWork.notify_one();
+    return true;
+}
+
+bool FluidSurface::takeMesh(std::vector<float>& vertices) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!meshReady) return false;
+    // the caller's old buffer is reused by the next extraction
+    vertices.swap(readyVertices);
+    meshReady = false;
+    return true;
+}
+
+void FluidSurface::workerLoop() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cvWork.wait(lock, [&] { return stopping || busy; });
+            if (stopping) return;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        extract(workPoints, workVertices);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        readyVertices.swap(workVertices);
+        meshReady = true;
+        busy = false;
+        lastExtractionMs = ms;
+    }
+}
+
+FluidSurface::NodeKey FluidSurface::nodeKey(int i, int j, int k) {
+    return (NodeKey(i + keyOffset) << (2*keyBits)) | (NodeKey(j + keyOffset) << keyBits) | NodeKey(k + keyOffset);
+}
+
+float FluidSurface::nodeValue(int i, int j, int k) const {
+    NodeMap::const_iterator it = nodes.find(nodeKey(i, j, k));
+    return it == nodes.end() ? 0.0f : it->second;
+}
+
+float FluidSurface::value(int i, int j, int k) const {
+    if (!workIsField) return nodeValue(i, j, k);
+    if (i < 0 || j < 0 || k < 0 || i >= fieldDims[0] || j >= fieldDims[1] || k >= fieldDims[2]) return 0.0f;
+    return workField[i + fieldDims[0] * (j + fieldDims[1] * k)];
+}
+
+Vec3 FluidSurface::gradient(int i, int j, int k) const {
+    double s = 0.5 / workCellSize;
+    return Vec3(s * (value(i+1, j, k) - value(i-1, j, k)),
+                s * (value(i, j+1, k) - value(i, j-1, k)),
+                s * (value(i, j, k+1) - value(i, j, k-1)));
+}
+
+void FluidSurface::splat(const std::vector<Vec3>& points) {
+    nodes.clear();
+    double r2 = radius * radius;
+    int reach = static_cast<int>(std::ceil(radius / workCellSize));
+
+    for (const Vec3& p : points) {
+        int ci = static_cast<int>(std::floor(p.x() / workCellSize));
+        int cj = static_cast<int>(std::floor(p.y() / workCellSize));
+        int ck = static_cast<int>(std::floor(p.z() / workCellSize));
+        for (int i = ci - reach; i <= ci + reach + 1; i++) {
+            for (int j = cj - reach; j <= cj + reach + 1; j++) {
+                for (int k = ck - reach; k <= ck + reach + 1; k++) {
+                    double d2 = (Vec3(i, j, k) * workCellSize - p).squaredNorm();
+                    // zero nodes are kept too, the cells around the surface need all their corners
+                    float& value = nodes[nodeKey(i, j, k)];
+                    if (d2 < r2) {
+                        double t = 1.0 - d2 / r2;
+                        value += float(t * t * t);
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+void FluidSurface::polygonizeTetrahedron(const Vec3 pos[4], const float val[4], const Vec3 grad[4],
+                                         std::vector<float>& vertices) const {
+    int inside[4], outside[4];
+    int numIn = 0, numOut = 0;
+    for (int v = 0; v < 4; v++) {
+        if (val[v] >= isoLevel) inside[numIn++] = v;
+        else                    outside[numOut++] = v;
+    }
+    if (numIn == 0 || numOut == 0) return;
+
+    auto addVertex = [&](int a, int b) {
+        float t = float((isoLevel - val[a]) / (val[b] - val[a]));
+        Vec3 p = pos[a] + t * (pos[b] - pos[a]);
+        // the field grows inwards, so the outward normal is minus the gradient
+        Vec3 n = -(grad[a] + t * (grad[b] - grad[a]));
+        double len = n.norm();
+        if (len > 0) n /= len;
+        vertices.push_back(float(p.x()));
+        vertices.push_back(float(p.y()));
+        vertices.push_back(float(p.z()));
+        vertices.push_back(float(n.x()));
+        vertices.push_back(float(n.y()));
+        vertices.push_back(float(n.z()));
+    };
+
+    if (numIn == 1 || numOut == 1) {
+        // one corner is cut off by a single triangle
+        int apex = (numIn == 1) ? inside[0] : outside[0];
+        const int* others = (numIn == 1) ? outside : inside;
+        addVertex(apex, others[0]);
+        addVertex(apex, others[1]);
+        addVertex(apex, others[2]);
+    }
+    else {
+        // two against two, the cut is a quad
+        int a = inside[0], b = inside[1], c = outside[0], d = outside[1];
+        addVertex(a, c);
+        addVertex(a, d);
+        addVertex(b, d);
+        addVertex(a, c);
+        addVertex(b, d);
+        addVertex(b, c);
+    }
+}
+
+void FluidSurface::polygonizeCell(int i, int j, int k, std::vector<float>& vertices) const {
+    Vec3 pos[8], grad[8], tetPos[4], tetGrad[4];
+    float val[8], tetVal[4];
+
+    int numIn = 0;
+    for (int c = 0; c < 8; c++) {
+        val[c] = value(i + (c & 1), j + ((c >> 1) & 1), k + ((c >> 2) & 1));
+        if (val[c] >= isoLevel) numIn++;
+    }
+    if (numIn == 0 || numIn == 8) return;
+
+    for (int c = 0; c < 8; c++) {
+        int ni = i + (c & 1), nj = j + ((c >> 1) & 1), nk = k + ((c >> 2) & 1);
+        pos[c] = workOrigin + Vec3(ni, nj, nk) * workCellSize;
+        grad[c] = gradient(ni, nj, nk);
+    }
+    for (int t = 0; t < 6; t++) {
+        for (int v = 0; v < 4; v++) {
+            tetPos[v] = pos[cubeTets[t][v]];
+            tetVal[v] = val[cubeTets[t][v]];
+            tetGrad[v] = grad[cubeTets[t][v]];
+        }
+        polygonizeTetrahedron(tetPos, tetVal, tetGrad, vertices);
+    }
+}
+
+void FluidSurface::extract(const std::vector<Vec3>& points, std::vector<float>& vertices) {
+    vertices.clear();
+    if (workIsField) {
+        // the cells start one before the field, the zero ring closes the surface at its border
+        for (int k = -1; k < fieldDims[2]; k++) {
+            for (int j = -1; j < fieldDims[1]; j++) {
+                for (int i = -1; i < fieldDims[0]; i++) {
+                    polygonizeCell(i, j, k, vertices);
+                }
+            }
+        }
+        return;
+    }
+
+    splat(points);
+    for (NodeMap::const_iterator it = nodes.begin(); it != nodes.end(); it++) {
+        // every node is the lower corner of one cell
+        NodeKey key = it->first;
+        int i = int((key >> (2*keyBits)) & ((1 << keyBits) - 1)) - keyOffset;
+        int j = int((key >> keyBits) & ((1 << keyBits) - 1)) - keyOffset;
+        int k = int(key & ((1 << keyBits) - 1)) - keyOffset;
+        polygonizeCell(i, j, k, vertices);
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef FLUIDSURFACE_H
+#define FLUIDSURFACE_H
+
+#include "particle.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/*
+ *  Triangle surface of a particle fluid, extracted on a worker thread so the simulation
+ *  never waits for it. requestUpdate copies the particle positions and wakes the worker if
+ *  it is idle; the finished mesh is picked up later with takeMesh.
+ *
+ *  Particles are splatted onto a sparse grid (only nodes near particles exist) and the
+ *  iso-surface is extracted with marching tetrahedra, six per grid cell, which needs no case
+ *  tables and has no ambiguous configurations. Normals come from the field gradient.
+ *  Grid based fluids pass their dense scalar field instead, the extraction reads it in place
+ *  and needs no nodes at all.
+ */
+class FluidSurface
+{
+public:
+    FluidSurface();
+    ~FluidSurface();
+
+    void setCellSize(double h) { cellSize = h; }
+    void setRadius(double r) { radius = r; }          // splatting radius
+    void setIsoLevel(double iso) { isoLevel = iso; }  // a lone particle gives w = 1 at its center
+
+    // returns false, without copying anything, while the previous extraction is running
+    bool requestUpdate(const std::vector<Particle*>& particles);
+    // dense field of nx*ny*nz values, x fastest, value (i,j,k) sits at origin + (i,j,k)*h
+    bool requestUpdate(const std::vector<double>& field, int nx, int ny, int nz, const Vec3& origin, double h);
+
+    // swaps the newest mesh into vertices (x y z nx ny nz per vertex, 3 vertices per triangle),
+    // returns false if nothing new was extracted since the last call
+    bool takeMesh(std::vector<float>& vertices);
+
+    double getLastExtractionMs() const;
+
+protected:
+    typedef long long NodeKey;
+    typedef std::unordered_map<NodeKey, float> NodeMap;
+
+    void workerLoop();
+    void extract(const std::vector<Vec3>& points, std::vector<float>& vertices);
+    void splat(const std::vector<Vec3>& points);
+    void polygonizeCell(int i, int j, int k, std::vector<float>& vertices) const;
+    void polygonizeTetrahedron(const Vec3 pos[4], const float val[4], const Vec3 grad[4],
+                               std::vector<float>& vertices) const;
+
+    static NodeKey nodeKey(int i, int j, int k);
+    float nodeValue(int i, int j, int k) const;
+    // from the dense field or the nodes, zero outside of both
+    float value(int i, int j, int k) const;
+    Vec3 gradient(int i, int j, int k) const;
+
+    double cellSize = 0.5;
+    double radius = 2.0;
+    double isoLevel = 0.4;
+
+    // worker side, nodes are at workOrigin + (i,j,k)*workCellSize
+    NodeMap nodes;
+    std::vector<Vec3> workPoints;
+    std::vector<float> workField;
+    bool workIsField = false;
+    int fieldDims[3] = {0, 0, 0};
+    Vec3 workOrigin = Vec3(0, 0, 0);
+    double workCellSize = 0.5;
+    std::vector<float> workVertices;
+
+    std::thread worker;
+    mutable std::mutex mutex;
+    std::condition_variable cvWork;
+    bool stopping = false;
+    bool busy = false;
+    bool meshReady = false;
+    std::vector<float> readyVertices;
+    double lastExtractionMs = 0;
+};
+
+#endif // FLUIDSURFACE_H
@@ -0,0 +1,184 @@
+#include "fluidtransport.h"
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#endif
+
+FluidLocalHub::FluidLocalHub(int size) : size(size), mailboxes(size * size) {
+}
+
+void FluidLocalHub::post(int from, int to, const std::vector<double>& message) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        mailboxes[from * size + to].push_back(message);
+    }
+    cvPosted.notify_all();
+}
+
+void FluidLocalHub::take(int from, int to, std::vector<double>& message) {
+    std::unique_lock<std::mutex> lock(mutex);
+    std::deque<std::vector<double>>& box = mailboxes[from * size + to];
+    cvPosted.wait(lock, [&]{ return !box.empty(); });
+    message.swap(box.front());
+    box.pop_front();
+}
+
+bool FluidLocalTransport::exchange(const std::vector<int>& peers,
+                                   const std::vector<std::vector<double>>& sends,
+                                   std::vector<std::vector<double>>& recvs) {
+    // mailboxes are unbounded, so posting everything first cannot block
+    for (unsigned int k = 0; k < peers.size(); k++) {
+        hub->post(rank, peers[k], sends[k]);
+    }
+    recvs.resize(peers.size());
+    for (unsigned int k = 0; k < peers.size(); k++) {
+        hub->take(peers[k], rank, recvs[k]);
+    }
+    return true;
+}
+
+
+#ifndef _WIN32
+std::vector<std::vector<int>> FluidSocketTransport::createSocketMesh(int size) {
+    std::vector<std::vector<int>> mesh(size, std::vector<int>(size, -1));
+    for (int a = 0; a < size; a++) {
+        for (int b = a + 1; b < size; b++) {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+                std::cerr << "socketpair failed: " << strerror(errno) << std::endl;
+                continue;
+            }
+            mesh[a][b] = fds[0];
+            mesh[b][a] = fds[1];
+        }
+    }
+    return mesh;
+}
+
+FluidSocketTransport::FluidSocketTransport(int rank, const std::vector<std::vector<int>>& mesh)
+    : rank(rank), sockets(mesh.size(), -1)
+{
+    for (unsigned int a = 0; a < mesh.size(); a++) {
+        for (unsigned int b = 0; b < mesh.size(); b++) {
+            int fd = mesh[a][b];
+            if (fd < 0) continue;
+            if (int(a) == rank) {
+                // non-blocking, exchange interleaves sending and receiving on all peers
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                sockets[b] = fd;
+            }
+            else {
+                close(fd);
+            }
+        }
+    }
+}
+
+FluidSocketTransport::~FluidSocketTransport() {
+    for (int fd : sockets) {
+        if (fd >= 0) close(fd);
+    }
+}
+
+bool FluidSocketTransport::exchange(const std::vector<int>& peers,
+                                    const std::vector<std::vector<double>>& sends,
+                                    std::vector<std::vector<double>>& recvs) {
+    // every message is its size in doubles followed by the doubles
+    struct Channel {
+        int fd;
+        std::uint64_t sendHeader, recvHeader;
+        size_t sent = 0, received = 0;
+        bool headerDone = false;
+    };
+    const size_t headerBytes = sizeof(std::uint64_t);
+
+    int numPeers = peers.size();
+    std::vector<Channel> channels(numPeers);
+    recvs.assign(numPeers, std::vector<double>());
+    for (int k = 0; k < numPeers; k++) {
+        channels[k].fd = sockets[peers[k]];
+        channels[k].sendHeader = sends[k].size();
+    }
+
+    std::vector<pollfd> fds(numPeers);
+    while (true) {
+        int pending = 0;
+        for (int k = 0; k < numPeers; k++) {
+            const Channel& c = channels[k];
+            size_t sendTotal = headerBytes + sizeof(double) * sends[k].size();
+            size_t recvTotal = headerBytes + sizeof(double) * (c.headerDone ? c.recvHeader : 0);
+            fds[k].fd = c.fd;
+            fds[k].events = 0;
+            fds[k].revents = 0;
+            if (c.sent < sendTotal) fds[k].events |= POLLOUT;
+            if (!c.headerDone || c.received < recvTotal) fds[k].events |= POLLIN;
+            if (fds[k].events) pending++;
+        }
+        if (pending == 0) break;
+
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "poll failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+
+        for (int k = 0; k < numPeers; k++) {
+            Channel& c = channels[k];
+            if (fds[k].revents & (POLLERR | POLLNVAL)) return false;
+
+            if (fds[k].revents & POLLOUT) {
+                // header first, then the payload
+                const char* data;
+                size_t left;
+                if (c.sent < headerBytes) {
+                    data = reinterpret_cast<const char*>(&c.sendHeader) + c.sent;
+                    left = headerBytes - c.sent;
+                }
+                else {
+                    size_t offset = c.sent - headerBytes;
+                    data = reinterpret_cast<const char*>(sends[k].data()) + offset;
+                    left = sizeof(double) * sends[k].size() - offset;
+                }
+                ssize_t n = send(c.fd, data, left, MSG_NOSIGNAL);
+                if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) return false;
+                if (n > 0) c.sent += n;
+            }
+
+            if ((fds[k].events & POLLIN) && (fds[k].revents & (POLLIN | POLLHUP))) {
+                char* data;
+                size_t left;
+                if (!c.headerDone) {
+                    data = reinterpret_cast<char*>(&c.recvHeader) + c.received;
+                    left = headerBytes - c.received;
+                }
+                else {
+                    size_t offset = c.received - headerBytes;
+                    data = reinterpret_cast<char*>(recvs[k].data()) + offset;
+                    left = sizeof(double) * recvs[k].size() - offset;
+                }
+                ssize_t n = recv(c.fd, data, left, 0);
+                if (n == 0) return false;   // peer closed
+                if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) return false;
+                if (n > 0) {
+                    c.received += n;
+                    if (!c.headerDone && c.received == headerBytes) {
+                        c.headerDone = true;
+                        recvs[k].resize(c.recvHeader);
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+#endif
@@ -0,0 +1,92 @@
+#ifndef FLUIDTRANSPORT_H
+#define FLUIDTRANSPORT_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+/*
+ *  Message passing between the workers of a decomposed fluid run. A worker only talks in
+ *  rounds: exchange sends one message to each of the given peers and returns one message
+ *  from each of them, so every peer has to call exchange with this rank in the same round.
+ *  Messages are plain arrays of doubles, empty messages are fine.
+ *
+ *  FluidLocalTransport connects threads of one process, FluidSocketTransport connects
+ *  processes over Unix sockets. Anything that moves buffers between ranks, like a network
+ *  connection to another node, can implement the same interface.
+ */
+class FluidTransport
+{
+public:
+    virtual ~FluidTransport() {}
+
+    virtual int getRank() const = 0;
+    virtual int getSize() const = 0;
+
+    // false if a peer went away
+    virtual bool exchange(const std::vector<int>& peers,
+                          const std::vector<std::vector<double>>& sends,
+                          std::vector<std::vector<double>>& recvs) = 0;
+};
+
+
+// mailboxes shared by the local transports, one queue per ordered pair of ranks
+class FluidLocalHub
+{
+public:
+    explicit FluidLocalHub(int size);
+
+    int getSize() const { return size; }
+    void post(int from, int to, const std::vector<double>& message);
+    void take(int from, int to, std::vector<double>& message);
+
+protected:
+    int size;
+    std::mutex mutex;
+    std::condition_variable cvPosted;
+    std::vector<std::deque<std::vector<double>>> mailboxes;   // from * size + to
+};
+
+class FluidLocalTransport : public FluidTransport
+{
+public:
+    FluidLocalTransport(FluidLocalHub* hub, int rank) : hub(hub), rank(rank) {}
+
+    virtual int getRank() const { return rank; }
+    virtual int getSize() const { return hub->getSize(); }
+    virtual bool exchange(const std::vector<int>& peers,
+                          const std::vector<std::vector<double>>& sends,
+                          std::vector<std::vector<double>>& recvs);
+
+protected:
+    FluidLocalHub* hub;
+    int rank;
+};
+
+
+#ifndef _WIN32
+class FluidSocketTransport : public FluidTransport
+{
+public:
+    // socket pairs between every two ranks, mesh[a][b] is the end a uses to talk to b.
+    // It has to be created before forking the workers.
+    static std::vector<std::vector<int>> createSocketMesh(int size);
+
+    // keeps the sockets of rank and closes all the others of the mesh
+    FluidSocketTransport(int rank, const std::vector<std::vector<int>>& mesh);
+    virtual ~FluidSocketTransport();
+
+    virtual int getRank() const { return rank; }
+    virtual int getSize() const { return static_cast<int>(sockets.size()); }
+    virtual bool exchange(const std::vector<int>& peers,
+                          const std::vector<std::vector<double>>& sends,
+                          std::vector<std::vector<double>>& recvs);
+
+protected:
+    int rank;
+    std::vector<int> sockets;   // by peer rank, -1 for this rank
+};
+#endif
+
+#endif // FLUIDTRANSPORT_H
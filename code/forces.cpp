@@ -1,7 +1,32 @@
 #include "forces.h"
+#include "threadpool.h"
 #include <cmath>
 #include <float.h>
 #include <iostream>
+#include <mutex>
+
+namespace {
+    // plain double sum
+    struct DoubleSum {
+        double sum = 0;
+        void add(double x) { sum += x; }
+        double value() const { return sum; }
+    };
+
+    // Kahan compensated float sum, keeps the error independent of the number of terms.
+    // Breaks with -ffast-math, which is free to drop the compensation.
+    struct KahanSum {
+        float sum = 0;
+        float c = 0;
+        void add(float x) {
+            float y = x - c;
+            float t = sum + y;
+            c = (t - sum) - y;
+            sum = t;
+        }
+        double value() const { return sum; }
+    };
+}
 
 void ForceConstAcceleration::apply() {
     for (Particle* p : particles) {
@@ -23,8 +48,10 @@ void ForceGravitationalAttraction::apply(){
 }
 
 void ForceSpring::apply(){
-    Particle* p0 = particles[0];
-    Particle* p1 = particles[1];
+    if (broken) return;
+
+    Particle* p0 = ends[0];
+    Particle* p1 = ends[1];
 
     Vec3 posDiff = p1->pos - p0->pos;
 
@@ -34,19 +61,11 @@ void ForceSpring::apply(){
     p1->force += -springForce;
 }
 
-double smoothingKernelPoly6(double r, double h){ // r = distance from current particle to neighbor
-    if(r >= 0 && h >= r){
-        return 315 / (64 * M_PI * pow(h,9)) * pow(h*h - r*r, 3);
-    }
-    return 0;
-}
-
 double ForceNavierStockes::densityCalculation(Particle *p){
     double density = 0;
 
     for(Particle* neighbor : p->neighbors){
-        double substraction = (neighbor->pos - p->pos).norm();
-        density += neighbor->mass * smoothingKernelPoly6(substraction, this->h);
+        density += neighbor->mass * kernels(p, neighbor).density.value((neighbor->pos - p->pos).squaredNorm());
     }
     return density;
 }
@@ -55,40 +74,468 @@ double ForceNavierStockes::pressureCalculation(double density){
     return GAS_CONST * (density - REST_DENS);
 }
 
+void ForceNavierStockes::forEachRange(int n, const std::function<void(int, int)>& f){
+    if (pool) pool->parallelFor(n, f);
+    else      f(0, n);
+}
+
+void ForceNavierStockes::densityPressureCalculation(){
+    // computed once per particle and step, the force pass only reads them
+    forEachRange(particles.size(), [&](int begin, int end){
+        for (int i = begin; i < end; i++){
+            if (isAsleep(i)) continue;
+            Particle* p = particles[i];
+            p->density = densityCalculation(p);
+            p->pressure = pressureCalculation(p->density);
+        }
+    });
+}
+
 void ForceNavierStockes::accelerationCalculation(){
-    double gradient = particles.at(0)->mass * 45.0f / (M_PI * pow(h, 6.f));
-    double laplacian = VISC * particles.at(0)->mass * 40.f / (M_PI * pow(h, 5.f));
-
-    for (Particle* pi : particles){
-        Vec3 pressure = Vec3(0,0,0);
-        Vec3 visc = Vec3(0,0,0);
-        double densityPi = densityCalculation(pi);
-        double pressurePi = this->pressureCalculation(densityPi)/(densityPi * densityPi);
-
-        for (Particle* pj : pi->neighbors){
-            double densityPj = densityCalculation(pj);
-            double pressurePj = this->pressureCalculation(densityPj)/(densityPj * densityPj);
-
-            Vec3 distance = pj->pos - pi->pos;
-            pressure += distance.normalized()  * gradient * pow(h - distance.norm(), 2.0f)  * (pressurePi + pressurePj);
-            visc += (pj->vel - pi->vel) / densityPj * laplacian * (h - distance.norm());
+    forEachRange(particles.size(), [&](int begin, int end){
+        for (int k = begin; k < end; k++){
+            if (isAsleep(k)) continue;
+            Particle* pi = particles[k];
+            Vec3 pressure = Vec3(0,0,0);
+            Vec3 visc = Vec3(0,0,0);
+            double pressurePi = pi->pressure/(pi->density * pi->density);
+
+            for (Particle* pj : pi->neighbors){
+                // boundary samples mirror the pressure of pi, Akinci et al. 2012
+                double pressurePj = pj->isFixed ? 0.0 : pj->pressure/(pj->density * pj->density);
+
+                Vec3 rij = pi->pos - pj->pos;
+                double r = rij.norm();
+                const KernelSet& W = kernels(pi, pj);
+                pressure += pj->mass * (pressurePi + pressurePj) * W.pressure.gradient(rij, r);
+                visc += (VISC * pj->mass / pj->density * W.viscosity.laplacian(r)) * (pj->vel - pi->vel);
+            }
+            Vec3 force = Vec3(0,0,0);
+            for(int i = 0; i < 3; i++){
+                if(pressure[i] < 5.0f && pressure[i] > -5.0f){
+                    force[i] += pressure[i];
+                }
+                if(visc[i] < 5.0f && visc[i] > -5.0f){
+                    force[i] += visc[i];
+                }
+            }
+            pi->force += force;
         }
-        Vec3 force = Vec3(0,0,0);
-        for(int i = 0; i < 3; i++){
-            if(pressure[i] < 5.0f && pressure[i] > -5.0f){
-                force[i] += pressure[i];
+    });
+}
+
+void ForceNavierStockes::viscosityCalculation(){
+    forEachRange(particles.size(), [&](int begin, int end){
+        for (int i = begin; i < end; i++){
+            if (isAsleep(i)) continue;
+            Particle* pi = particles[i];
+            Vec3 visc = Vec3(0,0,0);
+            for (Particle* pj : pi->neighbors){
+                double r = (pi->pos - pj->pos).norm();
+                visc += (VISC * pj->mass / pj->density * kernels(pi, pj).viscosity.laplacian(r)) * (pj->vel - pi->vel);
             }
-            if(visc[i] < 5.0f && visc[i] > -5.0f){
-                force[i] += visc[i];
+            pi->force += visc;
+        }
+    });
+}
+
+void ForceNavierStockes::pcisphCalculation(){
+    int n = static_cast<int>(particles.size());
+    double dt = timeStep;
+    double rho0 = REST_DENS;
+
+    // scratch arrays are indexed by particle id, boundary samples never move
+    auto predictedPos = [&](const Particle* p) -> const Vec3& {
+        return p->isFixed ? p->pos : predPos[p->id];
+    };
+    predPos.resize(n);
+    predVel.resize(n);
+    pressureForce.resize(n);
+    predDensity.resize(n);
+    pressureScale.resize(n);
+
+    // pressure stiffness, delta in Solenthaler and Pajarola 2009, once per kernel level from a
+    // prototype particle with a filled neighborhood. The actual neighborhoods thin out at the
+    // free surface, where their delta would blow up. Particles squeezed closer than the
+    // prototype, as on impact against the boundary, keep their own smaller delta.
+    std::vector<double> levelScale(levelRadii.size(), -1.0);
+    for (int i = 0; i < n; i++){
+        double& scale = levelScale[levelOf(particles[i])];
+        if (scale < 0) scale = prototypeStiffness(particles[i], dt);
+    }
+    forEachRange(n, [&](int begin, int end){
+        for (int i = begin; i < end; i++){
+            Particle* pi = particles[i];
+            pressureForce[i] = Vec3(0,0,0);
+            if (isAsleep(i)){
+                // stays where it is with the pressure it fell asleep with
+                predPos[i] = pi->pos;
+                predDensity[i] = pi->density;
+                continue;
+            }
+            Vec3 sumGrad = Vec3(0,0,0);
+            double sumGrad2 = 0;
+            for (Particle* pj : pi->neighbors){
+                Vec3 rij = pi->pos - pj->pos;
+                Vec3 grad = kernels(pi, pj).pressure.gradient(rij, rij.norm());
+                sumGrad += grad;
+                sumGrad2 += grad.squaredNorm();
             }
+            double beta = 2.0 * (dt * pi->mass / rho0) * (dt * pi->mass / rho0);
+            double denom = beta * (sumGrad.squaredNorm() + sumGrad2);
+            double scale = levelScale[levelOf(pi)];
+            pressureScale[i] = denom * scale > 1.0 ? 1.0 / denom : scale;
+            pi->pressure = 0;
         }
-        pi->force += force;
+    });
+
+    lastIterations = 0;
+    lastDensityError = 0;
+    std::mutex errorMutex;
+    while (lastIterations < maxIterations){
+        // predict positions with the current pressure guess
+        forEachRange(n, [&](int begin, int end){
+            for (int i = begin; i < end; i++){
+                if (isAsleep(i)) continue;
+                Particle* pi = particles[i];
+                predVel[i] = pi->vel + dt * (pi->force + pressureForce[i]) / pi->mass;
+                predPos[i] = pi->pos + dt * predVel[i];
+            }
+        });
+
+        // predicted density, only compression is corrected
+        double maxError = 0;
+        forEachRange(n, [&](int begin, int end){
+            double rangeError = 0;
+            for (int i = begin; i < end; i++){
+                if (isAsleep(i)) continue;
+                Particle* pi = particles[i];
+                double density = 0;
+                for (Particle* pj : pi->neighbors){
+                    density += pj->mass * kernels(pi, pj).density.value((predPos[i] - predictedPos(pj)).squaredNorm());
+                }
+                predDensity[i] = density;
+                double error = std::max(density - rho0, 0.0);
+                pi->pressure += pressureScale[i] * error;
+                rangeError = std::max(rangeError, error);
+            }
+            std::lock_guard<std::mutex> lock(errorMutex);
+            maxError = std::max(maxError, rangeError);
+        });
+
+        // pressure forces at the predicted positions
+        forEachRange(n, [&](int begin, int end){
+            for (int i = begin; i < end; i++){
+                if (isAsleep(i)) continue;
+                Particle* pi = particles[i];
+                if (predDensity[i] <= 0) continue;
+                double pressurePi = pi->pressure / (predDensity[i] * predDensity[i]);
+                Vec3 force = Vec3(0,0,0);
+                for (Particle* pj : pi->neighbors){
+                    double pressurePj = 0;
+                    if (!pj->isFixed){
+                        int j = pj->id;
+                        if (predDensity[j] <= 0) continue;
+                        pressurePj = pj->pressure / (predDensity[j] * predDensity[j]);
+                    }
+                    Vec3 rij = predPos[i] - predictedPos(pj);
+                    force -= pj->mass * (pressurePi + pressurePj) * kernels(pi, pj).pressure.gradient(rij, rij.norm());
+                }
+                pressureForce[i] = pi->mass * force;
+            }
+        });
+
+        lastIterations++;
+        lastDensityError = maxError / rho0;
+        if (lastIterations >= minIterations && lastDensityError < densityTolerance) break;
     }
+
+    forEachRange(n, [&](int begin, int end){
+        for (int i = begin; i < end; i++){
+            particles[i]->force += pressureForce[i];
+        }
+    });
 }
 
-void ForceNavierStockes::apply(){
-    this->accelerationCalculation();
+double ForceNavierStockes::prototypeStiffness(const Particle* p, double dt) const {
+    // neighbors of the same level on a cubic lattice, spaced so that the summed density is
+    // the rest density
+    double rho0 = REST_DENS;
+    double support = 2.0 * p->radius;
+    const KernelSet& k = kernels(p, p);
+    auto latticeDensity = [&](double spacing){
+        int range = int(std::ceil(support / spacing));
+        double density = 0;
+        for (int x = -range; x <= range; x++)
+            for (int y = -range; y <= range; y++)
+                for (int z = -range; z <= range; z++)
+                    density += p->mass * k.density.value(spacing * spacing * (x*x + y*y + z*z));
+        return density;
+    };
+    double lo = 0.25 * support, hi = support;
+    for (int it = 0; it < 40; it++){
+        double mid = 0.5 * (lo + hi);
+        if (latticeDensity(mid) > rho0) lo = mid;
+        else hi = mid;
+    }
+    double spacing = 0.5 * (lo + hi);
+    int range = int(std::ceil(support / spacing));
+    Vec3 sumGrad = Vec3(0,0,0);
+    double sumGrad2 = 0;
+    for (int x = -range; x <= range; x++){
+        for (int y = -range; y <= range; y++){
+            for (int z = -range; z <= range; z++){
+                Vec3 rij = -spacing * Vec3(x, y, z);
+                double r = rij.norm();
+                if (r <= 0 || r >= support) continue;
+                Vec3 grad = k.pressure.gradient(rij, r);
+                sumGrad += grad;
+                sumGrad2 += grad.squaredNorm();
+            }
+        }
+    }
+    double beta = 2.0 * (dt * p->mass / rho0) * (dt * p->mass / rho0);
+    double denom = beta * (sumGrad.squaredNorm() + sumGrad2);
+    return denom > 1e-12 ? 1.0 / denom : 0.0;
+}
+
+void ForceNavierStockes::updateKernelLevels(){
+    int n = static_cast<int>(particles.size());
+    particleLevel.resize(n);
+    unsigned int numLevels = levelRadii.size();
+    for (int i = 0; i < n; i++){
+        // per step scratch data is indexed by id
+        particles[i]->id = i;
+
+        double r = particles[i]->radius;
+        unsigned int level = 0;
+        while (level < levelRadii.size() && std::abs(levelRadii[level] - r) > 1e-9 * r) level++;
+        if (level == levelRadii.size()) levelRadii.push_back(r);
+        particleLevel[i] = level;
+    }
+    for (unsigned int k = 0; k < boundaryParticles.size(); k++){
+        boundaryParticles[k]->id = k;
+    }
+
+    if (levelRadii.size() != numLevels){
+        pairKernels.clear();
+        pairKernelsF.clear();
+        for (double ri : levelRadii){
+            for (double rj : levelRadii){
+                pairKernels.push_back(KernelSet(ri + rj));
+                pairKernelsF.push_back(KernelSetF(float(ri + rj)));
+            }
+        }
+    }
 }
 
+void ForceNavierStockes::gatherMixedState(){
+    int nb = static_cast<int>(boundaryParticles.size());
+    int total = nb + static_cast<int>(particles.size());
+    mixed.px.resize(total);
+    mixed.py.resize(total);
+    mixed.pz.resize(total);
+    mixed.vx.resize(total);
+    mixed.vy.resize(total);
+    mixed.vz.resize(total);
+    mixed.mass.resize(total);
+    mixed.density.resize(total);
+    mixed.pressureTerm.resize(total);
+    mixed.level.resize(total);
 
+    forEachRange(total, [&](int begin, int end){
+        for (int i = begin; i < end; i++){
+            const Particle* p = i < nb ? boundaryParticles[i] : particles[i - nb];
+            mixed.px[i] = float(p->pos.x());
+            mixed.py[i] = float(p->pos.y());
+            mixed.pz[i] = float(p->pos.z());
+            mixed.vx[i] = float(p->vel.x());
+            mixed.vy[i] = float(p->vel.y());
+            mixed.vz[i] = float(p->vel.z());
+            mixed.mass[i] = float(p->mass);
+            // boundary samples keep the rest density and do not push back
+            mixed.density[i] = float(p->density);
+            mixed.pressureTerm[i] = 0;
+            mixed.level[i] = 0;
+        }
+    });
+    mixedValid = true;
+}
 
+void ForceNavierStockes::storeMixed(int i, const Particle* p){
+    if (!mixedValid) return;
+    int f = static_cast<int>(boundaryParticles.size()) + i;
+    if (f == static_cast<int>(mixed.px.size())){
+        // spawned at the end of the pool
+        mixed.px.push_back(0); mixed.py.push_back(0); mixed.pz.push_back(0);
+        mixed.vx.push_back(0); mixed.vy.push_back(0); mixed.vz.push_back(0);
+        mixed.mass.push_back(0);
+        mixed.density.push_back(float(p->density));
+        mixed.pressureTerm.push_back(0);
+        mixed.level.push_back(0);
+    }
+    else if (f > static_cast<int>(mixed.px.size())){
+        mixedValid = false;
+        return;
+    }
+    mixed.px[f] = float(p->pos.x());
+    mixed.py[f] = float(p->pos.y());
+    mixed.pz[f] = float(p->pos.z());
+    mixed.vx[f] = float(p->vel.x());
+    mixed.vy[f] = float(p->vel.y());
+    mixed.vz[f] = float(p->vel.z());
+    mixed.mass[f] = float(p->mass);
+}
+
+void ForceNavierStockes::retireMixed(int slot, int last){
+    if (!mixedValid) return;
+    int nb = static_cast<int>(boundaryParticles.size());
+    int s = nb + slot, l = nb + last;
+    if (l != static_cast<int>(mixed.px.size()) - 1){
+        mixedValid = false;
+        return;
+    }
+    mixed.px[s] = mixed.px[l]; mixed.py[s] = mixed.py[l]; mixed.pz[s] = mixed.pz[l];
+    mixed.vx[s] = mixed.vx[l]; mixed.vy[s] = mixed.vy[l]; mixed.vz[s] = mixed.vz[l];
+    mixed.mass[s] = mixed.mass[l];
+    mixed.density[s] = mixed.density[l];
+    mixed.px.pop_back(); mixed.py.pop_back(); mixed.pz.pop_back();
+    mixed.vx.pop_back(); mixed.vy.pop_back(); mixed.vz.pop_back();
+    mixed.mass.pop_back();
+    mixed.density.pop_back();
+    mixed.pressureTerm.pop_back();
+    mixed.level.pop_back();
+}
+
+void ForceNavierStockes::gatherMixedNeighbors(){
+    int n = static_cast<int>(particles.size());
+    int nb = static_cast<int>(boundaryParticles.size());
+    for (int i = 0; i < n; i++){
+        mixed.level[nb + i] = particleLevel[i];
+    }
+
+    // neighborhoods to index lists, the sets are walked once per step
+    mixed.neighborStart.resize(n + 1);
+    mixed.neighborStart[0] = 0;
+    for (int i = 0; i < n; i++){
+        int count = isAsleep(i) ? 0 : particles[i]->neighbors.size();
+        mixed.neighborStart[i + 1] = mixed.neighborStart[i] + count;
+    }
+    mixed.neighborIds.resize(mixed.neighborStart[n]);
+    forEachRange(n, [&](int begin, int end){
+        for (int i = begin; i < end; i++){
+            if (isAsleep(i)) continue;
+            int* ids = &mixed.neighborIds[mixed.neighborStart[i]];
+            for (const Particle* pj : particles[i]->neighbors){
+                *ids++ = pj->isFixed ? pj->id : nb + pj->id;
+            }
+        }
+    });
+}
+
+template<typename Sum>
+void ForceNavierStockes::mixedDensityPressure(){
+    const MixedState& s = mixed;
+    unsigned int numLevels = levelRadii.size();
+    const int nb = static_cast<int>(boundaryParticles.size());
+    forEachRange(particles.size(), [&](int begin, int end){
+        for (int i = begin; i < end; i++){
+            const int f = nb + i;
+            if (isAsleep(i)){
+                // a gather clears the pressure term, it is taken again from the particle
+                const Particle* p = particles[i];
+                mixed.density[f] = float(p->density);
+                mixed.pressureTerm[f] = float(p->pressure / (p->density * p->density));
+                continue;
+            }
+            float xi = s.px[f], yi = s.py[f], zi = s.pz[f];
+            const KernelSetF* W = &pairKernelsF[s.level[f] * numLevels];
+            Sum density;
+            for (int k = s.neighborStart[i]; k < s.neighborStart[i + 1]; k++){
+                int j = s.neighborIds[k];
+                float dx = s.px[j] - xi, dy = s.py[j] - yi, dz = s.pz[j] - zi;
+                density.add(s.mass[j] * W[s.level[j]].density.value(dx*dx + dy*dy + dz*dz));
+            }
+            Particle* p = particles[i];
+            p->density = density.value();
+            p->pressure = pressureCalculation(p->density);
+            mixed.density[f] = float(p->density);
+            mixed.pressureTerm[f] = float(p->pressure / (p->density * p->density));
+        }
+    });
+}
+
+template<typename Sum>
+void ForceNavierStockes::mixedAcceleration(){
+    const MixedState& s = mixed;
+    unsigned int numLevels = levelRadii.size();
+    const float visc = VISC;
+    const int nb = static_cast<int>(boundaryParticles.size());
+    forEachRange(particles.size(), [&](int begin, int end){
+        for (int i = begin; i < end; i++){
+            if (isAsleep(i)) continue;
+            const int f = nb + i;
+            float xi = s.px[f], yi = s.py[f], zi = s.pz[f];
+            float vxi = s.vx[f], vyi = s.vy[f], vzi = s.vz[f];
+            float pressurePi = s.pressureTerm[f];
+            const KernelSetF* W = &pairKernelsF[s.level[f] * numLevels];
+            Sum pressure[3], viscosity[3];
+            for (int k = s.neighborStart[i]; k < s.neighborStart[i + 1]; k++){
+                int j = s.neighborIds[k];
+                Eigen::Vector3f rij(xi - s.px[j], yi - s.py[j], zi - s.pz[j]);
+                float r = rij.norm();
+                const KernelSetF& Wij = W[s.level[j]];
+                Eigen::Vector3f grad = (s.mass[j] * (pressurePi + s.pressureTerm[j])) * Wij.pressure.gradient(rij, r);
+                float lap = visc * s.mass[j] / s.density[j] * Wij.viscosity.laplacian(r);
+                pressure[0].add(grad.x());
+                pressure[1].add(grad.y());
+                pressure[2].add(grad.z());
+                viscosity[0].add(lap * (s.vx[j] - vxi));
+                viscosity[1].add(lap * (s.vy[j] - vyi));
+                viscosity[2].add(lap * (s.vz[j] - vzi));
+            }
+            // same clamping as accelerationCalculation
+            Vec3 force = Vec3(0,0,0);
+            for (int c = 0; c < 3; c++){
+                double pc = pressure[c].value();
+                double vc = viscosity[c].value();
+                if (pc < 5.0f && pc > -5.0f){
+                    force[c] += pc;
+                }
+                if (vc < 5.0f && vc > -5.0f){
+                    force[c] += vc;
+                }
+            }
+            particles[i]->force += force;
+        }
+    });
+}
+
+void ForceNavierStockes::apply(){
+    if (particles.empty()) return;
+    this->updateKernelLevels();
+    if (solver == WCSPH && precision != Double){
+        size_t total = boundaryParticles.size() + particles.size();
+        if (!mixedValid || mixed.px.size() != total) this->gatherMixedState();
+        this->gatherMixedNeighbors();
+        if (precision == MixedKahan){
+            this->mixedDensityPressure<KahanSum>();
+            this->mixedAcceleration<KahanSum>();
+        }
+        else {
+            this->mixedDensityPressure<DoubleSum>();
+            this->mixedAcceleration<DoubleSum>();
+        }
+        return;
+    }
+    // the double path does not keep the float state up to date
+    mixedValid = false;
+    this->densityPressureCalculation();
+    if (solver == PCISPH){
+        this->viscosityCalculation();
+        this->pcisphCalculation();
+    }
+    else {
+        this->accelerationCalculation();
+    }
+}
@@ -1,8 +1,12 @@
 #ifndef FORCES_H
 #define FORCES_H
 
+#include <functional>
 #include <vector>
 #include "particle.h"
+#include "sphkernels.h"
+
+class ThreadPool;
 
 class Force
 {
@@ -83,37 +87,167 @@ protected:
     double blackHoleMass;
 };
 
+// The two ends are kept in the spring itself rather than in the influenced particles list,
+// so building the millions of springs of a large cloth does not allocate per spring.
 class ForceSpring : public Force
 {
 public:
-    ForceSpring() { ks = 0; kd = 0; }
-    ForceSpring(double ks, double kd) {this->ks = ks; this->kd = kd;}
+    ForceSpring(Particle* p0, Particle* p1, double ks, double kd) : ks(ks), kd(kd) { ends[0] = p0; ends[1] = p1; }
 
     virtual void apply();
 
+    Particle* getParticle0() const { return ends[0]; }
+    Particle* getParticle1() const { return ends[1]; }
+
     void updateKs(double newKs) { this->ks = newKs; }
     void updateKd(double newKd) { this->kd = newKd; }
     void setL(double l) { this->l = l; }
     double getL(){ return this->l; }
 
+    // a broken spring stays in its lists but no longer pulls
+    void breakSpring() { broken = true; }
+    bool isBroken() const { return broken; }
+
 protected:
+    Particle* ends[2];
     double l;
     double ks;
     double kd;
+    bool broken = false;
 };
 
 class ForceNavierStockes: public Force {
 public:
+    // WCSPH: weakly compressible equation of state
+    // PCISPH: predictive-corrective incompressible SPH, iterates pressure until the density error is below tolerance
+    enum Solver { WCSPH, PCISPH };
+
+    // Double: everything on the particles in double precision
+    // Mixed: float copies of the state in SoA arrays, sums accumulated in double
+    // MixedKahan: the same with Kahan compensated float sums
+    // The mixed modes cover the WCSPH solver, PCISPH always runs in double.
+    enum Precision { Double, Mixed, MixedKahan };
+
     double h;
-    ForceNavierStockes(double h){this->h = h;};
+    ForceNavierStockes(double h) : h(h) {
+        levelRadii.push_back(0.5*h);
+        pairKernels.push_back(KernelSet(h));
+        pairKernelsF.push_back(KernelSetF(h));
+    };
 
+    // PCISPH integrates the other forces when predicting positions, so this force has to be applied last
     virtual void apply();
 
+    // per-particle loops run on the pool if set
+    void setThreadPool(ThreadPool* p) { pool = p; }
+    void setSolver(Solver s) { if (s != solver) mixedValid = false; solver = s; }
+    Solver getSolver() const { return solver; }
+    void setTimeStep(double dt) { timeStep = dt; }
+    void setDensityTolerance(double tol) { densityTolerance = tol; }
+    void setMaxIterations(int n) { maxIterations = n; }
+    void setPrecision(Precision p) { if (p != precision) mixedValid = false; precision = p; }
+    Precision getPrecision() const { return precision; }
+
+    // The mixed modes keep positions, velocities and densities in float arrays across steps,
+    // they are only gathered from the particles when switching to them or after invalidate.
+    // The owner of the particles stores every position and velocity it changes, including
+    // spawned particles at the end, and mirrors the retire swaps.
+    bool keepsMixedState() const { return mixedValid; }
+    void storeMixed(int i, const Particle* p);
+    void retireMixed(int slot, int last);
+    void invalidateMixedState() { mixedValid = false; }
+
+    // fixed particles that show up in the neighborhoods, the mixed precision path keeps
+    // float copies of them next to the fluid
+    void setBoundaryParticles(const std::vector<Particle*>& samples) { boundaryParticles = samples; mixedValid = false; }
+    int getLastIterations() const { return lastIterations; }
+    double getLastDensityError() const { return lastDensityError; }
+
+    // flags by particle id, or nullptr when all are awake. Sleeping particles keep the density
+    // and pressure they fell asleep with and only act on their neighbours.
+    void setSleeping(const std::vector<char>* asleep) { sleeping = asleep; }
+
+    double getRestDensity() const { return REST_DENS; }
+
 protected:
     double densityCalculation(Particle *p);
     double pressureCalculation(double density);
 
+    void densityPressureCalculation();
     void accelerationCalculation();
+    void viscosityCalculation();
+    void pcisphCalculation();
+    // PCISPH pressure per density error for a particle like p with a full neighborhood
+    double prototypeStiffness(const Particle* p, double dt) const;
+    void gatherMixedState();
+    void gatherMixedNeighbors();
+    template<typename Sum> void mixedDensityPressure();
+    template<typename Sum> void mixedAcceleration();
+    void forEachRange(int n, const std::function<void(int, int)>& f);
+
+    struct KernelSet {
+        explicit KernelSet(double h) : density(h), pressure(h), viscosity(h) {}
+        SPHDensityKernel density;
+        SPHPressureKernel pressure;
+        SPHViscosityKernel viscosity;
+    };
+    struct KernelSetF {
+        explicit KernelSetF(float h) : density(h), pressure(h), viscosity(h) {}
+        SPHDensityKernelF density;
+        SPHPressureKernelF pressure;
+        SPHViscosityKernelF viscosity;
+    };
+
+    // Particles may have different radii (adaptive resolution), a pair uses the support
+    // h_ij = r_i + r_j, which is h for two particles of radius h/2. Radii are expected to
+    // come in a few discrete levels, there is one kernel set per pair of levels.
+    // Boundary samples always have radius h/2.
+    // Boundary samples are numbered too, their id is their index in boundaryParticles.
+    void updateKernelLevels();
+    int levelOf(const Particle* p) const { return p->isFixed ? 0 : particleLevel[p->id]; }
+    bool isAsleep(int i) const { return sleeping && (*sleeping)[i]; }
+    const KernelSet& kernels(const Particle* pi, const Particle* pj) const {
+        return pairKernels[levelOf(pi) * levelRadii.size() + levelOf(pj)];
+    }
+
+    ThreadPool* pool = nullptr;
+    Solver solver = WCSPH;
+    Precision precision = Double;
+    std::vector<Particle*> boundaryParticles;
+    const std::vector<char>* sleeping = nullptr;
+    double timeStep = 0.01;
+    double densityTolerance = 0.01;
+    int maxIterations = 50;
+    int minIterations = 3;
+    int lastIterations = 0;
+    double lastDensityError = 0;
+
+    // PCISPH scratch, indexed by particle id
+    std::vector<Vec3> predPos;
+    std::vector<Vec3> predVel;
+    std::vector<Vec3> pressureForce;
+    std::vector<double> predDensity;
+    std::vector<double> pressureScale;
+
+    std::vector<double> levelRadii;      // levelRadii[0] = h/2
+    std::vector<KernelSet> pairKernels;  // levels x levels
+    std::vector<int> particleLevel;      // indexed by particle id
+    std::vector<KernelSetF> pairKernelsF;
+
+    // mixed precision state, the boundary samples by id followed by the fluid particles by id,
+    // so spawned particles append, and the neighborhoods as index lists into it (CSR)
+    struct MixedState {
+        std::vector<float> px, py, pz;
+        std::vector<float> vx, vy, vz;
+        std::vector<float> mass;
+        std::vector<float> density;
+        std::vector<float> pressureTerm;      // p / rho^2, zero for the boundary
+        std::vector<unsigned char> level;
+        std::vector<int> neighborStart;
+        std::vector<int> neighborIds;
+    };
+    MixedState mixed;
+    bool mixedValid = false;
 
     float REST_DENS = 0.32f;
     float GAS_CONST = 1.0f;
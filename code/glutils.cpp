@@ -1,6 +1,7 @@
 #include "glutils.h"
 #include <QOpenGLBuffer>
 #include <QOpenGLVertexArrayObject>
+#include <algorithm>
 #include "model.h"
 
 
@@ -103,3 +104,60 @@ QOpenGLVertexArrayObject* glutils::createVAO(QOpenGLShaderProgram* program, Mode
 
     return vao;
 }
+
+
+glutils::DynamicBuffer::DynamicBuffer(int vertexBytes, int maxVertices, int numRegions)
+    : buffer(QOpenGLBuffer::Type::VertexBuffer), fences(numRegions, nullptr),
+      vertexBytes(vertexBytes), maxVertices(maxVertices)
+{
+    glFuncs = QOpenGLContext::currentContext()->versionFunctions<QOpenGLFunctions_3_3_Core>();
+    buffer.create();
+    buffer.bind();
+    buffer.setUsagePattern(QOpenGLBuffer::UsagePattern::StreamDraw);
+    buffer.allocate(numRegions*maxVertices*vertexBytes);
+    buffer.release();
+}
+
+glutils::DynamicBuffer::~DynamicBuffer()
+{
+    for (GLsync f : fences) {
+        if (f) glFuncs->glDeleteSync(f);
+    }
+    buffer.destroy();
+}
+
+void* glutils::DynamicBuffer::map(int n)
+{
+    buffer.bind();
+    if (n > maxVertices) {
+        // orphaning the storage lets the GPU finish with the old one, the fences go with it
+        for (GLsync& f : fences) {
+            if (f) glFuncs->glDeleteSync(f);
+            f = nullptr;
+        }
+        maxVertices = n + n/2;
+        buffer.allocate(int(fences.size())*maxVertices*vertexBytes);
+    }
+
+    region = (region + 1) % int(fences.size());
+    if (fences[region]) {
+        // the GPU is a full ring behind, wait for it in 1 s slices
+        while (glFuncs->glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+        glFuncs->glDeleteSync(fences[region]);
+        fences[region] = nullptr;
+    }
+    return buffer.mapRange(region*maxVertices*vertexBytes, std::max(n, 1)*vertexBytes,
+                           QOpenGLBuffer::RangeWrite | QOpenGLBuffer::RangeInvalidate | QOpenGLBuffer::RangeUnsynchronized);
+}
+
+void glutils::DynamicBuffer::unmap()
+{
+    buffer.unmap();
+    buffer.release();
+}
+
+void glutils::DynamicBuffer::fence()
+{
+    if (fences[region]) glFuncs->glDeleteSync(fences[region]);
+    fences[region] = glFuncs->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -1,10 +1,13 @@
 #ifndef GLUTILS_H
 #define GLUTILS_H
 
+#include <QOpenGLBuffer>
 #include <QOpenGLFunctions>
+#include <QOpenGLFunctions_3_3_Core>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLVertexArrayObject>
 #include <iostream>
+#include <vector>
 
 class Model;
 
@@ -17,6 +20,44 @@ namespace glutils {
                                             const QString& fsPath, QObject* parent=nullptr);
 
     QOpenGLVertexArrayObject* createVAO(QOpenGLShaderProgram* program, Model* model, QObject* parent=nullptr);
+
+    /*
+     *  Vertex buffer for data rewritten every frame. The buffer is split in a ring of regions,
+     *  each upload maps the next one unsynchronized and writes straight into it, so the driver
+     *  never waits for the GPU to finish the previous frame or copies a client array. A fence
+     *  placed after the draws reading a region is waited on before that region is reused,
+     *  which only blocks if the GPU is a whole ring behind.
+     *
+     *  Attribute pointers are set once at offset 0, draws pass getFirstVertex() as the first
+     *  vertex of glDrawArrays or the base vertex of glDrawElementsBaseVertex. Needs a current
+     *  GL 3.3 context, like the rest of the rendering.
+     */
+    class DynamicBuffer
+    {
+    public:
+        // regions should cover the uploads of a couple of frames
+        DynamicBuffer(int vertexBytes, int maxVertices, int numRegions = 3);
+        ~DynamicBuffer();
+
+        // binds the buffer, to set the attribute pointers in a VAO
+        void bind() { buffer.bind(); }
+
+        // next region for n vertices, grows the buffer if they do not fit
+        void* map(int n);
+        void unmap();
+        // after the draws that read the last mapped region
+        void fence();
+
+        int getFirstVertex() const { return region*maxVertices; }
+
+    protected:
+        QOpenGLFunctions_3_3_Core* glFuncs = nullptr;
+        QOpenGLBuffer buffer;
+        std::vector<GLsync> fences;
+        int vertexBytes;
+        int maxVertices;
+        int region = 0;
+    };
 }
 
 #endif // GLUTILS_H
@@ -66,10 +66,11 @@ void GLWidget::paintTextOverlay()
     QPen penLineGrey(QColor(50, 50, 50));
     QPen penLineWhite(QColor(250, 250, 250));
 
+    const QStringList sceneStats = scene->getStats();
     const int bX = 10;
     const int bY = 10;
     const int sizeX = 170;
-    const int sizeY = 110;
+    const int sizeY = 110 + 20*sceneStats.size();
 
     // Background
     painter.setPen(penLineGrey);
@@ -89,6 +90,9 @@ void GLWidget::paintTextOverlay()
     painter.drawText(10 + 5, bY + 10 +  50, "Sim time:  " + QString::number(simTime, 'f', 3) + " s");
     painter.drawText(10 + 5, bY + 10 +  70, "Curr perf: " + QString::number(simPerf, 'f', 1) + " ms/step");
     painter.drawText(10 + 5, bY + 10 +  90, "Avg perf:  " + QString::number(simMs/double(simSteps), 'f', 1) + " ms/step");
+    for (int i = 0; i < sceneStats.size(); i++) {
+        painter.drawText(10 + 5, bY + 10 + 110 + 20*i, sceneStats[i]);
+    }
     painter.end();
 
     // Reset GL depth test and alpha
@@ -0,0 +1,408 @@
+#include "gridfluid.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    // ms since the last lap, restarts the lap
+    double lapMs(Clock::time_point& t0) {
+        Clock::time_point t1 = Clock::now();
+        double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        t0 = t1;
+        return ms;
+    }
+
+    // cells per partial sum of a dot product
+    const int DotBlock = 4096;
+
+    // modified incomplete Cholesky, Bridson's tuning
+    const double MicTau = 0.97;
+    const double MicSigma = 0.25;
+}
+
+
+const Vec3 GridFluid::offsetU(0.0, 0.5, 0.5);
+const Vec3 GridFluid::offsetV(0.5, 0.0, 0.5);
+const Vec3 GridFluid::offsetW(0.5, 0.5, 0.0);
+const Vec3 GridFluid::offsetCell(0.5, 0.5, 0.5);
+
+
+GridFluid::GridFluid(ThreadPool* threadPool)
+    : pool(threadPool ? threadPool : &ThreadPool::shared())
+{
+}
+
+const char* GridFluid::phaseName(int phase) {
+    static const char* names[NumPhases] = {"Sources", "Advect", "Forces", "Project"};
+    return names[phase];
+}
+
+void GridFluid::load(const FluidSetup& s, double cellSize) {
+    setup = s;
+    h = cellSize;
+    origin = setup.domainMin;
+    Vec3 extent = setup.domainMax - setup.domainMin;
+    nx = std::max(1, int(std::round(extent.x() / h)));
+    ny = std::max(1, int(std::round(extent.y() / h)));
+    nz = std::max(1, int(std::round(extent.z() / h)));
+
+    int dims[4][3] = {{nx + 1, ny, nz}, {nx, ny + 1, nz}, {nx, ny, nz + 1}, {nx, ny, nz}};
+    for (int a = 0; a < 3; a++) {
+        uDims[a] = dims[0][a];
+        vDims[a] = dims[1][a];
+        wDims[a] = dims[2][a];
+        cDims[a] = dims[3][a];
+    }
+
+    reset();
+    buildPreconditioner();
+}
+
+void GridFluid::reset() {
+    u.assign((nx + 1) * ny * nz, 0.0);
+    v.assign(nx * (ny + 1) * nz, 0.0);
+    w.assign(nx * ny * (nz + 1), 0.0);
+    uNext.resize(u.size());
+    vNext.resize(v.size());
+    wNext.resize(w.size());
+    int n = nx * ny * nz;
+    pressure.assign(n, 0.0);
+    residual.assign(n, 0.0);
+    preconditioned.assign(n, 0.0);
+    search.assign(n, 0.0);
+    product.assign(n, 0.0);
+    aux.assign(n, 0.0);
+    fluidCells.assign(n, 1);
+    partials.assign((n + DotBlock - 1) / DotBlock, 0.0);
+
+    // every block particle brings its volume of dye to the cell it is in
+    density.assign(nx * ny * nz, 0.0);
+    densityNext.resize(density.size());
+    double volume = std::pow(setup.particleSpacing / h, 3);
+    setup.forEachBlockParticle([&](const Vec3& pos, const Vec3&) {
+        Vec3 g = (pos - origin) / h;
+        int i = int(std::floor(g.x())), j = int(std::floor(g.y())), k = int(std::floor(g.z()));
+        if (i < 0 || j < 0 || k < 0 || i >= nx || j >= ny || k >= nz) return;
+        double& d = density[cell(i, j, k)];
+        d = std::min(1.0, d + volume);
+    });
+}
+
+double GridFluid::getTotalDye() const {
+    double sum = 0;
+    for (double d : density) sum += d;
+    return sum * h * h * h;
+}
+
+void GridFluid::buildPreconditioner() {
+    // MIC(0) of the Poisson matrix, in cell order. The factor only sees the lower neighbors,
+    // each link between two cells has the value -1.
+    precon.assign(nx * ny * nz, 0.0);
+    for (int k = 0; k < nz; k++) {
+        for (int j = 0; j < ny; j++) {
+            for (int i = 0; i < nx; i++) {
+                int c = cell(i, j, k);
+                if (!fluidCells[c]) continue;
+
+                // precon is zero outside the fluid, which drops the missing links
+                double diag = neighborCount(i, j, k);
+                double e = diag;
+                if (i > 0) {
+                    double p = precon[c - 1];
+                    int other = (j < ny - 1 && fluidCells[c - 1 + nx]) + (k < nz - 1 && fluidCells[c - 1 + nx * ny]);
+                    e -= p * p + MicTau * other * p * p;
+                }
+                if (j > 0) {
+                    double p = precon[c - nx];
+                    int other = (i < nx - 1 && fluidCells[c - nx + 1]) + (k < nz - 1 && fluidCells[c - nx + nx * ny]);
+                    e -= p * p + MicTau * other * p * p;
+                }
+                if (k > 0) {
+                    double p = precon[c - nx * ny];
+                    int other = (i < nx - 1 && fluidCells[c - nx * ny + 1]) + (j < ny - 1 && fluidCells[c - nx * ny + nx]);
+                    e -= p * p + MicTau * other * p * p;
+                }
+                if (e < MicSigma * diag) e = diag;
+                precon[c] = e > 0 ? 1.0 / std::sqrt(e) : 0.0;
+            }
+        }
+    }
+}
+
+void GridFluid::applyPoisson(const std::vector<double>& x, std::vector<double>& y) {
+    pool->parallelFor(nx * ny * nz, [&](int begin, int end) {
+        for (int c = begin; c < end; c++) {
+            if (!fluidCells[c]) {
+                y[c] = 0;
+                continue;
+            }
+            int i = c % nx, j = (c / nx) % ny, k = c / (nx * ny);
+            double sum = neighborCount(i, j, k) * x[c];
+            if (i > 0      && fluidCells[c - 1])       sum -= x[c - 1];
+            if (i < nx - 1 && fluidCells[c + 1])       sum -= x[c + 1];
+            if (j > 0      && fluidCells[c - nx])      sum -= x[c - nx];
+            if (j < ny - 1 && fluidCells[c + nx])      sum -= x[c + nx];
+            if (k > 0      && fluidCells[c - nx * ny]) sum -= x[c - nx * ny];
+            if (k < nz - 1 && fluidCells[c + nx * ny]) sum -= x[c + nx * ny];
+            y[c] = sum;
+        }
+    });
+}
+
+void GridFluid::applyPreconditioner(const std::vector<double>& r, std::vector<double>& z) {
+    // forward substitution into aux...
+    for (int k = 0; k < nz; k++) {
+        for (int j = 0; j < ny; j++) {
+            for (int i = 0; i < nx; i++) {
+                int c = cell(i, j, k);
+                double t = r[c];
+                if (i > 0) t += precon[c - 1] * aux[c - 1];
+                if (j > 0) t += precon[c - nx] * aux[c - nx];
+                if (k > 0) t += precon[c - nx * ny] * aux[c - nx * ny];
+                aux[c] = t * precon[c];
+            }
+        }
+    }
+    // ...and back
+    for (int k = nz - 1; k >= 0; k--) {
+        for (int j = ny - 1; j >= 0; j--) {
+            for (int i = nx - 1; i >= 0; i--) {
+                int c = cell(i, j, k);
+                double t = aux[c];
+                if (i < nx - 1) t += precon[c] * z[c + 1];
+                if (j < ny - 1) t += precon[c] * z[c + nx];
+                if (k < nz - 1) t += precon[c] * z[c + nx * ny];
+                z[c] = t * precon[c];
+            }
+        }
+    }
+}
+
+double GridFluid::dot(const std::vector<double>& a, const std::vector<double>& b) {
+    int n = int(a.size());
+    pool->parallelFor(int(partials.size()), [&](int begin, int end) {
+        for (int block = begin; block < end; block++) {
+            double sum = 0;
+            int last = std::min(n, (block + 1) * DotBlock);
+            for (int c = block * DotBlock; c < last; c++) sum += a[c] * b[c];
+            partials[block] = sum;
+        }
+    });
+    double sum = 0;
+    for (double p : partials) sum += p;
+    return sum;
+}
+
+double GridFluid::sample(const std::vector<double>& field, const int dims[3], const Vec3& offset, const Vec3& pos) const {
+    Vec3 g = (pos - origin) / h - offset;
+    int i0[3];
+    double t[3];
+    for (int a = 0; a < 3; a++) {
+        double x = std::min(std::max(g[a], 0.0), double(dims[a] - 1));
+        i0[a] = std::min(int(x), std::max(dims[a] - 2, 0));
+        t[a] = x - i0[a];
+    }
+    int sx = dims[0] > 1 ? 1 : 0;
+    int sy = dims[1] > 1 ? dims[0] : 0;
+    int sz = dims[2] > 1 ? dims[0] * dims[1] : 0;
+    int base = i0[0] + dims[0] * (i0[1] + dims[1] * i0[2]);
+
+    double c00 = field[base]           * (1 - t[0]) + field[base + sx]           * t[0];
+    double c10 = field[base + sy]      * (1 - t[0]) + field[base + sy + sx]      * t[0];
+    double c01 = field[base + sz]      * (1 - t[0]) + field[base + sz + sx]      * t[0];
+    double c11 = field[base + sz + sy] * (1 - t[0]) + field[base + sz + sy + sx] * t[0];
+    double c0 = c00 * (1 - t[1]) + c10 * t[1];
+    double c1 = c01 * (1 - t[1]) + c11 * t[1];
+    return c0 * (1 - t[2]) + c1 * t[2];
+}
+
+Vec3 GridFluid::velocityAt(const Vec3& pos) const {
+    return Vec3(sample(u, uDims, offsetU, pos), sample(v, vDims, offsetV, pos), sample(w, wDims, offsetW, pos));
+}
+
+Vec3 GridFluid::backTrace(const Vec3& pos, double dt) const {
+    // midpoint rule
+    Vec3 mid = pos - 0.5 * dt * velocityAt(pos);
+    return pos - dt * velocityAt(mid);
+}
+
+void GridFluid::applySources() {
+    if (setup.emitters.empty() && setup.drains.empty()) return;
+
+    if (!setup.drains.empty()) {
+        pool->parallelFor(nx * ny * nz, [&](int begin, int end) {
+            for (int c = begin; c < end; c++) {
+                int i = c % nx, j = (c / nx) % ny, k = c / (nx * ny);
+                Vec3 pos = origin + (Vec3(i, j, k) + offsetCell) * h;
+                for (const FluidDrain& drain : setup.drains) {
+                    if (drain.contains(pos)) density[c] = 0;
+                }
+            }
+        });
+    }
+
+    // a layer of cells one cell thick across each nozzle. Neighbor cells share faces,
+    // so this runs on one thread over the cells around the nozzle only.
+    for (const FluidEmitter& emitter : setup.emitters) {
+        Vec3 vel = emitter.getVelocity();
+        Vec3 dir = vel.normalized();
+        double reach = emitter.getHalfWidth() + h;
+        Vec3 lo = (emitter.getCenter() - origin) / h - Vec3(reach, reach, reach) / h;
+        Vec3 hi = (emitter.getCenter() - origin) / h + Vec3(reach, reach, reach) / h;
+        int i0 = std::max(0, int(std::floor(lo.x()))), i1 = std::min(nx - 1, int(std::ceil(hi.x())));
+        int j0 = std::max(0, int(std::floor(lo.y()))), j1 = std::min(ny - 1, int(std::ceil(hi.y())));
+        int k0 = std::max(0, int(std::floor(lo.z()))), k1 = std::min(nz - 1, int(std::ceil(hi.z())));
+
+        for (int k = k0; k <= k1; k++) {
+            for (int j = j0; j <= j1; j++) {
+                for (int i = i0; i <= i1; i++) {
+                    Vec3 d = origin + (Vec3(i, j, k) + offsetCell) * h - emitter.getCenter();
+                    double along = d.dot(dir);
+                    Vec3 across = d - along * dir;
+                    if (std::abs(along) > 0.5 * h || across.cwiseAbs().maxCoeff() > emitter.getHalfWidth() + 0.5 * h) continue;
+
+                    density[cell(i, j, k)] = 1;
+                    // faces of this cell, except the walls
+                    if (i > 0)      u[uFace(i, j, k)] = vel.x();
+                    if (i < nx - 1) u[uFace(i + 1, j, k)] = vel.x();
+                    if (j > 0)      v[vFace(i, j, k)] = vel.y();
+                    if (j < ny - 1) v[vFace(i, j + 1, k)] = vel.y();
+                    if (k > 0)      w[wFace(i, j, k)] = vel.z();
+                    if (k < nz - 1) w[wFace(i, j, k + 1)] = vel.z();
+                }
+            }
+        }
+    }
+}
+
+void GridFluid::applyForces(double dt) {
+    // weight of the dye on the horizontal faces between two cells
+    pool->parallelFor(nx * (ny - 1) * nz, [&](int begin, int end) {
+        for (int f = begin; f < end; f++) {
+            int i = f % nx, j = 1 + (f / nx) % (ny - 1), k = f / (nx * (ny - 1));
+            double d = 0.5 * (density[cell(i, j - 1, k)] + density[cell(i, j, k)]);
+            v[vFace(i, j, k)] -= dt * dyeWeight * d;
+        }
+    });
+}
+
+void GridFluid::advect(double dt) {
+    // one pass per field, wall faces stay at zero
+    auto advectField = [&](const std::vector<double>& field, std::vector<double>& next,
+                           const int dims[3], const Vec3& offset, int wallAxis) {
+        int n = dims[0] * dims[1] * dims[2];
+        pool->parallelFor(n, [&](int begin, int end) {
+            for (int f = begin; f < end; f++) {
+                int idx[3] = {f % dims[0], (f / dims[0]) % dims[1], f / (dims[0] * dims[1])};
+                if (wallAxis >= 0 && (idx[wallAxis] == 0 || idx[wallAxis] == dims[wallAxis] - 1)) {
+                    next[f] = 0;
+                    continue;
+                }
+                Vec3 pos = origin + (Vec3(idx[0], idx[1], idx[2]) + offset) * h;
+                next[f] = sample(field, dims, offset, backTrace(pos, dt));
+            }
+        });
+    };
+    advectField(u, uNext, uDims, offsetU, 0);
+    advectField(v, vNext, vDims, offsetV, 1);
+    advectField(w, wNext, wDims, offsetW, 2);
+    advectField(density, densityNext, cDims, offsetCell, -1);
+    u.swap(uNext);
+    v.swap(vNext);
+    w.swap(wNext);
+    density.swap(densityNext);
+}
+
+void GridFluid::project() {
+    int n = nx * ny * nz;
+    pool->parallelFor(n, [&](int begin, int end) {
+        for (int c = begin; c < end; c++) {
+            if (!fluidCells[c]) {
+                residual[c] = 0;
+                pressure[c] = 0;
+                continue;
+            }
+            int i = c % nx, j = (c / nx) % ny, k = c / (nx * ny);
+            double div = u[uFace(i + 1, j, k)] - u[uFace(i, j, k)]
+                       + v[vFace(i, j + 1, k)] - v[vFace(i, j, k)]
+                       + w[wFace(i, j, k + 1)] - w[wFace(i, j, k)];
+            residual[c] = -div;
+        }
+    });
+
+    lastIterations = 0;
+    lastError = 0;
+    double rhsNorm = std::sqrt(dot(residual, residual));
+    if (rhsNorm == 0) return;
+
+    // last step's pressure is a good first guess. Without any empty cell the matrix is
+    // singular, pressure is only defined up to a constant, but the divergence of a closed
+    // box sums to zero and CG stays in the range of the matrix.
+    applyPoisson(pressure, product);
+    pool->parallelFor(n, [&](int begin, int end) {
+        for (int c = begin; c < end; c++) residual[c] -= product[c];
+    });
+
+    double error = std::sqrt(dot(residual, residual)) / rhsNorm;
+    if (error > tolerance) {
+        applyPreconditioner(residual, preconditioned);
+        search = preconditioned;
+        double sigma = dot(preconditioned, residual);
+
+        for (int it = 1; it <= maxIterations; it++) {
+            applyPoisson(search, product);
+            double denom = dot(product, search);
+            if (denom == 0) break;
+            double alpha = sigma / denom;
+            pool->parallelFor(n, [&](int begin, int end) {
+                for (int c = begin; c < end; c++) {
+                    pressure[c] += alpha * search[c];
+                    residual[c] -= alpha * product[c];
+                }
+            });
+            lastIterations = it;
+            error = std::sqrt(dot(residual, residual)) / rhsNorm;
+            if (error <= tolerance) break;
+
+            applyPreconditioner(residual, preconditioned);
+            double sigmaNew = dot(preconditioned, residual);
+            double beta = sigmaNew / sigma;
+            sigma = sigmaNew;
+            pool->parallelFor(n, [&](int begin, int end) {
+                for (int c = begin; c < end; c++) search[c] = preconditioned[c] + beta * search[c];
+            });
+        }
+    }
+    lastError = error;
+
+    // interior faces take the pressure difference of their two cells, faces between two
+    // empty cells are left alone
+    pool->parallelFor(n, [&](int begin, int end) {
+        for (int c = begin; c < end; c++) {
+            int i = c % nx, j = (c / nx) % ny, k = c / (nx * ny);
+            if (i > 0) u[uFace(i, j, k)] -= pressure[c] - pressure[c - 1];
+            if (j > 0) v[vFace(i, j, k)] -= pressure[c] - pressure[c - nx];
+            if (k > 0) w[wFace(i, j, k)] -= pressure[c] - pressure[c - nx * ny];
+        }
+    });
+}
+
+void GridFluid::step(double dt) {
+    if (nx * ny * nz == 0) return;
+
+    Clock::time_point timer = Clock::now();
+
+    applySources();
+    phaseMs[PhaseSources] = lapMs(timer);
+
+    advect(dt);
+    phaseMs[PhaseAdvection] = lapMs(timer);
+
+    applyForces(dt);
+    phaseMs[PhaseForces] = lapMs(timer);
+
+    project();
+    phaseMs[PhaseProjection] = lapMs(timer);
+}
@@ -0,0 +1,114 @@
+#ifndef GRIDFLUID_H
+#define GRIDFLUID_H
+
+#include "fluidsimulation.h"
+#include "threadpool.h"
+#include <vector>
+
+/*
+ *  Eulerian fluid on a MAC grid, Stam's stable fluids. Velocities live on the cell faces,
+ *  the dye density in the cell centers. A step advects velocity and dye semi-Lagrangian
+ *  (RK2 back trace, trilinear sampling) in the divergence free field of the last step, adds
+ *  the weight of the dye and projects the velocity to be divergence free again. The pressure
+ *  Poisson problem is solved matrix free with conjugate gradients and a modified incomplete
+ *  Cholesky preconditioner, which only depends on the grid and is factorized once per load.
+ *  Advection, the matrix products and the dot products run on the thread pool, the
+ *  preconditioner's triangular solves run on one thread.
+ *
+ *  The grid covers the domain of a FluidSetup and all its sides are solid walls. The fluid
+ *  blocks of the setup are the initial dye, emitters inject dye and momentum and drains
+ *  remove dye, so both engines can run the same tank. The dye is heavier than the fluid
+ *  around it (Boussinesq), which makes a block of dye collapse like the SPH dam break.
+ */
+class GridFluid
+{
+public:
+    enum Phase { PhaseSources, PhaseAdvection, PhaseForces, PhaseProjection, NumPhases };
+
+    // runs on the shared pool if none is given
+    explicit GridFluid(ThreadPool* pool = nullptr);
+
+    void load(const FluidSetup& setup, double cellSize);
+    void reset();
+    void step(double dt);
+
+    void setDyeWeight(double g) { dyeWeight = g; }
+    // residual relative to the divergence
+    void setTolerance(double tol) { tolerance = tol; }
+    void setMaxIterations(int n) { maxIterations = n; }
+
+    int getNx() const { return nx; }
+    int getNy() const { return ny; }
+    int getNz() const { return nz; }
+    int getNumCells() const { return nx * ny * nz; }
+    double getCellSize() const { return h; }
+    const Vec3& getOrigin() const { return origin; }
+    const std::vector<double>& getDensity() const { return density; }
+    double getTotalDye() const;
+
+    int getLastIterations() const { return lastIterations; }
+    double getLastError() const { return lastError; }
+    double getPhaseMs(int phase) const { return phaseMs[phase]; }
+    static const char* phaseName(int phase);
+
+protected:
+    int cell(int i, int j, int k) const { return i + nx * (j + ny * k); }
+    int uFace(int i, int j, int k) const { return i + (nx + 1) * (j + ny * k); }
+    int vFace(int i, int j, int k) const { return i + nx * (j + (ny + 1) * k); }
+    int wFace(int i, int j, int k) const { return i + nx * (j + ny * k); }
+
+    // trilinear sample of a field with dims values per axis, whose value (0,0,0) is at
+    // origin + offset * h. Positions outside are clamped to the border values.
+    double sample(const std::vector<double>& field, const int dims[3], const Vec3& offset, const Vec3& pos) const;
+    Vec3 velocityAt(const Vec3& pos) const;
+    Vec3 backTrace(const Vec3& pos, double dt) const;
+
+    // where value (0,0,0) of each field sits, in cells from the grid origin
+    static const Vec3 offsetU, offsetV, offsetW, offsetCell;
+
+    void applySources();
+    void applyForces(double dt);
+    void advect(double dt);
+    void project();
+    void buildPreconditioner();
+
+    // Poisson matrix: one row per fluid cell, -1 towards each neighbor fluid cell, the number
+    // of neighbor cells on the diagonal. Walls are left out, their face velocity is fixed,
+    // and cells without fluid have zero pressure.
+    void applyPoisson(const std::vector<double>& x, std::vector<double>& y);
+    void applyPreconditioner(const std::vector<double>& r, std::vector<double>& z);
+    double dot(const std::vector<double>& a, const std::vector<double>& b);
+    int neighborCount(int i, int j, int k) const {
+        return (i > 0) + (i < nx - 1) + (j > 0) + (j < ny - 1) + (k > 0) + (k < nz - 1);
+    }
+
+    ThreadPool* pool;
+    FluidSetup setup;
+
+    int nx = 0, ny = 0, nz = 0;
+    double h = 1;
+    Vec3 origin = Vec3(0, 0, 0);
+    int uDims[3], vDims[3], wDims[3], cDims[3];
+
+    std::vector<double> u, v, w;
+    std::vector<double> uNext, vNext, wNext;
+    std::vector<double> density, densityNext;
+    double dyeWeight = 9.81;
+
+    // cells taking part in the projection, all of them unless a liquid marks its own
+    std::vector<char> fluidCells;
+
+    // pressure projection, p is scaled so the face update is just a difference
+    std::vector<double> precon;
+    std::vector<double> pressure;
+    std::vector<double> residual, preconditioned, search, product, aux;
+    std::vector<double> partials;   // per block of cells, keeps the dot products deterministic
+    double tolerance = 1e-5;
+    int maxIterations = 200;
+    int lastIterations = 0;
+    double lastError = 0;
+
+    double phaseMs[NumPhases] = {0};
+};
+
+#endif // GRIDFLUID_H
@@ -21,8 +21,12 @@ void IntegratorSymplecticEuler::step(ParticleSystem &system, double dt) {
     system.setPositions(p1);
 }
 
-void IntegratorSymplecticEuler::stepWithoutPS(std::vector<Particle*> particles, double dt){
-    for(int i = 0; i < particles.size(); i++){
+void IntegratorSymplecticEuler::stepWithoutPS(const std::vector<Particle*>& particles, double dt){
+    stepWithoutPS(particles, dt, 0, particles.size());
+}
+
+void IntegratorSymplecticEuler::stepWithoutPS(const std::vector<Particle*>& particles, double dt, int begin, int end){
+    for(int i = begin; i < end; i++){
         Vec3 v0 = particles.at(i)->vel;
         Vec3 x0 = particles.at(i)->pos;
 
@@ -47,13 +51,23 @@ void IntegratorMidpoint::step(ParticleSystem &system, double dt) {
 
 void IntegratorVerlet::step(ParticleSystem &system, double dt) {
     for(Particle* p : system.getParticles()){
-        if(p->pos.x() == p->prevPos.x() && p->pos.y() == p->prevPos.y() && p->pos.z() == p->prevPos.z()){
-            p->prevPos = p->pos - p->vel * dt;
-        }
-        Vec3 p1 = p->pos + kd * (p->pos - p->prevPos) + ((dt*dt)/p->mass) * p->force;
-        p->prevPos = p->pos;
-        p->pos = p1;
+        stepParticle(p, dt);
+    }
+}
+
+void IntegratorVerlet::step(ParticleSystem &system, double dt, const std::vector<int>& active) {
+    for(int i : active){
+        stepParticle(system.getParticle(i), dt);
+    }
+}
+
+void IntegratorVerlet::stepParticle(Particle* p, double dt) const {
+    if(p->pos.x() == p->prevPos.x() && p->pos.y() == p->prevPos.y() && p->pos.z() == p->prevPos.z()){
+        p->prevPos = p->pos - p->vel * dt;
     }
+    Vec3 p1 = p->pos + kd * (p->pos - p->prevPos) + ((dt*dt)/p->mass) * p->force;
+    p->prevPos = p->pos;
+    p->pos = p1;
 }
 
 void IntegratorRK2::step(ParticleSystem &system, double dt) {
@@ -20,7 +20,9 @@ public:
 class IntegratorSymplecticEuler : public Integrator {
 public:
     virtual void step(ParticleSystem& system, double dt);
-    virtual void stepWithoutPS(std::vector<Particle*> particles, double dt);
+    virtual void stepWithoutPS(const std::vector<Particle*>& particles, double dt);
+    // only integrates particles in [begin, end), so ranges can run in parallel
+    void stepWithoutPS(const std::vector<Particle*>& particles, double dt, int begin, int end);
 };
 
 
@@ -33,7 +35,12 @@ public:
 class IntegratorVerlet : public Integrator {
 public:
     virtual void step(ParticleSystem& system, double dt);
+    // only the particles of the given indices, the others stay where they are
+    void step(ParticleSystem& system, double dt, const std::vector<int>& active);
     double kd = 1;
+
+protected:
+    void stepParticle(Particle* p, double dt) const;
 };
 
 class IntegratorRK2 : public Integrator {
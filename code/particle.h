@@ -17,9 +17,11 @@ public:
     double mass;
     double radius = 1.0;
     double life   = 0.0;
+    double density  = 0.0;
+    double pressure = 0.0;
     Vec3 color    = Vec3(1, 1, 1);
     unsigned int id = 0;
-    bool isFixed;
+    bool isFixed = false;
     std::set<Particle*> neighbors;
 
     Particle() {
@@ -48,10 +50,29 @@ public:
         color   = p.color;
         radius  = p.radius;
         life    = p.life;
+        density = p.density;
+        pressure = p.pressure;
     }
 
     ~Particle() {
     }
+
+    // back to the state of a default constructed particle, keeping the memory of neighbors
+    void reset() {
+        pos      = Vec3(0.0, 0.0, 0.0);
+        prevPos  = pos;
+        vel      = Vec3(0.0, 0.0, 0.0);
+        force    = Vec3(0.0, 0.0, 0.0);
+        mass     = 1.0;
+        radius   = 1.0;
+        life     = 0.0;
+        density  = 0.0;
+        pressure = 0.0;
+        color    = Vec3(1, 1, 1);
+        id       = 0;
+        isFixed  = false;
+        neighbors.clear();
+    }
 };
 
 
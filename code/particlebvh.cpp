@@ -0,0 +1,238 @@
+#include "particlebvh.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+ParticleBVH::ParticleBVH(int maxNumObjects, int leafSize) : leafSize(std::max(1, leafSize)) {
+    nodes.reserve(2 * maxNumObjects / this->leafSize + 1);
+    particleIds.reserve(maxNumObjects);
+    queryIds.resize(maxNumObjects);
+    queryDists.resize(maxNumObjects);
+    querySize = 0;
+    buildArea = 0;
+}
+
+void ParticleBVH::leafBounds(const std::vector<Particle *>& particles, Node& node) {
+    node.bmin = Vec3::Constant( std::numeric_limits<double>::max());
+    node.bmax = Vec3::Constant(-std::numeric_limits<double>::max());
+    for (int k = node.start; k < node.start + node.count; k++) {
+        const Particle* p = particles[particleIds[k]];
+        Vec3 r = Vec3::Constant(p->radius);
+        node.bmin = node.bmin.cwiseMin(p->pos - r);
+        node.bmax = node.bmax.cwiseMax(p->pos + r);
+    }
+}
+
+double ParticleBVH::surfaceArea(const Node& node) const {
+    Vec3 d = node.bmax - node.bmin;
+    return 2.0 * (d.x()*d.y() + d.y()*d.z() + d.z()*d.x());
+}
+
+int ParticleBVH::build(const std::vector<Particle *>& particles, int start, int end) {
+    int idx = static_cast<int>(nodes.size());
+    nodes.push_back(Node());
+    nodes[idx].left = nodes[idx].right = -1;
+    nodes[idx].start = start;
+    nodes[idx].count = end - start;
+    leafBounds(particles, nodes[idx]);
+
+    if (end - start <= leafSize) {
+        return idx;
+    }
+
+    // median split along the longest axis of the centers
+    Vec3 cmin = Vec3::Constant( std::numeric_limits<double>::max());
+    Vec3 cmax = Vec3::Constant(-std::numeric_limits<double>::max());
+    for (int k = start; k < end; k++) {
+        cmin = cmin.cwiseMin(particles[particleIds[k]]->pos);
+        cmax = cmax.cwiseMax(particles[particleIds[k]]->pos);
+    }
+    int axis;
+    (cmax - cmin).maxCoeff(&axis);
+
+    int mid = (start + end) / 2;
+    std::nth_element(particleIds.begin() + start, particleIds.begin() + mid, particleIds.begin() + end,
+                     [&](int a, int b) { return particles[a]->pos[axis] < particles[b]->pos[axis]; });
+
+    // children are always stored after their parent, refit relies on it
+    int left = build(particles, start, mid);
+    int right = build(particles, mid, end);
+    nodes[idx].left = left;
+    nodes[idx].right = right;
+    nodes[idx].count = 0;
+    return idx;
+}
+
+void ParticleBVH::create(const std::vector<Particle *>& particles) {
+    int numObjects = static_cast<int>(particles.size());
+    nodes.clear();
+    particleIds.resize(numObjects);
+    for (int i = 0; i < numObjects; i++) {
+        particleIds[i] = i;
+    }
+    if (static_cast<int>(queryIds.size()) < numObjects) {
+        queryIds.resize(numObjects);
+        queryDists.resize(numObjects);
+    }
+
+    buildArea = 0;
+    if (numObjects > 0) {
+        build(particles, 0, numObjects);
+        buildArea = surfaceArea(nodes[0]);
+    }
+}
+
+void ParticleBVH::refit(const std::vector<Particle *>& particles) {
+    // reverse pre-order visits children before their parents
+    for (int n = static_cast<int>(nodes.size()) - 1; n >= 0; n--) {
+        Node& node = nodes[n];
+        if (node.left < 0) {
+            leafBounds(particles, node);
+        }
+        else {
+            node.bmin = nodes[node.left].bmin.cwiseMin(nodes[node.right].bmin);
+            node.bmax = nodes[node.left].bmax.cwiseMax(nodes[node.right].bmax);
+        }
+    }
+}
+
+bool ParticleBVH::needsRebuild(double maxGrowth) const {
+    if (nodes.empty()) return true;
+    return surfaceArea(nodes[0]) > maxGrowth * buildArea;
+}
+
+double ParticleBVH::boxDistance2(const Node& node, const Vec3& p) const {
+    Vec3 d = (node.bmin - p).cwiseMax(p - node.bmax).cwiseMax(Vec3::Zero());
+    return d.squaredNorm();
+}
+
+bool ParticleBVH::rayBox(const Node& node, const Vec3& origin, const Vec3& invDir, double tmax) const {
+    double tmin = 0;
+    for (int a = 0; a < 3; a++) {
+        double t1 = (node.bmin[a] - origin[a]) * invDir[a];
+        double t2 = (node.bmax[a] - origin[a]) * invDir[a];
+        if (t1 > t2) std::swap(t1, t2);
+        tmin = std::max(tmin, t1);
+        tmax = std::min(tmax, t2);
+        if (tmin > tmax) return false;
+    }
+    return true;
+}
+
+void ParticleBVH::query(const std::vector<Particle *>& particles, int i, double maxDist) {
+    queryRadius(particles, particles[i]->pos, particles[i]->radius + maxDist);
+}
+
+void ParticleBVH::queryRadius(const std::vector<Particle *>& particles, const Vec3& center, double radius) {
+    querySize = 0;
+    if (nodes.empty()) return;
+
+    stack.clear();
+    stack.push_back(0);
+    while (!stack.empty()) {
+        const Node& node = nodes[stack.back()];
+        stack.pop_back();
+
+        if (boxDistance2(node, center) > radius * radius) continue;
+
+        if (node.left >= 0) {
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+            continue;
+        }
+        for (int k = node.start; k < node.start + node.count; k++) {
+            const Particle* p = particles[particleIds[k]];
+            double r = radius + p->radius;
+            if ((p->pos - center).squaredNorm() <= r * r) {
+                queryIds[querySize] = particleIds[k];
+                querySize++;
+            }
+        }
+    }
+}
+
+void ParticleBVH::queryKNearest(const std::vector<Particle *>& particles, const Vec3& pos, int k) {
+    querySize = 0;
+    if (nodes.empty() || k <= 0) return;
+    k = std::min(k, static_cast<int>(particleIds.size()));
+
+    // queryIds/queryDists hold the k best so far, sorted by increasing squared distance
+    double worst = std::numeric_limits<double>::max();
+    stack.clear();
+    stack.push_back(0);
+    while (!stack.empty()) {
+        const Node& node = nodes[stack.back()];
+        stack.pop_back();
+
+        if (querySize == k && boxDistance2(node, pos) > worst) continue;
+
+        if (node.left >= 0) {
+            // visit the closer child first so the bound shrinks early
+            double dl = boxDistance2(nodes[node.left], pos);
+            double dr = boxDistance2(nodes[node.right], pos);
+            if (dl < dr) {
+                stack.push_back(node.right);
+                stack.push_back(node.left);
+            }
+            else {
+                stack.push_back(node.left);
+                stack.push_back(node.right);
+            }
+            continue;
+        }
+        for (int n = node.start; n < node.start + node.count; n++) {
+            double d2 = (particles[particleIds[n]]->pos - pos).squaredNorm();
+            if (querySize == k && d2 >= worst) continue;
+
+            int slot = (querySize < k) ? querySize++ : k - 1;
+            while (slot > 0 && queryDists[slot - 1] > d2) {
+                queryDists[slot] = queryDists[slot - 1];
+                queryIds[slot] = queryIds[slot - 1];
+                slot--;
+            }
+            queryDists[slot] = d2;
+            queryIds[slot] = particleIds[n];
+            if (querySize == k) worst = queryDists[k - 1];
+        }
+    }
+}
+
+int ParticleBVH::raycast(const std::vector<Particle *>& particles, const Vec3& origin, const Vec3& dir, double& tHit) {
+    int hit = -1;
+    tHit = std::numeric_limits<double>::max();
+    if (nodes.empty()) return hit;
+
+    Vec3 d = dir.normalized();
+    Vec3 invDir(1.0/d.x(), 1.0/d.y(), 1.0/d.z());
+
+    stack.clear();
+    stack.push_back(0);
+    while (!stack.empty()) {
+        const Node& node = nodes[stack.back()];
+        stack.pop_back();
+
+        if (!rayBox(node, origin, invDir, tHit)) continue;
+
+        if (node.left >= 0) {
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+            continue;
+        }
+        for (int k = node.start; k < node.start + node.count; k++) {
+            const Particle* p = particles[particleIds[k]];
+            Vec3 oc = p->pos - origin;
+            double tc = oc.dot(d);
+            double dist2 = oc.squaredNorm() - tc*tc;  // squared point-ray distance
+            double r2 = p->radius * p->radius;
+            if (dist2 > r2) continue;
+
+            double t = tc - std::sqrt(r2 - dist2);
+            if (t < 0) t = tc;  // origin inside the sphere
+            if (t >= 0 && t < tHit) {
+                tHit = t;
+                hit = particleIds[k];
+            }
+        }
+    }
+    return hit;
+}
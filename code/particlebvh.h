@@ -0,0 +1,56 @@
+#ifndef PARTICLEBVH_H
+#define PARTICLEBVH_H
+
+#include "particle.h"
+#include <vector>
+
+/*
+ *  Bounding volume hierarchy over particle spheres. Unlike ParticleHashGrid it does not
+ *  assume a fixed spacing, so it handles particles with different radii and answers
+ *  k-nearest and ray queries. Call create() to build it and refit() on the following
+ *  steps to update the bounds in O(n) without changing the tree topology.
+ */
+class ParticleBVH {
+private:
+    struct Node {
+        Vec3 bmin, bmax;
+        int left, right;    // children, -1 on leaves
+        int start, count;   // range in particleIds, only on leaves
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int> particleIds;
+    std::vector<int> queryIds;
+    std::vector<double> queryDists;
+    std::vector<int> stack;
+    int querySize;
+    int leafSize;
+    double buildArea;
+
+    int build(const std::vector<Particle *>& particles, int start, int end);
+    void leafBounds(const std::vector<Particle *>& particles, Node& node);
+    double surfaceArea(const Node& node) const;
+    double boxDistance2(const Node& node, const Vec3& p) const;
+    bool rayBox(const Node& node, const Vec3& origin, const Vec3& invDir, double tmax) const;
+
+public:
+    ParticleBVH(int maxNumObjects, int leafSize = 4);
+
+    void create(const std::vector<Particle *>& particles);
+    void refit(const std::vector<Particle *>& particles);
+    bool needsRebuild(double maxGrowth = 2.0) const;
+
+    // particles j whose sphere is within maxDist of the sphere of particle i (i included)
+    void query(const std::vector<Particle *>& particles, int i, double maxDist);
+    // particles j with |center - pj| <= radius + rj
+    void queryRadius(const std::vector<Particle *>& particles, const Vec3& center, double radius);
+    // k particles with closest centers, sorted by distance
+    void queryKNearest(const std::vector<Particle *>& particles, const Vec3& pos, int k);
+    // first particle sphere hit by the ray, -1 if none. dir does not need to be normalized
+    int raycast(const std::vector<Particle *>& particles, const Vec3& origin, const Vec3& dir, double& tHit);
+
+    const std::vector<int>& getNeighbors() const {return queryIds;};
+    int getQuerySize(){return querySize;};
+};
+
+#endif // PARTICLEBVH_H
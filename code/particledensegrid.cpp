@@ -0,0 +1,72 @@
+#include "particledensegrid.h"
+#include <algorithm>
+#include <cmath>
+
+ParticleDenseGrid::ParticleDenseGrid(double spacing, const Vec3& bmin, const Vec3& bmax, int maxNumObjects)
+    : spacing(spacing), origin(bmin) {
+    nx = std::max(1, static_cast<int>(std::ceil((bmax.x() - bmin.x()) / spacing)));
+    ny = std::max(1, static_cast<int>(std::ceil((bmax.y() - bmin.y()) / spacing)));
+    nz = std::max(1, static_cast<int>(std::ceil((bmax.z() - bmin.z()) / spacing)));
+    cellStart.resize(nx * ny * nz + 1);
+    cellEntries.resize(maxNumObjects);
+    cellOf.resize(maxNumObjects);
+    queryIds.resize(maxNumObjects);
+    querySize = 0;
+}
+
+int ParticleDenseGrid::intCoord(double coord, int axis, int n) const {
+    int c = static_cast<int>(std::floor((coord - origin[axis]) / spacing));
+    return std::min(std::max(c, 0), n - 1);
+}
+
+int ParticleDenseGrid::cellIndex(const Vec3& pos) const {
+    return (intCoord(pos.x(), 0, nx) * ny + intCoord(pos.y(), 1, ny)) * nz + intCoord(pos.z(), 2, nz);
+}
+
+void ParticleDenseGrid::create(const std::vector<Particle *>& particles) {
+    int numObjects = std::min(static_cast<int>(particles.size()), static_cast<int>(cellEntries.size()));
+    int numCells = nx * ny * nz;
+
+    // Determine cell sizes
+    std::fill(cellStart.begin(), cellStart.end(), 0);
+    for (int i = 0; i < numObjects; i++) {
+        cellOf[i] = cellIndex(particles[i]->pos);
+        cellStart[cellOf[i]]++;
+    }
+
+    // Determine cell starts
+    int start = 0;
+    for (int c = 0; c < numCells; c++) {
+        start += cellStart[c];
+        cellStart[c] = start;
+    }
+    cellStart[numCells] = start;
+
+    // Fill in objects ids
+    for (int i = 0; i < numObjects; i++) {
+        cellStart[cellOf[i]]--;
+        cellEntries[cellStart[cellOf[i]]] = i;
+    }
+}
+
+void ParticleDenseGrid::query(const std::vector<Particle *>& particles, int i, double maxDist) {
+    const Vec3& pos = particles[i]->pos;
+    int x0 = intCoord(pos.x() - maxDist, 0, nx), x1 = intCoord(pos.x() + maxDist, 0, nx);
+    int y0 = intCoord(pos.y() - maxDist, 1, ny), y1 = intCoord(pos.y() + maxDist, 1, ny);
+    int z0 = intCoord(pos.z() - maxDist, 2, nz), z1 = intCoord(pos.z() + maxDist, 2, nz);
+
+    querySize = 0;
+
+    for (int xi = x0; xi <= x1; xi++) {
+        for (int yi = y0; yi <= y1; yi++) {
+            // cells along z are contiguous, so the whole row is a single range
+            int row = (xi * ny + yi) * nz;
+            int start = cellStart[row + z0];
+            int end = cellStart[row + z1 + 1];
+            for (int k = start; k < end; k++) {
+                queryIds[querySize] = cellEntries[k];
+                querySize++;
+            }
+        }
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef PARTICLEDENSEGRID_H
+#define PARTICLEDENSEGRID_H
+
+#include "particle.h"
+#include <vector>
+
+/*
+ *  Uniform grid with one cell per spacing^3 over a fixed box. Same interface as
+ *  ParticleHashGrid, but cells never collide, at the cost of storing every cell of the box.
+ *  Positions outside the box are clamped to the border cells.
+ */
+class ParticleDenseGrid {
+private:
+    double spacing;
+    Vec3 origin;
+    int nx, ny, nz;
+    std::vector<int> cellStart;
+    std::vector<int> cellEntries;
+    std::vector<int> cellOf;
+    std::vector<int> queryIds;
+    int querySize;
+
+    int intCoord(double coord, int axis, int n) const;
+    int cellIndex(const Vec3& pos) const;
+
+public:
+    ParticleDenseGrid(double spacing, const Vec3& bmin, const Vec3& bmax, int maxNumObjects);
+
+    void create(const std::vector<Particle *>& particles);
+    void query(const std::vector<Particle *>& particles, int i, double maxDist);
+    const std::vector<int>& getNeighbors() const {return queryIds;};
+    int getQuerySize(){return querySize;};
+    int getNumCells() const {return nx * ny * nz;};
+};
+
+#endif // PARTICLEDENSEGRID_H
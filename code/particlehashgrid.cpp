@@ -1,12 +1,13 @@
 #include "particlehashgrid.h"
+#include "threadpool.h"
 #include <iostream>
 
-int ParticleHashGrid::hashCoords(int xi, int yi, int zi) {
+int ParticleHashGrid::hashCoords(int xi, int yi, int zi) const {
     int h = (xi * 92837111) ^ (yi * 689287499) ^ (zi * 283923481); // Fantasy function
     return std::abs(h) % tableSize;
 }
 
-int ParticleHashGrid::intCoord(double coord) {
+int ParticleHashGrid::intCoord(double coord) const {
     return static_cast<int>(std::floor(coord / spacing));
 }
 
@@ -22,21 +23,29 @@ ParticleHashGrid::ParticleHashGrid(double spacing, int maxNumObjects) : spacing(
     tableSize = 2 * maxNumObjects;
     cellStart.resize(tableSize + 1);
     cellEntries.resize(maxNumObjects);
+    cellOf.resize(maxNumObjects);
     queryIds.resize(maxNumObjects);
     querySize = 0;
 }
 
-void ParticleHashGrid::create(std::vector<Particle *> particles) {
+void ParticleHashGrid::create(const std::vector<Particle *>& particles, ThreadPool* pool) {
     int numObjects = std::min(static_cast<int>(particles.size()), static_cast<int>(cellEntries.size()));
 
+    // Hash positions
+    auto hashRange = [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            const Vec3& position = particles[i]->pos;
+            cellOf[i] = this->hashCoords(intCoord(position.x()), intCoord(position.y()), intCoord(position.z()));
+        }
+    };
+    if (pool) pool->parallelFor(numObjects, hashRange);
+    else      hashRange(0, numObjects);
+
     // Determine cell sizes
     std::fill(cellStart.begin(), cellStart.end(), 0);
-    std::fill(cellEntries.begin(), cellEntries.end(), 0);
 
     for(int i = 0; i < numObjects; i++){
-        Vec3 position = particles.at(i)->pos;
-        int hash = this->hashCoords(intCoord(position.x()), intCoord(position.y()), intCoord(position.z()));
-        this->cellStart[hash]++;
+        this->cellStart[cellOf[i]]++;
     }
 
     // Determine cell starts
@@ -49,14 +58,17 @@ void ParticleHashGrid::create(std::vector<Particle *> particles) {
 
     // Fill in objects ids
     for (int i = 0; i < numObjects; i++) {
-        Vec3 position = particles.at(i)->pos;
-        int h = this->hashCoords(intCoord(position.x()), intCoord(position.y()), intCoord(position.z()));
+        int h = cellOf[i];
         cellStart[h]--;
         cellEntries[cellStart[h]] = i;
     }
 }
 
 void ParticleHashGrid::query(const std::vector<Particle *>& particles, int i, double maxDist) {
+    querySize = query(particles, i, maxDist, queryIds);
+}
+
+int ParticleHashGrid::query(const std::vector<Particle *>& particles, int i, double maxDist, std::vector<int>& ids) const {
     int x0 = intCoord(particles.at(i)->pos.x() - maxDist);
     int y0 = intCoord(particles.at(i)->pos.y() - maxDist);
     int z0 = intCoord(particles.at(i)->pos.z() - maxDist);
@@ -65,7 +77,7 @@ void ParticleHashGrid::query(const std::vector<Particle *>& particles, int i, do
     int y1 = intCoord(particles.at(i)->pos.y() + maxDist);
     int z1 = intCoord(particles.at(i)->pos.z() + maxDist);
 
-    querySize = 0;
+    int querySize = 0;
 
     for (int xi = x0; xi <= x1; xi++) {
         for (int yi = y0; yi <= y1; yi++) {
@@ -75,10 +87,17 @@ void ParticleHashGrid::query(const std::vector<Particle *>& particles, int i, do
                 int end = cellStart[h + 1];
 
                 for (int i = start; i < end; i++) {
-                    queryIds[querySize] = cellEntries[i];
+                    // colliding cells can return the same bucket more than once
+                    if (querySize == static_cast<int>(ids.size())) {
+                        ids.push_back(cellEntries[i]);
+                    }
+                    else {
+                        ids[querySize] = cellEntries[i];
+                    }
                     querySize++;
                 }
             }
         }
     }
+    return querySize;
 }
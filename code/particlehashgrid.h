@@ -3,28 +3,34 @@
 
 #include "stdlib.h"
 
-#include <Particle.h>
+#include "particle.h"
 #include <vector>
 
+class ThreadPool;
+
 class ParticleHashGrid {
 private:
     double spacing;
     int tableSize;
     std::vector<int> cellStart;
     std::vector<int> cellEntries;
+    std::vector<int> cellOf;
     std::vector<int> queryIds;
     int querySize;
 
-    int hashCoords(int xi, int yi, int zi);
-    int intCoord(double coord);
+    int hashCoords(int xi, int yi, int zi) const;
+    int intCoord(double coord) const;
     int hashPos(std::vector<double>& pos, int nr);
 
 public:
     ParticleHashGrid(double spacing, int maxNumObjects);
 
-    void create(std::vector<Particle *> particles);
+    // hashing runs on the pool if given, filling the cells is sequential
+    void create(const std::vector<Particle *>& particles, ThreadPool* pool = nullptr);
     void query(const std::vector<Particle *>& particles, int i, double maxDist);
-    std::vector<int> getNeighbors(){return queryIds;};
+    // thread safe version, candidates go to ids and their number is returned
+    int query(const std::vector<Particle *>& particles, int i, double maxDist, std::vector<int>& ids) const;
+    const std::vector<int>& getNeighbors() const {return queryIds;};
     int getQuerySize(){return querySize;};
 };
 
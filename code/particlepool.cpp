@@ -0,0 +1,60 @@
+#include "particlepool.h"
+
+ParticlePool::ParticlePool(int capacity) {
+    storage.resize(capacity);
+    for (int i = 0; i < capacity; i++) {
+        storage[i] = new Particle();
+    }
+    active.reserve(capacity);
+    freeList.reserve(capacity);
+    clear();
+}
+
+ParticlePool::~ParticlePool() {
+    for (Particle* p : storage) {
+        delete p;
+    }
+}
+
+Particle* ParticlePool::spawn() {
+    if (freeList.empty()) return nullptr;
+
+    Particle* p = freeList.back();
+    freeList.pop_back();
+
+    // recycled particles must not keep anything from their previous life
+    p->reset();
+    p->id = active.size();
+    active.push_back(p);
+    return p;
+}
+
+void ParticlePool::retire(int slot) {
+    freeList.push_back(active[slot]);
+    active[slot] = active.back();
+    active[slot]->id = slot;
+    active.pop_back();
+}
+
+void ParticlePool::grow(int newCapacity) {
+    int old = capacity();
+    if (newCapacity <= old) return;
+
+    storage.resize(newCapacity);
+    for (int i = old; i < newCapacity; i++) {
+        storage[i] = new Particle();
+    }
+    active.reserve(newCapacity);
+    freeList.reserve(newCapacity);
+    // below the free particles already there, so those are still handed out first
+    freeList.insert(freeList.begin(), storage.rbegin(), storage.rbegin() + (newCapacity - old));
+}
+
+void ParticlePool::clear() {
+    active.clear();
+    freeList.clear();
+    // reversed so particles are handed out in storage order
+    for (int i = capacity() - 1; i >= 0; i--) {
+        freeList.push_back(storage[i]);
+    }
+}
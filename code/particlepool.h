@@ -0,0 +1,38 @@
+#ifndef PARTICLEPOOL_H
+#define PARTICLEPOOL_H
+
+#include "particle.h"
+#include <vector>
+
+/*
+ *  Fixed number of preallocated particles. spawn hands out a free one and retire gives it
+ *  back, so streaming simulations never allocate after construction.
+ *  The active particles are kept compact: retiring moves the last active particle into the
+ *  freed slot, and the id of an active particle is always its slot index.
+ *  grow adds particles for the rare owner that cannot know its size up front, the
+ *  particles already handed out keep their addresses.
+ */
+class ParticlePool
+{
+public:
+    explicit ParticlePool(int capacity);
+    ~ParticlePool();
+
+    // reset particle, or nullptr if the pool is full
+    Particle* spawn();
+    void retire(int slot);
+    void clear();
+    // at least this many particles, never shrinks
+    void grow(int capacity);
+
+    const std::vector<Particle*>& getParticles() const { return active; }
+    int size() const { return static_cast<int>(active.size()); }
+    int capacity() const { return static_cast<int>(storage.size()); }
+
+protected:
+    std::vector<Particle*> storage;
+    std::vector<Particle*> active;
+    std::vector<Particle*> freeList;
+};
+
+#endif // PARTICLEPOOL_H
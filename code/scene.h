@@ -3,6 +3,7 @@
 
 #include <QWidget>
 #include <QMouseEvent>
+#include <QStringList>
 #include "camera.h"
 
 class Scene : public QObject
@@ -25,6 +26,9 @@ public:
     virtual void getSceneBounds(Vec3& bmin, Vec3& bmax) = 0;
     virtual unsigned int getNumParticles() { return 0; }
 
+    // extra lines for the stats overlay
+    virtual QStringList getStats() { return QStringList(); }
+
     virtual QWidget* sceneUI() = 0;
 };
 
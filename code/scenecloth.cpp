@@ -1,8 +1,10 @@
 #include "scenecloth.h"
 #include "glutils.h"
 #include "model.h"
+#include "clothbuilder.h"
 #include <QOpenGLFunctions_3_3_Core>
 #include <QOpenGLBuffer>
+#include <algorithm>
 #include <cmath>
 
 
@@ -24,9 +26,6 @@ SceneCloth::~SceneCloth() {
 
     system.deleteParticles();
     if (fGravity)  delete fGravity;
-    for (ForceSpring* f : springsStretch) delete f;
-    for (ForceSpring* f : springsShear) delete f;
-    for (ForceSpring* f : springsBend) delete f;
 }
 
 void SceneCloth::initialize() {
@@ -61,11 +60,8 @@ void SceneCloth::initialize() {
     vaoMesh = new QOpenGLVertexArrayObject();
     vaoMesh->create();
     vaoMesh->bind();
-    vboMesh = new QOpenGLBuffer(QOpenGLBuffer::Type::VertexBuffer);
-    vboMesh->create();
+    vboMesh = new glutils::DynamicBuffer(3*sizeof(float), 1000*1000); // sync with widget max particles
     vboMesh->bind();
-    vboMesh->setUsagePattern(QOpenGLBuffer::UsagePattern::DynamicDraw);
-    vboMesh->allocate(1000*1000*3*3*sizeof(float)); // sync with widget max particles
     shaderCloth->setAttributeBuffer("vertex", GL_FLOAT, 0, 3, 0);
     shaderCloth->enableAttributeArray("vertex");
     iboMesh = new QOpenGLBuffer(QOpenGLBuffer::Type::IndexBuffer);
@@ -89,6 +85,8 @@ void SceneCloth::initialize() {
     colliderCube = ColliderAABB(cubePos, Vec3(cubeSide, cubeSide, cubeSide));
     //colliderCube.setFromCenterSize(Vec3(-60,30,0), Vec3(60, 40, 60));
     //colliderWalls.setFromCenterSize(Vec3(0, 0, 0), Vec3(200, 200, 200));
+    colliders = { &colliderFloor, &colliderBall, &colliderCube };
+    broadphase.setColliders(colliders);
 
     integrator.kd = 0.95;
 }
@@ -104,12 +102,10 @@ void SceneCloth::reset()
     // reset forces
     system.clearForces();
     fGravity->clearInfluencedParticles();
-    for (Force* f : springsStretch) delete f;
     springsStretch.clear();
-    for (ForceSpring* f : springsShear) delete f;
     springsShear.clear();
-    for (ForceSpring* f : springsBend) delete f;
     springsBend.clear();
+    springPool.clear();
 
     // cloth props
     Vec2 dims = widget->getDimensions();
@@ -122,217 +118,162 @@ void SceneCloth::reset()
     double edgeY = dims[1]/numParticlesY;
     particleRadius = widget->getParticleRadius();
 
-    // create particles
-    numParticles = numParticlesX * numParticlesY;
-    fixedParticle = std::vector<bool>(numParticles, false);
-
-    for (int i = 0; i < numParticlesX; i++) {
-        for (int j = 0; j < numParticlesY; j++) {
-
-            int idx = i*numParticlesY + j;
-
-            // TODO: you can play here with different start positions and/or fixed particles
-            fixedParticle[idx] = false;
-            double tx = i*edgeX - 0.5*clothWidth;
-            double ty = j*edgeY - 0.5*clothHeight;
-            Vec3 pos = Vec3(ty+edgeY, 80, 70 - tx - edgeX - 70);
-
-            Particle* p = new Particle();
-            p->id = idx;
-            p->pos = pos;
-            p->prevPos = pos;
-            p->vel = Vec3(0,0,0);
-            p->mass = 1;
-            p->radius = particleRadius;
-            p->color = Vec3(235/255.0, 51/255.0, 36/255.0);
-            p->isFixed = false;
-
-            system.addParticle(p);
-            fGravity->addInfluencedParticle(p);
+    // cloth mesh: the particle grid, or a sphere with about as many vertices
+    bool grid = widget->getMesh() == 0;
+    Model mesh;
+    if (grid) {
+        std::vector<float> coords(3*numParticlesX*numParticlesY);
+        for (int i = 0; i < numParticlesX; i++) {
+            for (int j = 0; j < numParticlesY; j++) {
+                int idx = i*numParticlesY + j;
+                double tx = i*edgeX - 0.5*clothWidth;
+                double ty = j*edgeY - 0.5*clothHeight;
+                coords[3*idx  ] = ty + edgeY;
+                coords[3*idx+1] = 80;
+                coords[3*idx+2] = 70 - tx - edgeX - 70;
+            }
         }
-    }
-    fixedParticle[0] = true;
-    system.getParticle(0)->isFixed = true;
-    fixedParticle[numParticlesY-1] = true;
-    system.getParticle(numParticlesY-1)->isFixed = true;
-
-    // forces: gravity
-    system.addForce(fGravity);
-
-    // TODO: create spring forces
-    // Code for PROVOT layout
-
-    //Stretch springs
-
-    for (int i = 0; i < numParticlesX; i++) {
-        for (int j = 0; j < numParticlesY; j++) {
-            Particle* pij = system.getParticle(i*numParticlesY + j);
-
-            if(i != numParticlesX - 1 && j != numParticlesY - 1){
-                Particle* pij_i_plus = system.getParticle((i+1)*numParticlesY + j);
-                Particle* pij_j_plus = system.getParticle(i*numParticlesY + (j+1));
-
-                ForceSpring* s1 = new ForceSpring(widget->getStiffness(), widget->getDamping());
-                ForceSpring* s2 = new ForceSpring(widget->getStiffness(), widget->getDamping());
-
-                s1->addInfluencedParticle(pij);
-                s1->addInfluencedParticle(pij_i_plus);
-                s1->setL((pij_i_plus->pos - pij->pos).norm());
-
-                s2->addInfluencedParticle(pij);
-                s2->addInfluencedParticle(pij_j_plus);
-                s2->setL((pij_j_plus->pos - pij->pos).norm());
-
-                springsStretch.push_back(s1);
-                springsStretch.push_back(s2);
-                system.addForce(s1);
-                system.addForce(s2);
-            }else if (i == numParticlesX - 1 && j != numParticlesY - 1){
-                Particle* pij_j_plus = system.getParticle(i*numParticlesY + (j+1));
-
-                ForceSpring* s2 = new ForceSpring(widget->getStiffness(), widget->getDamping());
-                s2->addInfluencedParticle(pij);
-                s2->addInfluencedParticle(pij_j_plus);
-                s2->setL((pij_j_plus->pos - pij->pos).norm());
-
-                springsStretch.push_back(s2);
-                system.addForce(s2);
-            }else if(j == numParticlesY - 1 && j != numParticlesY - 1){
-                Particle* pij_i_plus = system.getParticle((i+1)*numParticlesY + j);
-
-                ForceSpring* s2 = new ForceSpring(widget->getStiffness(), widget->getDamping());
-                s2->addInfluencedParticle(pij);
-                s2->addInfluencedParticle(pij_i_plus);
-                s2->setL((pij_i_plus->pos - pij->pos).norm());
-
-                springsStretch.push_back(s2);
-                system.addForce(s2);
+        std::vector<unsigned int> tris;
+        tris.reserve((numParticlesX - 1)*(numParticlesY - 1)*2*3);
+        for (int i = 0; i < numParticlesX-1; i++) {
+            for (int j = 0; j < numParticlesY-1; j++) {
+                unsigned int a = i*numParticlesY + j;
+                unsigned int b = (i+1)*numParticlesY + j;
+                tris.insert(tris.end(), { a, b, a + 1, a + 1, b, b + 1 });
             }
         }
+        mesh = Model(coords, std::vector<float>(), tris);
     }
-
-    //Shear springs
-    for (int i = 0; i < numParticlesX; i++) {
-        for (int j = 0; j < numParticlesY; j++) {
-            Particle* pij = system.getParticle(i*numParticlesY + j);
-
-            if(i != numParticlesX - 1 && j != numParticlesY -1 && j != 0){ //Not on top and not on sides
-                Particle* p_top_left = system.getParticle((i+1)*numParticlesY + (j-1));
-                Particle* p_top_right = system.getParticle((i+1)*numParticlesY + (j+1));
-
-                ForceSpring* s1 = new ForceSpring(widget->getStiffness(), widget->getDamping());
-                s1->addInfluencedParticle(pij);
-                s1->addInfluencedParticle(p_top_left);
-                s1->setL((p_top_left->pos - pij->pos).norm());
-
-                ForceSpring* s2 = new ForceSpring(widget->getStiffness(), widget->getDamping());
-                s2->addInfluencedParticle(pij);
-                s2->addInfluencedParticle(p_top_right);
-                s2->setL((p_top_right->pos - pij->pos).norm());
-
-                springsShear.push_back(s1);
-                springsShear.push_back(s2);
-
-                system.addForce(s1);
-                system.addForce(s2);
-            }else if(i != numParticlesX - 1 && j == numParticlesY - 1){ //Right side but not at the top
-                Particle* p_top_left = system.getParticle((i+1)*numParticlesY + (j-1));
-
-                ForceSpring* s1 = new ForceSpring(widget->getStiffness(), widget->getDamping());
-                s1->addInfluencedParticle(pij);
-                s1->addInfluencedParticle(p_top_left);
-                s1->setL((p_top_left->pos - pij->pos).norm());
-
-                springsShear.push_back(s1);
-                system.addForce(s1);
-            }else if(i != numParticlesX - 1 && j == 0){ //Left side but not at the top
-                Particle* p_top_right = system.getParticle((i+1)*numParticlesY + (j+1));
-
-                ForceSpring* s1 = new ForceSpring(widget->getStiffness(), widget->getDamping());
-                s1->addInfluencedParticle(pij);
-                s1->addInfluencedParticle(p_top_right);
-                s1->setL((p_top_right->pos - pij->pos).norm());
-
-                springsShear.push_back(s1);
-                system.addForce(s1);
-            }
+    else {
+        // 10*4^s + 2 vertices after s subdivisions, kept under the buffer sizes
+        int subdivisions = 0;
+        while (subdivisions < 8 && 10*(1 << 2*subdivisions) + 2 < numParticlesX*numParticlesY) subdivisions++;
+        Model sphere = Model::createIcosphere(subdivisions);
+        std::vector<float> coords = sphere.getVertexCoords();
+        for (unsigned int i = 0; i < coords.size(); i++) {
+            coords[i] = 0.5f*clothWidth*coords[i] + (i%3 == 1 ? 80.0f : 0.0f);
         }
+        mesh = Model(coords, sphere.getNormals(), sphere.getIndices());
     }
 
-    //Bend springs
-
-    for (int i = 0; i < numParticlesX; i++) {
-        for (int j = 0; j < numParticlesY; j++) {
-            Particle* pij = system.getParticle(i*numParticlesY + j);
-
-            if(i <= numParticlesX - 3 && j <= numParticlesY - 3){
-                Particle* pij_i_plus = system.getParticle((i+2)*numParticlesY + j);
-                Particle* pij_j_plus = system.getParticle(i*numParticlesY + (j+2));
-
-                ForceSpring* s1 = new ForceSpring(widget->getStiffness(), widget->getDamping());
-                ForceSpring* s2 = new ForceSpring(widget->getStiffness(), widget->getDamping());
-
-                s1->addInfluencedParticle(pij);
-                s1->addInfluencedParticle(pij_i_plus);
-                s1->setL((pij_i_plus->pos - pij->pos).norm());
-
-                s2->addInfluencedParticle(pij);
-                s2->addInfluencedParticle(pij_j_plus);
-                s2->setL((pij_j_plus->pos - pij->pos).norm());
-
-                springsBend.push_back(s1);
-                springsBend.push_back(s2);
-                system.addForce(s1);
-                system.addForce(s2);
-            }else if (i > numParticlesX - 3 && j <= numParticlesY - 3){
-                Particle* pij_j_plus = system.getParticle(i*numParticlesY + (j+2));
-
-                ForceSpring* s2 = new ForceSpring(widget->getStiffness(), widget->getDamping());
-                s2->addInfluencedParticle(pij);
-                s2->addInfluencedParticle(pij_j_plus);
-                s2->setL((pij_j_plus->pos - pij->pos).norm());
+    // create particles
+    numParticles = mesh.numVertices();
+    fixedParticle = std::vector<bool>(numParticles, false);
+    const std::vector<float>& coords = mesh.getVertexCoords();
+    for (int idx = 0; idx < numParticles; idx++) {
+        // TODO: you can play here with different start positions and/or fixed particles
+        Vec3 pos = Vec3(coords[3*idx], coords[3*idx+1], coords[3*idx+2]);
+
+        Particle* p = new Particle();
+        p->id = idx;
+        p->pos = pos;
+        p->prevPos = pos;
+        p->vel = Vec3(0,0,0);
+        p->mass = 1;
+        p->radius = particleRadius;
+        p->color = Vec3(235/255.0, 51/255.0, 36/255.0);
+        p->isFixed = false;
 
-                springsBend.push_back(s2);
-                system.addForce(s2);
-            }else if(j > numParticlesY - 3 && i <= numParticlesX - 3){
-                Particle* pij_i_plus = system.getParticle((i+2)*numParticlesY + j);
+        system.addParticle(p);
+        fGravity->addInfluencedParticle(p);
+    }
+    if (grid) {
+        fixedParticle[0] = true;
+        system.getParticle(0)->isFixed = true;
+        fixedParticle[numParticlesY-1] = true;
+        system.getParticle(numParticlesY-1)->isFixed = true;
+    }
 
-                ForceSpring* s2 = new ForceSpring(widget->getStiffness(), widget->getDamping());
-                s2->addInfluencedParticle(pij);
-                s2->addInfluencedParticle(pij_i_plus);
-                s2->setL((pij_i_plus->pos - pij->pos).norm());
+    // forces: gravity
+    system.addForce(fGravity);
 
-                springsBend.push_back(s2);
-                system.addForce(s2);
-            }
+    // springs from the mesh edges, all in one block
+    ClothBuilder builder;
+    builder.build(mesh);
+    springPool.reserve(builder.getStretch().size() + builder.getShear().size() + builder.getBend().size());
+    auto addSprings = [&](const std::vector<ClothBuilder::Spring>& springs, std::vector<ForceSpring*>& list) {
+        list.reserve(springs.size());
+        for (const ClothBuilder::Spring& s : springs) {
+            springPool.emplace_back(system.getParticle(s.a), system.getParticle(s.b),
+                                    widget->getStiffness(), widget->getDamping());
+            ForceSpring* f = &springPool.back();
+            f->setL(s.rest);
+            list.push_back(f);
+            system.addForce(f);
         }
-    }
+    };
+    addSprings(builder.getStretch(), springsStretch);
+    addSprings(builder.getShear(), springsShear);
+    addSprings(builder.getBend(), springsBend);
 
     updateSprings();
+    if (grid) multigrid.setGrid(system.getParticles(), numParticlesX, numParticlesY);
+    else      multigrid.clear();
 
-    // update index buffer
+    // update index buffer, the triangles are kept for the self collisions
     iboMesh->bind();
-    numMeshIndices = (numParticlesX - 1)*(numParticlesY - 1)*2*3;
-    int* indices = new int[numMeshIndices];
-    int idx = 0;
-    for (int i = 0; i < numParticlesX-1; i++) {
-        for (int j = 0; j < numParticlesY-1; j++) {
-            indices[idx  ] = i*numParticlesY + j;
-            indices[idx+1] = (i+1)*numParticlesY + j;
-            indices[idx+2] = i*numParticlesY + j + 1;
-            indices[idx+3] = i*numParticlesY + j + 1;
-            indices[idx+4] = (i+1)*numParticlesY + j;
-            indices[idx+5] = (i+1)*numParticlesY + j + 1;
-            idx += 6;
-        }
-    }
-    void* bufptr = iboMesh->mapRange(0, numMeshIndices*sizeof(int),
+    meshIndices = mesh.getIndices();
+    numMeshIndices = meshIndices.size();
+    void* bufptr = iboMesh->mapRange(0, numMeshIndices*sizeof(unsigned int),
                                      QOpenGLBuffer::RangeInvalidateBuffer | QOpenGLBuffer::RangeWrite);
-    memcpy(bufptr, (void*)(indices), numMeshIndices*sizeof(int));
+    memcpy(bufptr, (void*)(meshIndices.data()), numMeshIndices*sizeof(unsigned int));
     iboMesh->unmap();
     iboMesh->release();
-    delete[] indices;
     glutils::checkGLError();
+
+    // picking accepts rays within half a rest edge of a particle, at least its radius
+    double meanEdge = 0;
+    for (const ClothBuilder::Spring& s : builder.getStretch()) meanEdge += s.rest;
+    meanEdge /= std::max<size_t>(1, builder.getStretch().size());
+    pickTolerance = std::max(0.5*meanEdge, particleRadius);
+
+    // collider broadphase patches, tiles of the particle grid or cells of a few rest edges
+    std::vector<int> particlePatch(numParticles);
+    if (grid) {
+        int patchesY = (numParticlesY + PatchSize - 1)/PatchSize;
+        for (int i = 0; i < numParticlesX; i++) {
+            for (int j = 0; j < numParticlesY; j++) {
+                particlePatch[i*numParticlesY + j] = (i/PatchSize)*patchesY + j/PatchSize;
+            }
+        }
+    }
+    else {
+        particlePatch = ClothBroadphase::cellPatches(system.getParticles(), PatchSize*meanEdge);
+    }
+    broadphase.setPatches(particlePatch);
+    broadphase.update(system.getParticles());
+
+    // resting patches sleep: slower than 1.5 units/s, above the jitter of gravity against
+    // a contact at the usual time step, for 20 steps
+    sleep.setPatches(particlePatch, meshIndices);
+    sleep.setThreshold(0.5*1.5*1.5);
+    sleep.setSleepSteps(20);
+    listAwakeSprings();
+
+    selfCollision.setMesh(system.getParticles(), meshIndices);
+    selfCollision.setThickness(particleRadius);
+    numSelfContacts = 0;
+
+    // the springs on the triangle edges tear, the others lie over them
+    std::vector<ForceSpring*> edgeSprings(springsStretch);
+    std::vector<ForceSpring*> overSprings;
+    for (unsigned int k = 0; k < springsShear.size(); k++) {
+        (builder.getShear()[k].edge ? edgeSprings : overSprings).push_back(springsShear[k]);
+    }
+    overSprings.insert(overSprings.end(), springsBend.begin(), springsBend.end());
+    tearing.setMesh(meshIndices, edgeSprings, overSprings);
+    dirtyTriangles.clear();
+
+    // air density relative to the cloth mass per area, a face-on wind of 20 about balances gravity
+    double area = 0;
+    for (unsigned int t = 0; t + 2 < meshIndices.size(); t += 3) {
+        const Vec3& x0 = system.getParticle(meshIndices[t])->pos;
+        const Vec3& x1 = system.getParticle(meshIndices[t + 1])->pos;
+        const Vec3& x2 = system.getParticle(meshIndices[t + 2])->pos;
+        area += 0.5*(x1 - x0).cross(x2 - x0).norm();
+    }
+    wind.setMesh(meshIndices, numParticles);
+    wind.setDensity(area > 0 ? 0.05*numParticles/area : 0);
 }
 
 
@@ -367,13 +308,40 @@ void SceneCloth::updateSimParams()
     for (Particle* p : system.getParticles()) {
         p->radius = widget->getParticleRadius();
     }
+    selfCollision.setThickness(widget->getParticleRadius());
 
     showParticles = widget->showParticles();
+
+    wakeCloth();
 }
 
 void SceneCloth::freeAnchors()
 {
     fixedParticle = std::vector<bool>(numParticles, false);
+    wakeCloth();
+}
+
+void SceneCloth::wakeCloth()
+{
+    if (sleep.getNumSleeping() == 0) return;
+    sleep.wakeAll(system.getParticles());
+    listAwakeSprings();
+}
+
+void SceneCloth::listAwakeSprings()
+{
+    sleep.getAwakeSprings(springsStretch, awakeStretch);
+    sleep.getAwakeSprings(springsShear, awakeShear);
+    sleep.getAwakeSprings(springsBend, awakeBend);
+
+    sleepingSpringEnds.clear();
+    const std::vector<char>& asleep = sleep.getParticleAsleep();
+    for (const std::vector<ForceSpring*>* list : { &awakeStretch, &awakeShear, &awakeBend }) {
+        for (ForceSpring* f : *list) {
+            if (asleep[f->getParticle0()->id]) sleepingSpringEnds.push_back(f->getParticle0()->id);
+            if (asleep[f->getParticle1()->id]) sleepingSpringEnds.push_back(f->getParticle1()->id);
+        }
+    }
 }
 
 void SceneCloth::paint(const Camera& camera)
@@ -457,20 +425,33 @@ void SceneCloth::paint(const Camera& camera)
 
     shaderPhong->release();
 
-    // update cloth mesh VBO coords
-    vboMesh->bind();
-    float* pos = new float[3*numParticles];
+    // update cloth mesh VBO coords, straight into the next ring region
+    float* pos = static_cast<float*>(vboMesh->map(numParticles));
     for (int i = 0; i < numParticles; i++) {
-        pos[3*i  ] = system.getParticle(i)->pos.x();
-        pos[3*i+1] = system.getParticle(i)->pos.y();
-        pos[3*i+2] = system.getParticle(i)->pos.z();
+        const Vec3& p = system.getParticle(i)->pos;
+        pos[3*i  ] = p.x();
+        pos[3*i+1] = p.y();
+        pos[3*i+2] = p.z();
     }
-    void* bufptr = vboMesh->mapRange(0, 3*numParticles*sizeof(float),
-                       QOpenGLBuffer::RangeInvalidateBuffer | QOpenGLBuffer::RangeWrite);
-    memcpy(bufptr, (void*)(pos), 3*numParticles*sizeof(float));
     vboMesh->unmap();
-    vboMesh->release();
-    delete[] pos;
+
+    // upload the triangles torn since the last frame, one write per run of consecutive ones
+    if (!dirtyTriangles.empty()) {
+        std::sort(dirtyTriangles.begin(), dirtyTriangles.end());
+        vaoMesh->bind();
+        iboMesh->bind();
+        unsigned int first = 0;
+        while (first < dirtyTriangles.size()) {
+            unsigned int last = first + 1;
+            while (last < dirtyTriangles.size() && dirtyTriangles[last] <= dirtyTriangles[last-1] + 1) last++;
+            int t0 = dirtyTriangles[first];
+            int count = dirtyTriangles[last-1] + 1 - t0;
+            iboMesh->write(3*t0*sizeof(unsigned int), &meshIndices[3*t0], 3*count*sizeof(unsigned int));
+            first = last;
+        }
+        vaoMesh->release();
+        dirtyTriangles.clear();
+    }
 
     // draw mesh
     shaderCloth->bind();
@@ -487,8 +468,9 @@ void SceneCloth::paint(const Camera& camera)
     shaderCloth->setUniformValueArray("lightPos", lightPosCam, numLights);
     shaderCloth->setUniformValueArray("lightColor", lightColor, numLights);
     vaoMesh->bind();
-    glFuncs->glDrawElements(GL_TRIANGLES, numMeshIndices, GL_UNSIGNED_INT, 0);
+    glFuncs->glDrawElementsBaseVertex(GL_TRIANGLES, numMeshIndices, GL_UNSIGNED_INT, 0, vboMesh->getFirstVertex());
     vaoMesh->release();
+    vboMesh->fence();
     shaderCloth->release();
 
     glutils::checkGLError();
@@ -505,10 +487,28 @@ void SceneCloth::update(double dt)
         }
     }
 
+    // sleeping: changing forces wake the cloth, so does the user, and with the whole cloth
+    // at rest there is nothing to step
+    bool sleeping = widget->sleeping();
+    Vec3 windVelocity = widget->wind() ? Vec3(widget->getWindSpeed(), 0, 0) : Vec3(0, 0, 0);
+    if (!sleeping || windVelocity != sleepWind) {
+        wakeCloth();
+        sleepWind = windVelocity;
+    }
+    if (selectedParticle >= 0 && sleep.wakeParticle(system.getParticles(), selectedParticle)) {
+        listAwakeSprings();
+    }
+    if (sleeping && sleep.allAsleep()) return;
+
     // integration step
-    Vecd ppos = system.getPositions();
-    integrator.step(system, dt);
-    system.setPreviousPositions(ppos);
+    if (sleeping) {
+        integrator.step(system, dt, sleep.getAwakeParticles());
+    }
+    else {
+        Vecd ppos = system.getPositions();
+        integrator.step(system, dt);
+        system.setPreviousPositions(ppos);
+    }
 
     // user interaction
     if (selectedParticle >= 0) {
@@ -518,61 +518,122 @@ void SceneCloth::update(double dt)
         p->vel = Vec3(0,0,0);
 
         // TODO: test and resolve for collisions during user movement
-        for (Particle* p : system.getParticles()) {
-            // TODO: test and resolve collisions
-            if(colliderFloor.testCollision(p)){
-                colliderFloor.resolveCollision(p, colBounce, colFriction);
-            }
-            if(colliderBall.testCollision(p)){
-                colliderBall.resolveCollision(p, colBounce, colFriction);
-            }
-            if(colliderCube.testCollision(p)){
-                colliderCube.resolveCollision(p, colBounce, colFriction);
-            }
-        }
+        resolveCollisions();
     }
 
-    for (Particle* p : system.getParticles()) {
-        // TODO: test and resolve collisions
-        if(colliderFloor.testCollision(p)){
-            colliderFloor.resolveCollision(p, colBounce, colFriction);
-        }
-        if(colliderBall.testCollision(p)){
-            colliderBall.resolveCollision(p, colBounce, colFriction);
-        }
-        if(colliderCube.testCollision(p)){
-            colliderCube.resolveCollision(p, colBounce, colFriction);
-        }
-    }
+    resolveCollisions();
 
     // TODO: relaxation
+    // coarse levels first, they carry the stretch across the grid in one step
+    if (widget->multigrid()) multigrid.solve(system.getParticles());
+
+    this->relaxationStep(sleeping ? awakeStretch : springsStretch);
+    this->relaxationStep(sleeping ? awakeShear : springsShear);
+    this->relaxationStep(sleeping ? awakeBend : springsBend);
 
-    this->relaxationStep(springsStretch);
-    this->relaxationStep(springsShear);
-    this->relaxationStep(springsBend);
+    // self collisions after the relaxation, which may pull the cloth through itself
+    const std::vector<char>* asleep = sleeping ? &sleep.getParticleAsleep() : nullptr;
+    numSelfContacts = widget->selfCollisions() ? selfCollision.resolve(system.getParticles(), asleep) : 0;
 
     // collisions
-    for (Particle* p : system.getParticles()) {
-        // TODO: test and resolve collisions
-        if(colliderFloor.testCollision(p)){
-            colliderFloor.resolveCollision(p, colBounce, colFriction);
-        }
-        if(colliderBall.testCollision(p)){
-            colliderBall.resolveCollision(p, colBounce, colFriction);
+    resolveCollisions();
+
+    // tearing: the torn springs leave the coarse levels, their triangles the mesh
+    if (widget->tearing()) {
+        tearing.setMaxStrain(widget->getTearStrain());
+        tornSprings.clear();
+        removedTriangles.clear();
+        tearing.tear(system.getParticles(), tornSprings, removedTriangles, asleep);
+        for (ForceSpring* f : tornSprings) {
+            multigrid.breakEdge(f->getParticle0()->id, f->getParticle1()->id);
         }
-        if(colliderCube.testCollision(p)){
-            colliderCube.resolveCollision(p, colBounce, colFriction);
+        for (int t : removedTriangles) {
+            // degenerate triangles are not rasterized, the buffer keeps its layout
+            meshIndices[3*t + 1] = meshIndices[3*t + 2] = meshIndices[3*t];
+            selfCollision.removeTriangle(t);
         }
+        dirtyTriangles.insert(dirtyTriangles.end(), removedTriangles.begin(), removedTriangles.end());
     }
 
+    if (sleeping && sleep.update(system.getParticles(), dt)) listAwakeSprings();
+
     // needed after we have done collisions and relaxation, since spring forces depend on p and v
-    system.updateForces();
+    if (sleeping) {
+        // the system holds gravity and the springs, here on the awake particles only
+        Vec3 g = fGravity->getAcceleration();
+        for (int i : sleep.getAwakeParticles()) {
+            Particle* p = system.getParticle(i);
+            p->force = p->mass*g;
+        }
+        for (ForceSpring* f : awakeStretch) f->apply();
+        for (ForceSpring* f : awakeShear) f->apply();
+        for (ForceSpring* f : awakeBend) f->apply();
+        // the sleeping ends took the other half, they are not integrated
+        for (int i : sleepingSpringEnds) system.getParticle(i)->force = Vec3(0, 0, 0);
+    }
+    else {
+        system.updateForces();
+    }
+
+    // wind on the triangles, on top of the forces of the system
+    if (widget->wind()) {
+        wind.setWind(Vec3(widget->getWindSpeed(), 0, 0));
+        wind.apply(system.getParticles(), meshIndices, dt, asleep);
+    }
+}
+
+void SceneCloth::resolveCollisions()
+{
+    // only the particles of the patches near each collider get the exact test, sleeping
+    // patches are left out. The patches moved by a collider are refit before the next one.
+    const std::vector<char>* frozen = widget->sleeping() ? &sleep.getPatchAsleep() : nullptr;
+    broadphase.update(system.getParticles(), frozen);
+    collisionMoved.clear();
+    for (unsigned int c = 0; c < colliders.size(); c++) {
+        broadphase.refit(system.getParticles(), collisionMoved, c, frozen);
+        collisionMoved.clear();
+        for (int i : broadphase.getCandidates(c)) {
+            Particle* p = system.getParticle(i);
+            if (colliders[c]->testCollision(p)) {
+                colliders[c]->resolveCollision(p, colBounce, colFriction);
+                collisionMoved.push_back(i);
+            }
+        }
+    }
+    // the bounds stay current for picking, no collider is left to list candidates for
+    broadphase.refit(system.getParticles(), collisionMoved, int(colliders.size()), frozen);
+}
+
+QStringList SceneCloth::getStats() {
+    QStringList stats;
+    stats << "Collider candidates: floor " + QString::number(broadphase.getCandidates(0).size())
+             + ", ball " + QString::number(broadphase.getCandidates(1).size())
+             + ", cube " + QString::number(broadphase.getCandidates(2).size())
+             + " (" + QString::number(broadphase.getNumPatches()) + " patches)";
+    if (widget->sleeping()) {
+        stats << "Sleeping patches: " + QString::number(sleep.getNumSleeping()) + " of "
+                 + QString::number(sleep.getNumPatches());
+    }
+    if (widget->multigrid()) {
+        stats << "Multigrid levels: " + QString::number(multigrid.getNumLevels());
+    }
+    if (widget->tearing()) {
+        stats << "Torn springs: " + QString::number(tearing.getNumBroken()) + ", triangles removed: "
+                 + QString::number(tearing.getNumRemovedTriangles());
+    }
+    if (widget->selfCollisions()) {
+        stats << "Self contacts: " + QString::number(numSelfContacts) + " ("
+                 + QString::number(selfCollision.getNumPointTriangle()) + " point-triangle, "
+                 + QString::number(selfCollision.getNumEdgeEdge()) + " edge-edge)";
+    }
+    return stats;
 }
 
 void SceneCloth::relaxationStep(std::vector<ForceSpring*> forces){
     for (ForceSpring* f : forces) {
-        Particle* p0 = f->getInfluencedParticles()[0];
-        Particle* p1 = f->getInfluencedParticles()[1];
+        if (f->isBroken()) continue;
+        Particle* p0 = f->getParticle0();
+        Particle* p1 = f->getParticle1();
         double distance = (p0->pos - p1->pos).norm();
 
         //std::cout << "distance: " << distance << std::endl;
@@ -604,19 +665,8 @@ void SceneCloth::mousePressed(const QMouseEvent* e, const Camera& cam)
         Vec3 rayDir = cam.getRayDir(grabX, grabY);
         Vec3 origin = cam.getPos();
 
-        selectedParticle = -1;
-        for (int i = 0; i < numParticles; i++) {
-            // TODO: point-ray dist to check if we select one particle
-            Vec3 camPartDirection = (system.getParticle(i)->pos - origin).normalized();
-
-            if(abs(camPartDirection.x() - rayDir.normalized().x()) < 0.01 &&
-                abs(camPartDirection.y() - rayDir.normalized().y()) < 0.01 &&
-                abs(camPartDirection.z() - rayDir.normalized().z()) < 0.01){
-
-                selectedParticle = i;
-                break;
-            }
-        }
+        // particle closest to the ray, through the broadphase patches
+        selectedParticle = broadphase.pick(system.getParticles(), origin, rayDir, pickTolerance);
 
         if (selectedParticle >= 0) {
             cursorWorldPos = system.getParticle(selectedParticle)->pos;
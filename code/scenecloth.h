@@ -5,10 +5,17 @@
 #include <QOpenGLVertexArrayObject>
 #include <QOpenGLBuffer>
 #include "scene.h"
+#include "glutils.h"
 #include "widgetcloth.h"
 #include "particlesystem.h"
 #include "integrators.h"
 #include "colliders.h"
+#include "clothbroadphase.h"
+#include "clothmultigrid.h"
+#include "clothselfcollision.h"
+#include "clothsleep.h"
+#include "clothtearing.h"
+#include "clothwind.h"
 
 class SceneCloth : public Scene
 {
@@ -33,6 +40,7 @@ public:
         bmax = Vec3( 100,  100,  100);
     }
     virtual unsigned int getNumParticles() { return system.getNumParticles(); }
+    virtual QStringList getStats();
 
     virtual QWidget* sceneUI() { return widget; }
 
@@ -43,6 +51,11 @@ public slots:
     void relaxationStep(std::vector<ForceSpring*> f);
 
 protected:
+    // floor, ball and cube against their broadphase candidates
+    void resolveCollisions();
+    void wakeCloth();
+    void listAwakeSprings();
+
     // ui
     WidgetCloth* widget = nullptr;
 
@@ -54,19 +67,30 @@ protected:
     QOpenGLVertexArrayObject* vaoCube    = nullptr;
     QOpenGLVertexArrayObject* vaoMesh    = nullptr;
     QOpenGLVertexArrayObject* vaoFloor   = nullptr;
-    QOpenGLBuffer* vboMesh = nullptr;
+    glutils::DynamicBuffer* vboMesh = nullptr;
     QOpenGLBuffer* iboMesh = nullptr;
     unsigned int numFacesSphereS = 0, numFacesSphereL = 0;
     unsigned int numMeshIndices = 0;
+    std::vector<unsigned int> meshIndices;
     bool showParticles = true;
 
     // physics
     IntegratorVerlet integrator; // TODO: pick a better one
     ParticleSystem system;
     ForceConstAcceleration* fGravity = nullptr;
+    std::vector<ForceSpring> springPool;    // storage of all the springs below
     std::vector<ForceSpring*> springsStretch;
     std::vector<ForceSpring*> springsShear;
     std::vector<ForceSpring*> springsBend;
+    // coarse levels of the particle grid, relaxed before the springs
+    ClothMultigrid multigrid;
+    // springs break past the tear strain, their triangles leave the index buffer
+    ClothTearing tearing;
+    std::vector<ForceSpring*> tornSprings;
+    std::vector<int> removedTriangles;
+    std::vector<int> dirtyTriangles;        // to upload on the next paint
+    // drag and lift of the wind on the triangles, along +x
+    ClothWind wind;
 
     // cloth properties
     std::vector<bool> fixedParticle;
@@ -87,9 +111,26 @@ protected:
     ColliderSphere colliderBall;
     ColliderAABB colliderCube;
     //ColliderHollowAABB  colliderWalls;
+    std::vector<const Collider*> colliders;
+
+    // particles near each collider, on tiles of PatchSize x PatchSize particles
+    static const int PatchSize = 8;
+    ClothBroadphase broadphase;
+    std::vector<int> collisionMoved;    // resolved by the colliders so far in this pass
+
+    // the cloth against itself, on the triangles of the mesh index buffer
+    ClothSelfCollision selfCollision;
+    int numSelfContacts = 0;
+
+    // resting patches are left out of the step, on the broadphase patches
+    ClothSleep sleep;
+    std::vector<ForceSpring*> awakeStretch, awakeShear, awakeBend;
+    std::vector<int> sleepingSpringEnds;    // sleeping particles tied to awake springs
+    Vec3 sleepWind = Vec3(0, 0, 0);     // wind the sleeping patches came to rest in
 
     // mouse interaction
     int grabX, grabY;
+    double pickTolerance = 1;
     Vec3 cursorWorldPos;
 };
 
@@ -17,8 +17,11 @@ SceneFluid::~SceneFluid() {
     if (vaoWall)  delete vaoWall;
     if (vaoSphereS)  delete vaoSphereS;
     if (vaoCube)  delete vaoCube;
-    if (fGravity) delete fGravity;
-    if (fNavierStockes) delete fNavierStockes;
+    if (vaoSurface) delete vaoSurface;
+    if (vboSurface) delete vboSurface;
+    if (surface)  delete surface;
+    if (simulation) delete simulation;
+    if (gridFluid) delete gridFluid;
 }
 
 void SceneFluid::initialize() {
@@ -45,163 +48,56 @@ void SceneFluid::initialize() {
     vaoCube = glutils::createVAO(shaderPhong, &cube);
     glutils::checkGLError();
 
-    numPartX = boundDimensions/4.f;
-    numPartY = boundDimensions/4.f;
-    numPartZ = boundDimensions/4.f;
-    if(widget->getComboBoxIndex() == 0){
-        numPartY = boundDimensions/3.f;
-        numPartZ = boundDimensions/2.f;
-    }
-    numParticles = numPartX * numPartY * numPartZ;
-
-//    particleHashGridGrid = new particleHashGridSystem(2.0f*particleRadius, numParticles);
-    particleHashGrid = new ParticleHashGrid(2.0f * particleRadius, numParticles);
-    integrator = new IntegratorSymplecticEuler();
-
-    fGravity = new ForceConstAcceleration();
-    fGravity->setAcceleration(Vec3(0, -9.81, 0));
-    fNavierStockes = new ForceNavierStockes(2.0f*particleRadius);
-
-    colliderFloor.setPlane(Vec3(0, 1, 0), 0);
-    colliderCeiling.setPlane(Vec3(0, 1, 0), -boundDimensions);
-    colliderWallLeft.setPlane(Vec3(0, 0, 1), 0);
-    colliderWallRight.setPlane(Vec3(0, 0, 1), -boundDimensions);
-    colliderWallDown.setPlane(Vec3(1, 0, 0), 0);
-    colliderWallUp.setPlane(Vec3(1, 0, 0), -boundDimensions);
-
-    for (int i = 0; i < numPartX/2; i++) {
-        for (int j = 0; j < numPartY; j++) {
-            for (int k = 0; k < numPartZ; k++) {
-                Vec3 pos = Vec3(i*particleSpacing, j*particleSpacing, k*particleSpacing);
-                Particle* p = new Particle();
-                p->id = (i * numPartY + j) * numPartZ + k;
-                p->pos = pos;
-                p->prevPos = pos;
-                p->vel = Vec3(0,0,0);
-                p->mass = MASS;
-                p->radius = particleRadius;
-                p->color = Vec3(45.0, 114.0, 178.0).normalized();
-                p->isFixed = false;
-
-                particles.push_back(p);
-                fGravity->addInfluencedParticle(p);
-                fNavierStockes->addInfluencedParticle(p);
-            }
-        }
-    }
-    for (int i = 0; i < numPartX/2; i++) {
-        for (int j = 0; j < numPartY; j++) {
-            for (int k = 0; k < numPartZ; k++) {
-                Vec3 pos = Vec3(i*particleSpacing + 32.f, j*particleSpacing, k*particleSpacing);
-                Particle* p = new Particle();
-                p->id = (i * numPartY + j) * numPartZ + k;
-                p->pos = pos;
-                p->prevPos = pos;
-                p->vel = Vec3(0,0,0);
-                p->mass = MASS;
-                p->radius = particleRadius;
-                p->color = Vec3(45.0, 114.0, 178.0).normalized();
-                p->isFixed = false;
-
-                particles.push_back(p);
-                fGravity->addInfluencedParticle(p);
-                fNavierStockes->addInfluencedParticle(p);
-            }
-        }
-    }
-    forces.push_back(fGravity);
-    forces.push_back(fNavierStockes);
+    // fluid surface VAO, the VBO is refilled whenever a new mesh is ready
+    vaoSurface = new QOpenGLVertexArrayObject();
+    vaoSurface->create();
+    vaoSurface->bind();
+    vboSurface = new glutils::DynamicBuffer(6*sizeof(float), 100000);
+    vboSurface->bind();
+    shaderPhong->setAttributeBuffer("vertex", GL_FLOAT, 0, 3, 6*sizeof(float));
+    shaderPhong->enableAttributeArray("vertex");
+    shaderPhong->setAttributeBuffer("normal", GL_FLOAT, 3*sizeof(float), 3, 6*sizeof(float));
+    shaderPhong->enableAttributeArray("normal");
+    vaoSurface->release();
+    glutils::checkGLError();
+
+    surface = new FluidSurface();
+    surface->setCellSize(particleRadius);
+    surface->setRadius(1.5f*particleSpacing);
+    surface->setIsoLevel(0.5);
+
+    pool = &ThreadPool::shared();
+    simulation = new FluidSimulation(pool);
+    gridFluid = new GridFluid(pool);
+
+    createParticles();
 }
 
 void SceneFluid::reset()
 {
     glutils::checkGLError();
 
-    deleteParticles();
+    createParticles();
+}
 
-    numPartX = boundDimensions/4.f;
-    numPartY = boundDimensions/4.f;
-    numPartZ = boundDimensions/4.f;
-    if(widget->getComboBoxIndex() == 0){
-        numPartY = boundDimensions/3.f;
-        numPartZ = boundDimensions/2.f;
+void SceneFluid::createParticles()
+{
+    FluidSetup setup;
+    switch (widget->getComboBoxIndex()) {
+        case 0:  setup = FluidSetup::doubleWall(boundDimensions, particleRadius); break;
+        case 1:  setup = FluidSetup::cube(boundDimensions, particleRadius); break;
+        default: setup = FluidSetup::river(boundDimensions, particleRadius); break;
     }
-    numParticles = numPartX * numPartY * numPartZ;
-
-    // reset forces
-    forces.clear();
-    fGravity->clearInfluencedParticles();
-    fNavierStockes->clearInfluencedParticles();
-
-    // create particles
-
-    if(widget->getComboBoxIndex() == 1){
-        for (int i = 0; i < numPartX; i++) {
-            for (int j = 0; j < numPartY; j++) {
-                for (int k = 0; k < numPartZ; k++) {
-                    Vec3 pos = Vec3(i*particleSpacing + 1.5f, j*particleSpacing + 1.5f, k*particleSpacing + 1.5f);
-                    Particle* p = new Particle();
-                    p->id = (i * numPartY + j) * numPartZ + k;
-                    p->pos = pos;
-                    p->prevPos = pos;
-                    p->vel = Vec3(0,0,0);
-                    p->mass = MASS;
-                    p->radius = particleRadius;
-                    p->color = Vec3(45.0, 114.0, 178.0).normalized();
-                    p->isFixed = false;
-
-                    particles.push_back(p);
-                    fGravity->addInfluencedParticle(p);
-                    fNavierStockes->addInfluencedParticle(p);
-                }
-            }
-        }
+
+    // one cell per particle spacing, so both engines resolve the tank alike
+    useGrid = widget->getEngine() == 3;
+    if (useGrid) {
+        simulation->clear();
+        gridFluid->load(setup, setup.particleSpacing);
     }
-    else if(widget->getComboBoxIndex() == 0){
-        for (int i = 0; i < numPartX/2; i++) {
-            for (int j = 0; j < numPartY; j++) {
-                for (int k = 0; k < numPartZ; k++) {
-                    Vec3 pos = Vec3(i*particleSpacing, j*particleSpacing, k*particleSpacing);
-                    Particle* p = new Particle();
-                    p->id = (i * numPartY + j) * numPartZ + k;
-                    p->pos = pos;
-                    p->prevPos = pos;
-                    p->vel = Vec3(0,0,0);
-                    p->mass = MASS;
-                    p->radius = particleRadius;
-                    p->color = Vec3(45.0, 114.0, 178.0).normalized();
-                    p->isFixed = false;
-
-                    particles.push_back(p);
-                    fGravity->addInfluencedParticle(p);
-                    fNavierStockes->addInfluencedParticle(p);
-                }
-            }
-        }
-        for (int i = 0; i < numPartX/2; i++) {
-            for (int j = 0; j < numPartY; j++) {
-                for (int k = 0; k < numPartZ; k++) {
-                    Vec3 pos = Vec3(i*particleSpacing + 32.f, j*particleSpacing, k*particleSpacing);
-                    Particle* p = new Particle();
-                    p->id = (i * numPartY + j) * numPartZ + k;
-                    p->pos = pos;
-                    p->prevPos = pos;
-                    p->vel = Vec3(0,0,0);
-                    p->mass = MASS;
-                    p->radius = particleRadius;
-                    p->color = Vec3(45.0, 114.0, 178.0).normalized();
-                    p->isFixed = false;
-
-                    particles.push_back(p);
-                    fGravity->addInfluencedParticle(p);
-                    fNavierStockes->addInfluencedParticle(p);
-                }
-            }
-        }
+    else {
+        simulation->load(setup);
     }
-
-    forces.push_back(fGravity);
-    forces.push_back(fNavierStockes);
 }
 
 void SceneFluid::paint(const Camera& camera)
@@ -232,14 +128,24 @@ void SceneFluid::paint(const Camera& camera)
 
     // draw the particle spheres
     QMatrix4x4 modelMat;
-    if (showParticles) {
+    if (widget->drawSurface() || useGrid) {
+        drawSurface(glFuncs);
+    }
+    else if (showParticles) {
         vaoSphereS->bind();
         shaderPhong->setUniformValue("matspec", 1.0f, 1.0f, 1.0f);
         shaderPhong->setUniformValue("matshin", 100.f);
-        for (int i = 0; i < numParticles; i++) {
-            const Particle* particle = particles.at(i);
+        const std::vector<Particle*>& particles = simulation->getParticles();
+        double restDensity = simulation->getNavierStokes()->getRestDensity();
+        for (unsigned int i = 0; i < particles.size(); i++) {
+            const Particle* particle = particles[i];
             Vec3   p = particle->pos;
             Vec3   c = particle->color;
+            if (widget->colorByDensity()) {
+                // blue up to rest density, red at twice the rest density
+                double t = std::min(std::max(particle->density / restDensity - 1.0, 0.0), 1.0);
+                c = Vec3(t, 0.2, 1.0 - t);
+            }
 
             modelMat = QMatrix4x4();
             modelMat.translate(p[0], p[1], p[2]);
@@ -292,58 +198,122 @@ void SceneFluid::paint(const Camera& camera)
 
 void SceneFluid::update(double dt)
 {
-    particleHashGrid->create(particles);
-
-    for(int i = 0; i < particles.size(); i++) {
-        particleHashGrid->query(particles, i, 2*particleRadius);
-        particles[i]->neighbors.clear();
-        for(int j= 0; j < particleHashGrid->getQuerySize(); j++) {
-            Particle* p = particles[particleHashGrid->getNeighbors().at(j)];
-            particles[i]->neighbors.insert(p);
-        }
-    }
+    pool->setNumThreads(widget->getNumThreads());
 
-    updateForces();
-    integrator->stepWithoutPS(particles, dt);
+    if (useGrid) {
+        gridFluid->step(dt);
 
-    for (Particle* p : particles) {
-        if (colliderFloor.testCollision(p)) {
-            colliderFloor.resolveCollision(p, colBounce, colFriction);
-        }
-        if (colliderCeiling.testCollision(p)) {
-            colliderCeiling.resolveCollision(p, colBounce, colFriction);
-        }
-        if (colliderWallLeft.testCollision(p)) {
-            colliderWallLeft.resolveCollision(p, colBounce, colFriction);
-        }
-        if (colliderWallRight.testCollision(p)) {
-            colliderWallRight.resolveCollision(p, colBounce, colFriction);
-        }
-        if (colliderWallUp.testCollision(p)) {
-            colliderWallUp.resolveCollision(p, colBounce, colFriction);
-        }
-        if (colliderWallDown.testCollision(p)) {
-            colliderWallDown.resolveCollision(p, colBounce, colFriction);
-        }
+        // the dye density is the surface field, cell centers are half a cell in. It is only
+        // copied when the extraction is idle.
+        double h = gridFluid->getCellSize();
+        surface->requestUpdate(gridFluid->getDensity(), gridFluid->getNx(), gridFluid->getNy(), gridFluid->getNz(),
+                               gridFluid->getOrigin() + Vec3(0.5*h, 0.5*h, 0.5*h), h);
+        return;
     }
 
-    for(int i = 0; i < particles.size(); i++) {
-        particleCollisions(particles.at(i));
+    // the hybrids replace the whole SPH step, the SPH settings are kept for switching back.
+    // The grid engine only takes over on reset, until then SPH keeps running.
+    int engine = widget->getEngine();
+    simulation->setEngine(engine == 1 ? FluidSimulation::EngineFLIP :
+                          engine == 2 ? FluidSimulation::EngineAPIC : FluidSimulation::EngineSPH);
+    bool sph = simulation->getEngine() == FluidSimulation::EngineSPH;
+
+    ForceNavierStockes* fNavierStockes = simulation->getNavierStokes();
+    fNavierStockes->setSolver(widget->getSolver() == 1 ? ForceNavierStockes::PCISPH : ForceNavierStockes::WCSPH);
+    fNavierStockes->setDensityTolerance(widget->getDensityTolerance());
+    fNavierStockes->setMaxIterations(widget->getMaxIterations());
+    // the combo box follows the order of ForceNavierStockes::Precision
+    fNavierStockes->setPrecision(ForceNavierStockes::Precision(widget->getPrecision()));
+    simulation->setAdaptive(sph && widget->adaptiveResolution());
+    simulation->setSleeping(sph && widget->sleeping());
+
+    simulation->step(dt);
+
+    // skipped while the previous mesh is still being extracted
+    if (widget->drawSurface()) {
+        surface->requestUpdate(simulation->getParticles());
     }
 }
 
-void SceneFluid::updateForces(){
-    for (unsigned int i = 0; i < particles.size(); i++) {
-        particles[i]->force = Vec3(0.0, 0.0, 0.0);
-    }
-    // apply forces
-    for (unsigned int i = 0; i < forces.size(); i++) {
-        forces[i]->apply();
+void SceneFluid::drawSurface(QOpenGLFunctions_3_3_Core* glFuncs)
+{
+    if (surface->takeMesh(surfaceVertices)) {
+        // the mesh comes from the extraction thread, one copy into the ring is left
+        numSurfaceVertices = surfaceVertices.size() / 6;
+        if (numSurfaceVertices > 0) {
+            void* bufptr = vboSurface->map(numSurfaceVertices);
+            memcpy(bufptr, (void*)(surfaceVertices.data()), surfaceVertices.size() * sizeof(float));
+            vboSurface->unmap();
+        }
     }
+
+    vaoSurface->bind();
+    shaderPhong->setUniformValue("ModelMatrix", QMatrix4x4());
+    shaderPhong->setUniformValue("matdiff", GLfloat(45.0/255), GLfloat(114.0/255), GLfloat(178.0/255));
+    shaderPhong->setUniformValue("matspec", 1.0f, 1.0f, 1.0f);
+    shaderPhong->setUniformValue("matshin", 100.f);
+    shaderPhong->setUniformValue("alpha", 0.8f);
+    glFuncs->glDrawArrays(GL_TRIANGLES, vboSurface->getFirstVertex(), numSurfaceVertices);
+    vboSurface->fence();
 }
 
-void SceneFluid::deleteParticles(){
-    for (std::vector<Particle*>::iterator it = particles.begin(); it != particles.end(); it++)
-        delete (*it);
-    particles.clear();
+QStringList SceneFluid::getStats(){
+    if (useGrid) {
+        QStringList stats;
+        stats << "Threads: " + QString::number(pool ? pool->getNumThreads() : 1);
+        stats << "Grid: " + QString::number(gridFluid->getNx()) + " x " + QString::number(gridFluid->getNy())
+                 + " x " + QString::number(gridFluid->getNz()) + " cells";
+        for (int i = 0; i < GridFluid::NumPhases; i++) {
+            stats << QString(GridFluid::phaseName(i)) + ": " + QString::number(gridFluid->getPhaseMs(i), 'f', 2) + " ms";
+        }
+        stats << "CG iters: " + QString::number(gridFluid->getLastIterations())
+                 + ", residual: " + QString::number(gridFluid->getLastError(), 'e', 1);
+        stats << "Dye volume: " + QString::number(gridFluid->getTotalDye(), 'f', 0);
+        stats << "Surface: " + QString::number(numSurfaceVertices/3) + " tris, "
+                 + QString::number(surface->getLastExtractionMs(), 'f', 1) + " ms";
+        return stats;
+    }
+
+    const std::vector<Particle*>& particles = simulation->getParticles();
+    const ForceNavierStockes* fNavierStockes = simulation->getNavierStokes();
+    QStringList stats;
+    stats << "Threads: " + QString::number(pool ? pool->getNumThreads() : 1);
+    stats << "Particles: " + QString::number(particles.size()) + " / " + QString::number(simulation->getCapacity());
+    stats << "Boundary samples: " + QString::number(simulation->getNumBoundarySamples());
+    if (!simulation->getSetup().emitters.empty() || !simulation->getSetup().drains.empty()) {
+        stats << "Spawned: " + QString::number(simulation->getNumSpawned()) + ", retired: " + QString::number(simulation->getNumRetired());
+    }
+    for (int i = 0; i < FluidSimulation::NumPhases; i++) {
+        stats << QString(FluidSimulation::phaseName(i)) + ": " + QString::number(simulation->getPhaseMs(i), 'f', 2) + " ms";
+    }
+    if (simulation->isAdaptive() && simulation->getEngine() == FluidSimulation::EngineSPH) {
+        int coarse = 0;
+        for (const Particle* p : particles) {
+            if (p->mass > simulation->getSetup().particleMass) coarse++;
+        }
+        stats << "Coarse particles: " + QString::number(coarse);
+        stats << "Merges: " + QString::number(simulation->getAdaptivity()->getLastMerges())
+                 + ", splits: " + QString::number(simulation->getAdaptivity()->getLastSplits());
+    }
+    if (simulation->isSleeping()) {
+        stats << "Sleeping: " + QString::number(simulation->getNumSleeping()) + " of "
+                 + QString::number(particles.size());
+    }
+    if (widget->drawSurface()) {
+        stats << "Surface: " + QString::number(numSurfaceVertices/3) + " tris, "
+                 + QString::number(surface->getLastExtractionMs(), 'f', 1) + " ms";
+    }
+    if (simulation->getEngine() != FluidSimulation::EngineSPH && simulation->getFlip()) {
+        const FlipFluid* flip = simulation->getFlip();
+        stats << "Fluid cells: " + QString::number(flip->getNumFluidCells()) + " of "
+                 + QString::number(flip->getNumCells());
+        stats << "CG iters: " + QString::number(flip->getLastIterations())
+                 + ", residual: " + QString::number(flip->getLastError(), 'e', 1);
+    }
+    else if (simulation->getEngine() == FluidSimulation::EngineSPH && fNavierStockes
+             && fNavierStockes->getSolver() == ForceNavierStockes::PCISPH) {
+        stats << "PCISPH iters: " + QString::number(fNavierStockes->getLastIterations());
+        stats << "Density err: " + QString::number(100*fNavierStockes->getLastDensityError(), 'f', 2) + " %";
+    }
+    return stats;
 }
@@ -4,14 +4,16 @@
 #include <QOpenGLShaderProgram>
 #include <QOpenGLVertexArrayObject>
 #include <QOpenGLBuffer>
-#include <Particle.h>
-#include <ParticleHashGrid.h>
-#include "colliders.h"
-#include "forces.h"
-#include "integrators.h"
+#include "fluidsimulation.h"
+#include "fluidsurface.h"
+#include "flipfluid.h"
+#include "gridfluid.h"
 #include "scene.h"
+#include "glutils.h"
 #include "widgetfluid.h"
 
+class QOpenGLFunctions_3_3_Core;
+
 class SceneFluid : public Scene
 {
     Q_OBJECT
@@ -25,14 +27,17 @@ public:
     virtual void update(double dt);
     virtual void paint(const Camera& cam);
 
-    virtual void updateForces();
-    virtual void deleteParticles();
+    void createParticles();
+    void drawSurface(QOpenGLFunctions_3_3_Core* glFuncs);
 
     virtual void getSceneBounds(Vec3& bmin, Vec3& bmax) {
         bmin = Vec3(-100, -100, -100);
         bmax = Vec3( 100,  100,  100);
     }
 
+    virtual unsigned int getNumParticles() { return simulation && !useGrid ? simulation->getParticles().size() : 0; }
+    virtual QStringList getStats();
+
     virtual QWidget* sceneUI() { return widget; }
 
 protected:
@@ -45,37 +50,29 @@ protected:
     QOpenGLVertexArrayObject* vaoFloor   = nullptr;
     QOpenGLVertexArrayObject* vaoWall    = nullptr;
     QOpenGLVertexArrayObject* vaoCube    = nullptr;
+    QOpenGLVertexArrayObject* vaoSurface = nullptr;
+    glutils::DynamicBuffer* vboSurface = nullptr;
+    int numSurfaceVertices = 0;
     unsigned int numFacesSphereS = 0, numFacesSphereL = 0;
     unsigned int numMeshIndices = 0;
 
-    ParticleHashGrid* particleHashGrid;
+    ThreadPool* pool = nullptr;
+
+    // particles, tank and step pipeline, the scene only draws it
+    FluidSimulation* simulation = nullptr;
+
+    // the grid engine runs the same tank instead when selected, picked up on reset
+    GridFluid* gridFluid = nullptr;
+    bool useGrid = false;
 
-    std::vector<Particle*> particles;
-    std::vector<Force*> forces;
-    int numPartX;
-    int numPartY;
-    int numPartZ;
-    int numParticles;
     bool showParticles = true;
     double particleRadius = 1;
     double particleSpacing = 2.0f * particleRadius;
 
-    ForceConstAcceleration* fGravity = nullptr;
-    ForceNavierStockes* fNavierStockes = nullptr;
-
-    IntegratorSymplecticEuler* integrator = nullptr;
-
-    ColliderPlane colliderFloor;
-    ColliderPlane colliderCeiling;
-    ColliderPlane colliderWallLeft;
-    ColliderPlane colliderWallRight;
-    ColliderPlane colliderWallUp;
-    ColliderPlane colliderWallDown;
-
-    double colBounce = 0.01;
-    double colFriction = 0.05;
+    // surface mesh extracted in the background, vertices are position + normal
+    FluidSurface* surface = nullptr;
+    std::vector<float> surfaceVertices;
 
-    float MASS = 1.0f;
     float boundDimensions = 40.0f;
 };
 
@@ -67,11 +67,9 @@ void SceneProjectiles::initialize() {
     vaoTrajectory = new QOpenGLVertexArrayObject();
     vaoTrajectory->create();
     vaoTrajectory->bind();
-    vboTrajectoryPoints = new QOpenGLBuffer(QOpenGLBuffer::Type::VertexBuffer);
-    vboTrajectoryPoints->create();
+    // three trajectories per frame, a ring of three frames
+    vboTrajectoryPoints = new glutils::DynamicBuffer(3*sizeof(float), MAX_TRAJ_POINTS, 9);
     vboTrajectoryPoints->bind();
-    vboTrajectoryPoints->setUsagePattern(QOpenGLBuffer::UsagePattern::DynamicDraw);
-    vboTrajectoryPoints->allocate(MAX_TRAJ_POINTS*3*sizeof(float));
     shaderLines->setAttributeBuffer("vertex", GL_FLOAT, 0, 3, 0);
     shaderLines->enableAttributeArray("vertex");
     vaoTrajectory->release();
@@ -339,25 +337,28 @@ void SceneProjectiles::paint(const Camera& camera) {
         Vec3 c = systemAnalytic.getParticle(0)->color;
         shaderLines->setUniformValue("matdiff", GLfloat(c[0]), GLfloat(c[1]), GLfloat(c[2]));
         vaoTrajectory->bind();
-        glFuncs->glDrawArrays(GL_LINE_STRIP, 0, std::min(static_cast<unsigned int>(trajectoryAnalytic.size()),
-                                                         MAX_TRAJ_POINTS));
+        glFuncs->glDrawArrays(GL_LINE_STRIP, vboTrajectoryPoints->getFirstVertex(),
+                              std::min(static_cast<unsigned int>(trajectoryAnalytic.size()), MAX_TRAJ_POINTS));
         vaoTrajectory->release();
+        vboTrajectoryPoints->fence();
 
         updateTrajectoryCoordsBuffer(trajectoryNumerical1, widget->renderSameZ());
         c = systemNumerical1.getParticle(0)->color;
         shaderLines->setUniformValue("matdiff", GLfloat(c[0]), GLfloat(c[1]), GLfloat(c[2]));
         vaoTrajectory->bind();
-        glFuncs->glDrawArrays(GL_LINE_STRIP, 0, std::min(static_cast<unsigned int>(trajectoryNumerical1.size()),
-                                                         MAX_TRAJ_POINTS));
+        glFuncs->glDrawArrays(GL_LINE_STRIP, vboTrajectoryPoints->getFirstVertex(),
+                              std::min(static_cast<unsigned int>(trajectoryNumerical1.size()), MAX_TRAJ_POINTS));
         vaoTrajectory->release();
+        vboTrajectoryPoints->fence();
 
         updateTrajectoryCoordsBuffer(trajectoryNumerical2, widget->renderSameZ());
         c = systemNumerical2.getParticle(0)->color;
         shaderLines->setUniformValue("matdiff", GLfloat(c[0]), GLfloat(c[1]), GLfloat(c[2]));
         vaoTrajectory->bind();
-        glFuncs->glDrawArrays(GL_LINE_STRIP, 0, std::min(static_cast<unsigned int>(trajectoryNumerical2.size()),
-                                                         MAX_TRAJ_POINTS));
+        glFuncs->glDrawArrays(GL_LINE_STRIP, vboTrajectoryPoints->getFirstVertex(),
+                              std::min(static_cast<unsigned int>(trajectoryNumerical2.size()), MAX_TRAJ_POINTS));
         vaoTrajectory->release();
+        vboTrajectoryPoints->fence();
 
         shaderLines->release();
     }
@@ -365,8 +366,7 @@ void SceneProjectiles::paint(const Camera& camera) {
 
 
 void SceneProjectiles::updateTrajectoryCoordsBuffer(const std::list<Vec3>& trajectory, bool sameZ) {
-    vboTrajectoryPoints->bind();
-    float* pos = new float[3*trajectory.size()];
+    float* pos = static_cast<float*>(vboTrajectoryPoints->map(trajectory.size()));
     unsigned int i = 0;
     for (auto it = trajectory.begin(); it != trajectory.end(); it++) {
         pos[3*i  ] = it->x();
@@ -374,10 +374,5 @@ void SceneProjectiles::updateTrajectoryCoordsBuffer(const std::list<Vec3>& traje
         pos[3*i+2] = sameZ ? 0 : it->z();
         i++;
     }
-    void* bufptr = vboTrajectoryPoints->mapRange(0, 3*trajectory.size()*sizeof(float),
-                                                 QOpenGLBuffer::RangeInvalidateBuffer | QOpenGLBuffer::RangeWrite);
-    memcpy(bufptr, (void*)(pos), 3*trajectory.size()*sizeof(float));
     vboTrajectoryPoints->unmap();
-    vboTrajectoryPoints->release();
-    delete[] pos;
 }
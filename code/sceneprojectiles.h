@@ -5,6 +5,7 @@
 #include <QOpenGLVertexArrayObject>
 #include <QOpenGLBuffer>
 #include "scene.h"
+#include "glutils.h"
 #include "widgetprojectiles.h"
 #include "particlesystem.h"
 #include "integrators.h"
@@ -42,7 +43,7 @@ protected:
     QOpenGLVertexArrayObject* vaoFloor = nullptr;
     QOpenGLVertexArrayObject* vaoCube = nullptr;
     QOpenGLVertexArrayObject* vaoTrajectory = nullptr;
-    QOpenGLBuffer* vboTrajectoryPoints = nullptr;
+    glutils::DynamicBuffer* vboTrajectoryPoints = nullptr;
     unsigned int numSphereFaces = 0;
     const unsigned int MAX_TRAJ_POINTS = 1000;
 
@@ -0,0 +1,227 @@
+#ifndef SPHKERNELS_H
+#define SPHKERNELS_H
+
+#include "defines.h"
+#include <cmath>
+
+/*
+ *  SPH smoothing kernels with support radius h. Normalization constants are computed once
+ *  in the constructor, so evaluating a kernel is only a few multiplications.
+ *
+ *  All kernels share the same interface, so they can be swapped as template arguments:
+ *    value(r2)         W for squared distance r2
+ *    gradient(rij, r)  gradient of W at xi, with rij = xi - xj and r = |rij|
+ *    laplacian(r)      laplacian of W
+ *  Everything is zero outside the support.
+ */
+
+template<typename Real = double>
+class KernelPoly6 {
+public:
+    typedef Eigen::Matrix<Real, 3, 1> Vec;
+
+    explicit KernelPoly6(Real h) : h(h), h2(h*h) {
+        Real h9 = h2*h2*h2*h2*h;
+        cValue = Real(315.0 / (64.0 * M_PI)) / h9;
+        cGrad  = Real(-945.0 / (32.0 * M_PI)) / h9;
+    }
+
+    Real value(Real r2) const {
+        if (r2 >= h2) return 0;
+        Real d = h2 - r2;
+        return cValue * d*d*d;
+    }
+
+    Vec gradient(const Vec& rij, Real r) const {
+        if (r >= h) return Vec::Zero();
+        Real d = h2 - r*r;
+        return (cGrad * d*d) * rij;
+    }
+
+    Real laplacian(Real r) const {
+        if (r >= h) return 0;
+        Real r2 = r*r;
+        return cGrad * (h2 - r2) * (3*h2 - 7*r2);
+    }
+
+    Real support() const { return h; }
+
+protected:
+    Real h, h2;
+    Real cValue, cGrad;
+};
+
+
+template<typename Real = double>
+class KernelSpiky {
+public:
+    typedef Eigen::Matrix<Real, 3, 1> Vec;
+
+    explicit KernelSpiky(Real h) : h(h), h2(h*h) {
+        Real h6 = h2*h2*h2;
+        cValue = Real(15.0 / M_PI) / h6;
+        cGrad  = Real(-45.0 / M_PI) / h6;
+        cLap   = Real(90.0 / M_PI) / h6;
+    }
+
+    Real value(Real r2) const {
+        if (r2 >= h2) return 0;
+        Real d = h - std::sqrt(r2);
+        return cValue * d*d*d;
+    }
+
+    Vec gradient(const Vec& rij, Real r) const {
+        if (r >= h || r <= 0) return Vec::Zero();
+        Real d = h - r;
+        return (cGrad * d*d / r) * rij;
+    }
+
+    Real laplacian(Real r) const {
+        if (r >= h || r <= 0) return 0;
+        return cLap * (h - r) * (2*r - h) / r;
+    }
+
+    Real support() const { return h; }
+
+protected:
+    Real h, h2;
+    Real cValue, cGrad, cLap;
+};
+
+
+// Mueller et al. 2003 viscosity kernel, meant to be used through its laplacian
+template<typename Real = double>
+class KernelViscosity {
+public:
+    typedef Eigen::Matrix<Real, 3, 1> Vec;
+
+    explicit KernelViscosity(Real h) : h(h), h2(h*h), h3(h*h*h) {
+        cValue = Real(15.0 / (2.0 * M_PI)) / h3;
+        cLap   = Real(45.0 / M_PI) / (h3*h3);
+    }
+
+    Real value(Real r2) const {
+        if (r2 >= h2 || r2 <= 0) return 0;
+        Real r = std::sqrt(r2);
+        return cValue * (-r2*r/(2*h3) + r2/h2 + h/(2*r) - 1);
+    }
+
+    Vec gradient(const Vec& rij, Real r) const {
+        if (r >= h || r <= 0) return Vec::Zero();
+        Real dW = cValue * (-3*r/(2*h3) + 2/h2 - h/(2*r*r*r));
+        return dW * rij;
+    }
+
+    Real laplacian(Real r) const {
+        if (r >= h) return 0;
+        return cLap * (h - r);
+    }
+
+    Real support() const { return h; }
+
+protected:
+    Real h, h2, h3;
+    Real cValue, cLap;
+};
+
+
+// Monaghan cubic spline, with support h instead of 2h
+template<typename Real = double>
+class KernelCubicSpline {
+public:
+    typedef Eigen::Matrix<Real, 3, 1> Vec;
+
+    explicit KernelCubicSpline(Real h) : h(h), h2(h*h), invH(1/h) {
+        cValue = Real(8.0 / M_PI) / (h2*h);
+        cGrad  = cValue * invH;
+        cLap   = cGrad * invH;
+    }
+
+    Real value(Real r2) const {
+        if (r2 >= h2) return 0;
+        Real q = std::sqrt(r2) * invH;
+        if (q <= Real(0.5)) return cValue * (6*(q*q*q - q*q) + 1);
+        Real d = 1 - q;
+        return cValue * 2*d*d*d;
+    }
+
+    Vec gradient(const Vec& rij, Real r) const {
+        if (r >= h || r <= 0) return Vec::Zero();
+        return (firstDerivative(r * invH) / r) * rij;
+    }
+
+    Real laplacian(Real r) const {
+        if (r >= h) return 0;
+        Real q = r * invH;
+        Real d2W = (q <= Real(0.5)) ? cLap * 6*(6*q - 2) : cLap * 12*(1 - q);
+        if (r <= 0) return 3 * d2W;
+        return d2W + 2 * firstDerivative(q) / r;
+    }
+
+    Real support() const { return h; }
+
+protected:
+    Real firstDerivative(Real q) const {
+        if (q <= Real(0.5)) return cGrad * 6*(3*q*q - 2*q);
+        Real d = 1 - q;
+        return cGrad * -6*d*d;
+    }
+
+    Real h, h2, invH;
+    Real cValue, cGrad, cLap;
+};
+
+
+// Wendland C2 kernel, does not suffer from pairing instability
+template<typename Real = double>
+class KernelWendland {
+public:
+    typedef Eigen::Matrix<Real, 3, 1> Vec;
+
+    explicit KernelWendland(Real h) : h(h), h2(h*h), invH(1/h) {
+        cValue = Real(21.0 / (2.0 * M_PI)) / (h2*h);
+        cGrad  = cValue * invH * -20;
+        cLap   = cGrad * invH;
+    }
+
+    Real value(Real r2) const {
+        if (r2 >= h2) return 0;
+        Real q = std::sqrt(r2) * invH;
+        Real d = 1 - q;
+        return cValue * d*d*d*d * (1 + 4*q);
+    }
+
+    Vec gradient(const Vec& rij, Real r) const {
+        if (r >= h || r <= 0) return Vec::Zero();
+        Real d = 1 - r * invH;
+        // dW/dr = cGrad * q * d^3, divided by r
+        return (cGrad * invH * d*d*d) * rij;
+    }
+
+    Real laplacian(Real r) const {
+        if (r >= h) return 0;
+        Real q = r * invH;
+        Real d = 1 - q;
+        // d2W/dr2 + 2/r dW/dr
+        return cLap * d*d * (1 - 4*q) + 2 * cLap * d*d*d;
+    }
+
+    Real support() const { return h; }
+
+protected:
+    Real h, h2, invH;
+    Real cValue, cGrad, cLap;
+};
+
+
+// kernels used by ForceNavierStockes, change them here to pick a different combination
+typedef KernelPoly6<double>     SPHDensityKernel;
+typedef KernelSpiky<double>     SPHPressureKernel;
+typedef KernelViscosity<double> SPHViscosityKernel;
+
+// the same kernels in single precision, for the mixed precision path
+typedef KernelPoly6<float>      SPHDensityKernelF;
+typedef KernelSpiky<float>      SPHPressureKernelF;
+typedef KernelViscosity<float>  SPHViscosityKernelF;
+
+#endif // SPHKERNELS_H
@@ -0,0 +1,104 @@
+#include "threadpool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(int numThreads) : nextChunk(0) {
+    setNumThreads(numThreads);
+}
+
+ThreadPool::~ThreadPool() {
+    stopWorkers();
+}
+
+int ThreadPool::hardwareThreads() {
+    return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::setNumThreads(int n) {
+    if (n <= 0) n = hardwareThreads();
+    if (n == numThreads && static_cast<int>(workers.size()) == numThreads - 1) return;
+
+    stopWorkers();
+    numThreads = n;
+    startWorkers();
+}
+
+void ThreadPool::startWorkers() {
+    stopping = false;
+    for (int t = 1; t < numThreads; t++) {
+        workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+}
+
+void ThreadPool::stopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cvWork.notify_all();
+    for (std::thread& w : workers) {
+        w.join();
+    }
+    workers.clear();
+}
+
+void ThreadPool::runChunks() {
+    int c;
+    while ((c = nextChunk.fetch_add(1)) < numChunks) {
+        int begin = c * chunkSize;
+        int end = std::min(begin + chunkSize, jobSize);
+        (*job)(begin, end);
+    }
+}
+
+void ThreadPool::workerLoop() {
+    unsigned long long seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cvWork.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+
+        runChunks();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busyWorkers--;
+        }
+        cvDone.notify_one();
+    }
+}
+
+void ThreadPool::parallelFor(int n, const std::function<void(int, int)>& f) {
+    if (n <= 0) return;
+    if (numThreads == 1 || n == 1) {
+        f(0, n);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // a few chunks per thread so uneven ranges still balance
+        numChunks = std::min(n, 4 * numThreads);
+        chunkSize = (n + numChunks - 1) / numChunks;
+        numChunks = (n + chunkSize - 1) / chunkSize;
+        jobSize = n;
+        job = &f;
+        nextChunk = 0;
+        busyWorkers = static_cast<int>(workers.size());
+        generation++;
+    }
+    cvWork.notify_all();
+
+    runChunks();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    cvDone.wait(lock, [&] { return busyWorkers == 0; });
+    job = nullptr;
+}
@@ -0,0 +1,56 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ *  Fixed set of worker threads running data-parallel loops. parallelFor splits [0, n) in
+ *  contiguous chunks, runs f(begin, end) on them and returns when all are done. The calling
+ *  thread works on chunks too, so a pool with one thread runs everything inline.
+ *  parallelFor must not be called from inside a running job.
+ */
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int numThreads = 0);   // 0 uses all hardware threads
+    ~ThreadPool();
+
+    void setNumThreads(int numThreads);
+    int getNumThreads() const { return numThreads; }
+
+    void parallelFor(int n, const std::function<void(int, int)>& f);
+
+    // pool shared by all the scenes
+    static ThreadPool& shared();
+    static int hardwareThreads();
+
+protected:
+    void startWorkers();
+    void stopWorkers();
+    void workerLoop();
+    void runChunks();
+
+    int numThreads = 1;
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable cvWork;
+    std::condition_variable cvDone;
+    bool stopping = false;
+    unsigned long long generation = 0;
+    int busyWorkers = 0;
+
+    // current job
+    const std::function<void(int, int)>* job = nullptr;
+    int jobSize = 0;
+    int chunkSize = 1;
+    int numChunks = 0;
+    std::atomic<int> nextChunk;
+};
+
+#endif // THREADPOOL_H
@@ -6,6 +6,8 @@ WidgetCloth::WidgetCloth(QWidget *parent) :
     ui(new Ui::WidgetCloth)
 {
     ui->setupUi(this);
+    ui->mesh->addItem("Grid");
+    ui->mesh->addItem("Sphere");
 
     connect(ui->btnUpdate, &QPushButton::clicked,
             this, [=] (void) { emit updatedParameters(); });
@@ -47,3 +49,35 @@ double WidgetCloth::getParticleRadius() const {
 bool WidgetCloth::showParticles() const {
     return ui->showParticles->isChecked();
 }
+
+bool WidgetCloth::selfCollisions() const {
+    return ui->selfCollisions->isChecked();
+}
+
+bool WidgetCloth::multigrid() const {
+    return ui->multigrid->isChecked();
+}
+
+bool WidgetCloth::tearing() const {
+    return ui->tearing->isChecked();
+}
+
+double WidgetCloth::getTearStrain() const {
+    return ui->tearStrain->value();
+}
+
+int WidgetCloth::getMesh() const {
+    return ui->mesh->currentIndex();
+}
+
+bool WidgetCloth::wind() const {
+    return ui->wind->isChecked();
+}
+
+double WidgetCloth::getWindSpeed() const {
+    return ui->windSpeed->value();
+}
+
+bool WidgetCloth::sleeping() const {
+    return ui->sleeping->isChecked();
+}
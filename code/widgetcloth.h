@@ -25,6 +25,14 @@ public:
     double getParticleRadius() const;
 
     bool showParticles()       const;
+    bool selfCollisions()      const;
+    bool multigrid()           const;
+    bool tearing()             const;
+    double getTearStrain()     const;
+    int getMesh()              const;
+    bool wind()                const;
+    double getWindSpeed()      const;
+    bool sleeping()            const;
 
 signals:
     void updatedParameters();
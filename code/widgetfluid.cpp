@@ -1,5 +1,6 @@
 #include "widgetfluid.h".h"
 #include "ui_widgetfluid.h"
+#include "threadpool.h"
 
 WidgetFluid::WidgetFluid(QWidget *parent) :
     QWidget(parent),
@@ -8,6 +9,29 @@ WidgetFluid::WidgetFluid(QWidget *parent) :
     ui->setupUi(this);
     ui->comboBox->addItem("Double wall");
     ui->comboBox->addItem("Cube");
+    ui->comboBox->addItem("River");
+    ui->solver->addItem("Weakly compressible");
+    ui->solver->addItem("PCISPH");
+    ui->engine->addItem("SPH");
+    ui->engine->addItem("FLIP");
+    ui->engine->addItem("APIC");
+    ui->engine->addItem("Grid (stable fluids)");
+    ui->precision->addItem("Double");
+    ui->precision->addItem("Mixed");
+    ui->precision->addItem("Mixed, Kahan sums");
+    ui->numThreads->setValue(ThreadPool::hardwareThreads());
+
+    // the solver, precision, adaptivity and sleep settings only drive the SPH engine
+    connect(ui->engine, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged),
+            this, [=] (int index) {
+        bool sph = index == 0;
+        ui->solver->setEnabled(sph);
+        ui->densityTolerance->setEnabled(sph);
+        ui->maxIterations->setEnabled(sph);
+        ui->precision->setEnabled(sph);
+        ui->adaptiveResolution->setEnabled(sph);
+        ui->sleeping->setEnabled(sph);
+    });
 }
 
 WidgetFluid::~WidgetFluid()
@@ -18,3 +42,43 @@ WidgetFluid::~WidgetFluid()
 int WidgetFluid::getComboBoxIndex(){
     return ui->comboBox->currentIndex();
 }
+
+bool WidgetFluid::colorByDensity() const {
+    return ui->colorByDensity->isChecked();
+}
+
+int WidgetFluid::getSolver() const {
+    return ui->solver->currentIndex();
+}
+
+double WidgetFluid::getDensityTolerance() const {
+    return 0.01 * ui->densityTolerance->value();
+}
+
+int WidgetFluid::getMaxIterations() const {
+    return ui->maxIterations->value();
+}
+
+int WidgetFluid::getNumThreads() const {
+    return ui->numThreads->value();
+}
+
+bool WidgetFluid::drawSurface() const {
+    return ui->drawSurface->isChecked();
+}
+
+bool WidgetFluid::adaptiveResolution() const {
+    return ui->adaptiveResolution->isChecked();
+}
+
+int WidgetFluid::getPrecision() const {
+    return ui->precision->currentIndex();
+}
+
+int WidgetFluid::getEngine() const {
+    return ui->engine->currentIndex();
+}
+
+bool WidgetFluid::sleeping() const {
+    return ui->sleeping->isChecked();
+}
@@ -16,6 +16,16 @@ public:
     ~WidgetFluid();
 
     int getComboBoxIndex();
+    bool colorByDensity() const;
+    int getSolver() const;
+    double getDensityTolerance() const;
+    int getMaxIterations() const;
+    int getNumThreads() const;
+    bool drawSurface() const;
+    bool adaptiveResolution() const;
+    int getPrecision() const;
+    int getEngine() const;
+    bool sleeping() const;
 private:
     Ui::WidgetFluid *ui;
 };